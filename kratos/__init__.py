@@ -2,6 +2,7 @@ from .generator import Generator, PortType, PortDirection, BlockEdgeType, \
     always, verilog, signed, CombinationalCodeBlock, SequentialCodeBlock
 
 from .passes import Attribute
+from .sim import Simulator
 
 # directly import from the underlying C++ binding
 from _kratos.util import is_valid_verilog
@@ -11,7 +12,7 @@ from _kratos import SwitchStmt, PackedStruct, Port, Var
 
 __all__ = ["Generator", "PortType", "PortDirection", "BlockEdgeType", "always",
            "verilog", "signed", "is_valid_verilog", "VarException",
-           "StmtException", "ASTVisitor"]
+           "StmtException", "ASTVisitor", "Simulator"]
 
 # code blocks
 __all__ += ["CombinationalCodeBlock", "SequentialCodeBlock", "SwitchStmt",
@@ -1,4 +1,5 @@
 import enum
+import os
 from .pyast import transform_stmt_block, get_fn_ln
 import _kratos
 from typing import List, Dict, Union
@@ -262,7 +263,19 @@ class Generator(metaclass=GeneratorMeta):
         return self.__generator.get_var(name)
 
     def const(self, value: int, width: int, signed: bool = False):
-        return self.__generator.constant(value, width, signed)
+        if width <= 64 and value < (1 << 63):
+            return self.__generator.constant(value, width, signed)
+        # wide constants are passed in as a bit vector
+        if signed:
+            if not -(1 << (width - 1)) <= value < (1 << (width - 1)):
+                raise ValueError("{0} does not fit into {1} bits".format(value,
+                                                                         width))
+            value &= (1 << width) - 1
+        elif value < 0:
+            raise ValueError("{0} is negative but the constant is "
+                             "unsigned".format(value))
+        bits = _kratos.BitVector.from_hex("{0:x}".format(value), width)
+        return self.__generator.constant(bits, signed)
 
     @property
     def internal_generator(self):
@@ -450,15 +463,58 @@ def verilog(generator: Generator, optimize_if: bool = True,
             additional_passes: Dict = None,
             extra_struct: bool = False,
             filename: str = None,
-            use_parallel: bool = True):
+            use_parallel: bool = True,
+            output_dir: str = None,
+            cache_dir: str = None,
+            fold_constants: bool = False,
+            cse_min_size: int = 0,
+            remove_dead_logic: bool = False,
+            inline_max_size: int = 0,
+            inline_attribute: str = "",
+            inline_pattern: str = ""):
     code_gen = _kratos.VerilogModule(generator.internal_generator)
     pass_manager = code_gen.pass_manager()
     if additional_passes is not None:
         for name, fn in additional_passes.items():
             pass_manager.add_pass(name, fn)
+    if cache_dir is not None:
+        # unchanged modules are loaded from cache_dir instead of generated
+        os.makedirs(cache_dir, exist_ok=True)
+    Generator.get_context().set_codegen_cache_dir(
+        cache_dir if cache_dir is not None else "")
+    if output_dir is not None:
+        # modules are streamed to output_dir/module_name.sv and only the
+        # manifest is returned. filename is ignored
+        os.makedirs(output_dir, exist_ok=True)
+        code_gen.set_output_path(output_dir, True)
+    if inline_max_size > 0 or inline_attribute or inline_pattern:
+        # children that are small enough, carry the attribute or whose name
+        # matches the pattern are merged into their parent
+        policy = _kratos.passes.InlinePolicy()
+        policy.max_size = inline_max_size
+        policy.attribute = inline_attribute
+        policy.name_pattern = inline_pattern
+        code_gen.set_inline_policy(policy)
+    if fold_constants:
+        # constant expressions are evaluated and branches on constant
+        # predicates are pruned
+        code_gen.set_fold_constants(True)
+    if remove_dead_logic:
+        # logic that doesn't reach a top level output is removed, including
+        # unused child ports
+        code_gen.set_remove_dead_logic(True)
+    if cse_min_size > 0:
+        # repeated expressions with at least cse_min_size nodes are hoisted
+        # into wires
+        code_gen.set_cse_min_size(cse_min_size)
     code_gen.run_passes(use_parallel, optimize_if, optimize_passthrough,
                         optimize_fanout)
-    src = code_gen.verilog_src()
+    if output_dir is not None:
+        src = {name: entry.filename for name, entry in
+               code_gen.manifest().items()}
+        filename = None
+    else:
+        src = code_gen.verilog_src()
     result = [src]
     if debug:
         info = _kratos.passes.extract_debug_info(generator.internal_generator)
@@ -8,10 +8,12 @@ import _kratos
 class HashStrategy(enum.Enum):
     SequentialHash = _kratos.HashStrategy.SequentialHash
     ParallelHash = _kratos.HashStrategy.ParallelHash
+    StructuralHash = _kratos.HashStrategy.StructuralHash
+    ParallelStructuralHash = _kratos.HashStrategy.ParallelStructuralHash
 
 
-def uniquify_generators(generator: Generator):
-    _uniquify_generators(generator.internal_generator)
+def uniquify_generators(generator: Generator, verify: bool = False):
+    _uniquify_generators(generator.internal_generator, verify)
 
 
 def hash_generators(generator: Generator,
@@ -0,0 +1,43 @@
+from .generator import Generator
+from typing import Union
+import _kratos
+
+
+class Simulator:
+    """cycle-based simulator that runs on the generator IR directly.
+    vars are either var objects or names relative to the top generator,
+    e.g. "child.in"
+    """
+    def __init__(self, generator: Generator):
+        self.__generator = generator
+        self.__sim = _kratos.Simulator(generator.internal_generator)
+
+    def __get_var(self, var: Union[str, _kratos.Var]):
+        if isinstance(var, str):
+            return self.__sim.get_var(var)
+        return var
+
+    def poke(self, var: Union[str, _kratos.Var], value: int):
+        var = self.__get_var(var)
+        # negative values are passed in as two's complement
+        self.__sim.poke(var, value & ((1 << 64) - 1))
+
+    def peek(self, var: Union[str, _kratos.Var]):
+        var = self.__get_var(var)
+        value = self.__sim.peek(var)
+        if var.signed and value >> (var.width - 1):
+            value -= 1 << var.width
+        return value
+
+    def step(self, clock: Union[str, _kratos.Var] = None):
+        if clock is None:
+            self.__sim.step()
+        else:
+            self.__sim.step(self.__get_var(clock))
+
+
+def simulation_cpp(generator: Generator, lanes: int = 64):
+    """C++ source of a standalone model that evaluates lanes independent
+    stimulus vectors per call
+    """
+    return _kratos.SimulationCodeGen(generator.internal_generator, lanes).str()
@@ -7,6 +7,7 @@
 #include "../src/expr.hh"
 #include "../src/generator.hh"
 #include "../src/pass.hh"
+#include "../src/simgen.hh"
 #include "../src/stmt.hh"
 #include "../src/util.hh"
 
@@ -32,6 +33,8 @@ void init_enum(py::module &m) {
     py::enum_<HashStrategy>(m, "HashStrategy")
         .value("SequentialHash", HashStrategy::SequentialHash)
         .value("ParallelHash", HashStrategy::ParallelHash)
+        .value("StructuralHash", HashStrategy::StructuralHash)
+        .value("ParallelStructuralHash", HashStrategy::ParallelStructuralHash)
         .export_values();
 
     py::enum_<StatementType>(m, "StatementType")
@@ -83,25 +86,93 @@ void init_pass(py::module &m) {
     pass_m.def("fix_assignment_type", &fix_assignment_type)
         .def("remove_unused_vars", &remove_unused_vars)
         .def("verify_generator_connectivity", &verify_generator_connectivity)
+        .def("verify_generators", &verify_generators)
         .def("create_module_instantiation", &create_module_instantiation)
         .def("hash_generators", &hash_generators)
         .def("decouple_generator_ports", &decouple_generator_ports)
-        .def("uniquify_generators", &uniquify_generators)
+        .def("uniquify_generators", py::overload_cast<Generator *>(&uniquify_generators))
+        .def("uniquify_generators", py::overload_cast<Generator *, bool>(&uniquify_generators))
         .def("uniquify_module_instances", &uniquify_module_instances)
-        .def("generate_verilog", &generate_verilog)
+        .def("generate_verilog", py::overload_cast<Generator *>(&generate_verilog))
+        .def("generate_verilog", py::overload_cast<Generator *, bool>(&generate_verilog))
+        .def("generate_verilog",
+             py::overload_cast<Generator *, const std::string &, bool, bool>(&generate_verilog))
         .def("transform_if_to_case", &transform_if_to_case)
         .def("remove_fanout_one_wires", &remove_fanout_one_wires)
         .def("remove_pass_through_modules", &remove_pass_through_modules)
         .def("extract_debug_info", &extract_debug_info)
         .def("extract_struct_info", &extract_struct_info)
-        .def("merge_wire_assignments", merge_wire_assignments);
+        .def("merge_wire_assignments", merge_wire_assignments)
+        .def("fold_constants", &fold_constants)
+        .def("eliminate_common_subexpressions",
+             py::overload_cast<Generator *>(&eliminate_common_subexpressions))
+        .def("eliminate_common_subexpressions",
+             py::overload_cast<Generator *, uint32_t>(&eliminate_common_subexpressions))
+        .def("remove_dead_logic", &remove_dead_logic)
+        .def("inline_generators", &inline_generators);
+
+    py::class_<InlinePolicy>(pass_m, "InlinePolicy")
+        .def(py::init<>())
+        .def_readwrite("max_size", &InlinePolicy::max_size)
+        .def_readwrite("attribute", &InlinePolicy::attribute)
+        .def_readwrite("name_pattern", &InlinePolicy::name_pattern);
+
+    py::class_<PassInfo>(pass_m, "PassInfo")
+        .def(py::init<>())
+        .def_readwrite("dependencies", &PassInfo::dependencies)
+        .def_readwrite("uses", &PassInfo::uses)
+        .def_readwrite("preserves", &PassInfo::preserves)
+        .def_readwrite("read_only", &PassInfo::read_only);
+
+    py::class_<VerilogFileEntry>(pass_m, "VerilogFileEntry")
+        .def_readonly("filename", &VerilogFileEntry::filename)
+        .def_readonly("line_offset", &VerilogFileEntry::line_offset)
+        .def_readonly("num_lines", &VerilogFileEntry::num_lines);
 
     auto manager = py::class_<PassManager>(pass_m, "PassManager");
     manager.def(py::init<>())
         .def("add_pass", py::overload_cast<const std::string &, std::function<void(Generator *)>>(
                              &PassManager::add_pass))
-        .def("run_passes", &PassManager::run_passes)
-        .def("has_pass", &PassManager::has_pass);
+        .def("add_pass",
+             py::overload_cast<const std::string &, std::function<void(Generator *)>,
+                               const PassInfo &>(&PassManager::add_pass))
+        // read-only passes may run on other threads. python passes take the GIL when they are
+        // called, so concurrent python passes run one at a time
+        .def("run_passes", &PassManager::run_passes, py::call_guard<py::gil_scoped_release>())
+        .def("has_pass", &PassManager::has_pass)
+        .def("pass_order", &PassManager::pass_order)
+        .def("is_analysis_cached",
+             [](PassManager &manager, const std::string &name) {
+                 return manager.analyses().is_cached(name);
+             })
+        .def("set_profiling", &PassManager::set_profiling)
+        .def("profiling", &PassManager::profiling)
+        .def("profile",
+             [](const PassManager &manager) {
+                 auto node_count = [](const IRNodeCount &count) {
+                     py::dict result;
+                     result["generators"] = count.generators;
+                     result["vars"] = count.vars;
+                     result["stmts"] = count.stmts;
+                     result["exprs"] = count.exprs;
+                     return result;
+                 };
+                 // python dict preserves the pass order
+                 py::dict result;
+                 for (auto const &entry : manager.profile()) {
+                     py::dict value;
+                     value["wall_time"] = entry.wall_time;
+                     value["cpu_time"] = entry.cpu_time;
+                     value["num_allocations"] = entry.num_allocations;
+                     value["allocated_bytes"] = entry.allocated_bytes;
+                     value["nodes_before"] = node_count(entry.nodes_before);
+                     value["nodes_after"] = node_count(entry.nodes_after);
+                     result[py::str(entry.name)] = value;
+                 }
+                 return result;
+             })
+        .def("profile_json", &PassManager::profile_json)
+        .def("dump_profile", &PassManager::dump_profile);
 
     // trampoline class for ast visitor
     class PyASTVisitor : public ASTVisitor {
@@ -235,11 +306,37 @@ void init_common_expr(T &class_) {
              py::return_value_policy::reference)
         .def("type", &K::type)
         .def("concat", &K::concat, py::return_value_policy::reference)
-        .def_readwrite("name", &K::name)
-        .def_readwrite("width", &K::width)
-        .def_readwrite("signed", &K::is_signed)
-        .def("sources", &K::sources, py::return_value_policy::reference)
-        .def("sinks", &K::sinks, py::return_value_policy::reference)
+        // the hash covers these fields, so writing them marks the generator dirty
+        .def_property(
+            "name", [](const K &var) { return var.name; },
+            [](K &var, const std::string &name) {
+                var.name = name;
+                var.generator->mark_dirty();
+            })
+        .def_property(
+            "width", [](const K &var) { return var.width; },
+            [](K &var, uint32_t width) {
+                var.width = width;
+                var.generator->mark_dirty();
+            })
+        .def_property(
+            "signed", [](const K &var) { return var.is_signed; },
+            [](K &var, bool is_signed) {
+                var.is_signed = is_signed;
+                var.generator->mark_dirty();
+            })
+        .def("sources",
+             [](const K &var) {
+                 // a list, so python sees the connection order
+                 auto const &sources = var.sources();
+                 return std::vector<std::shared_ptr<AssignStmt>>(sources.begin(), sources.end());
+             })
+        .def("sinks",
+             [](const K &var) {
+                 // a list, so python sees the connection order
+                 auto const &sinks = var.sinks();
+                 return std::vector<std::shared_ptr<AssignStmt>>(sinks.begin(), sinks.end());
+             })
         .def("cast", &K::cast)
         .def_property_readonly("generator", [](const K &var) { return var.generator; });
 
@@ -275,9 +372,20 @@ void init_expr(py::module &m) {
     port.def("port_direction", &Port::port_direction).def("port_type", &Port::port_type);
     def_trace<py::class_<Port, ::shared_ptr<Port>, Var>, Port>(port);
 
+    py::class_<BitVector>(m, "BitVector")
+        .def(py::init<int64_t, uint32_t>())
+        .def_static("from_hex", &BitVector::from_hex)
+        .def("width", &BitVector::width)
+        .def("to_hex", &BitVector::to_hex)
+        .def("to_string", &BitVector::to_string)
+        .def("__eq__", &BitVector::operator==);
+
     auto const_ = py::class_<Const, ::shared_ptr<Const>, Var>(m, "Const");
     init_var_derived(const_);
-    const_.def("value", &Const::value).def("set_value", &Const::set_value);
+    const_.def("value", &Const::value)
+        .def("set_value", py::overload_cast<int64_t>(&Const::set_value))
+        .def("set_value", py::overload_cast<const BitVector &>(&Const::set_value))
+        .def("bits", &Const::bits);
     def_trace<py::class_<Const, ::shared_ptr<Const>, Var>, Const>(const_);
 
     auto slice = py::class_<VarSlice, ::shared_ptr<VarSlice>, Var>(m, "VarSlice");
@@ -290,7 +398,10 @@ void init_expr(py::module &m) {
 
     auto param = py::class_<Param, ::shared_ptr<Param>, Var>(m, "Param");
     init_var_derived(param);
-    param.def("value", &Param::value).def("set_value", &Param::set_value);
+    param.def("value", &Param::value)
+        .def("set_value", py::overload_cast<int64_t>(&Param::set_value))
+        .def("set_value", py::overload_cast<const BitVector &>(&Param::set_value))
+        .def("bits", &Param::bits);
     def_trace<py::class_<Param, ::shared_ptr<Param>, Var>, Param>(param);
 
     auto port_packed = py::class_<PortPacked, ::shared_ptr<PortPacked>, Var>(m, "PortPacked");
@@ -326,7 +437,9 @@ void init_context(py::module &m) {
         .def("hash_table_size", &Context::hash_table_size)
         .def("change_generator_name", &Context::change_generator_name)
         .def("add", &Context::add)
-        .def("has_hash", &Context::has_hash);
+        .def("has_hash", &Context::has_hash)
+        .def("codegen_cache_dir", &Context::codegen_cache_dir)
+        .def("set_codegen_cache_dir", &Context::set_codegen_cache_dir);
 }
 
 void init_generator(py::module &m) {
@@ -347,6 +460,8 @@ void init_generator(py::module &m) {
              py::return_value_policy::reference)
         .def("constant", py::overload_cast<int64_t, uint32_t, bool>(&Generator::constant),
              py::return_value_policy::reference)
+        .def("constant", py::overload_cast<const BitVector &, bool>(&Generator::constant),
+             py::return_value_policy::reference)
         .def("parameter",
              py::overload_cast<const std::string &, uint32_t, bool>(&Generator::parameter),
              py::return_value_policy::reference)
@@ -359,6 +474,7 @@ void init_generator(py::module &m) {
         .def("vars", &Generator::vars)
         .def("add_stmt", &Generator::add_stmt)
         .def("remove_stmt", &Generator::remove_stmt)
+        .def("remove_stmts", &Generator::remove_stmts)
         .def("stmts_count", &Generator::stmts_count)
         .def("get_stmt", &Generator::get_stmt)
         .def("sequential", &Generator::sequential, py::return_value_policy::reference)
@@ -378,11 +494,20 @@ void init_generator(py::module &m) {
         .def("external_filename", &Generator::external_filename)
         .def("is_stub", &Generator::is_stub)
         .def("set_is_stub", &Generator::set_is_stub)
+        .def("is_dirty", &Generator::is_dirty)
+        .def("mark_dirty", &Generator::mark_dirty)
         .def("wire_ports", &Generator::wire_ports)
         .def("get_unique_variable_name", &Generator::get_unique_variable_name)
         .def("context", &Generator::context, py::return_value_policy::reference)
-        .def_readwrite("instance_name", &Generator::instance_name)
-        .def_readwrite("name", &Generator::name)
+        .def_property(
+            "instance_name", [](const Generator &generator) { return generator.instance_name; },
+            &Generator::set_instance_name)
+        .def_property(
+            "name", [](const Generator &generator) { return generator.name; },
+            [](Generator &generator, const std::string &name) {
+                generator.name = name;
+                generator.mark_dirty();
+            })
         .def_readwrite("debug", &Generator::debug)
         .def("clone", &Generator::clone)
         .def_property("is_cloned", &Generator::is_cloned, &Generator::set_is_cloned);
@@ -451,11 +576,36 @@ void init_code_gen(py::module &m) {
     py::class_<VerilogModule>(m, "VerilogModule")
         .def(py::init<Generator *>())
         .def("verilog_src", &VerilogModule::verilog_src)
-        .def("run_passes", &VerilogModule::run_passes)
+        .def("run_passes", &VerilogModule::run_passes, py::call_guard<py::gil_scoped_release>())
+        .def("set_output_path", &VerilogModule::set_output_path)
+        .def("set_fold_constants", &VerilogModule::set_fold_constants)
+        .def("set_cse_min_size", &VerilogModule::set_cse_min_size)
+        .def("set_remove_dead_logic", &VerilogModule::set_remove_dead_logic)
+        .def("set_inline_policy", &VerilogModule::set_inline_policy)
+        .def("manifest", &VerilogModule::manifest)
         .def("debug_info", &VerilogModule::debug_info)
         .def("pass_manager", &VerilogModule::pass_manager, py::return_value_policy::reference);
 }
 
+void init_sim(py::module &m) {
+    py::class_<Simulator>(m, "Simulator")
+        .def(py::init<Generator *>())
+        .def("poke", py::overload_cast<Var *, uint64_t>(&Simulator::poke))
+        .def("poke", py::overload_cast<const std::string &, uint64_t>(&Simulator::poke))
+        .def("peek", py::overload_cast<Var *>(&Simulator::peek))
+        .def("peek", py::overload_cast<const std::string &>(&Simulator::peek))
+        .def("step", py::overload_cast<>(&Simulator::step))
+        .def("step", py::overload_cast<Var *>(&Simulator::step))
+        .def("step", py::overload_cast<const std::string &>(&Simulator::step))
+        .def("get_var", &Simulator::get_var, py::return_value_policy::reference)
+        .def("num_nets", &Simulator::num_nets);
+
+    py::class_<SimulationCodeGen>(m, "SimulationCodeGen")
+        .def(py::init<Generator *, uint32_t>())
+        .def("str", &SimulationCodeGen::str)
+        .def("class_name", &SimulationCodeGen::class_name);
+}
+
 PYBIND11_MODULE(_kratos, m) {
     m.doc() = "C++ Python binding for kratos";
     init_enum(m);
@@ -465,6 +615,7 @@ PYBIND11_MODULE(_kratos, m) {
     init_generator(m);
     init_stmt(m);
     init_code_gen(m);
+    init_sim(m);
     init_util(m);
     init_except(m);
 }
@@ -0,0 +1,101 @@
+#include "arena.hh"
+#include <atomic>
+#include <new>
+
+static std::atomic<bool> track_allocation = false;
+static std::atomic<uint64_t> num_allocations = 0;
+static std::atomic<uint64_t> allocated_bytes = 0;
+
+bool allocation_tracking() { return track_allocation.load(std::memory_order_relaxed); }
+
+void count_allocation(std::size_t size) {
+    num_allocations.fetch_add(1, std::memory_order_relaxed);
+    allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+void start_allocation_tracking() {
+    num_allocations = 0;
+    allocated_bytes = 0;
+    track_allocation = true;
+}
+
+AllocationCount stop_allocation_tracking() {
+    track_allocation = false;
+    AllocationCount count;
+    count.num_allocations = num_allocations;
+    count.allocated_bytes = allocated_bytes;
+    return count;
+}
+
+ArenaChunkPool::~ArenaChunkPool() {
+    for (auto chunk : free_chunks_) ::operator delete(chunk);
+}
+
+void *ArenaChunkPool::acquire() {
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        if (!free_chunks_.empty()) {
+            auto chunk = free_chunks_.back();
+            free_chunks_.pop_back();
+            return chunk;
+        }
+        num_chunks_++;
+    }
+    return ::operator new(chunk_size);
+}
+
+void ArenaChunkPool::release(void *chunk) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    free_chunks_.emplace_back(chunk);
+}
+
+uint64_t ArenaChunkPool::num_free_chunks() const {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return free_chunks_.size();
+}
+
+IRArena::IRArena(std::shared_ptr<ArenaChunkPool> pool) : pool_(std::move(pool)) {}
+
+IRArena::~IRArena() {
+    for (auto chunk : chunks_) pool_->release(chunk);
+}
+
+void *IRArena::allocate(std::size_t size, std::size_t alignment) {
+    if (!is_small(size, alignment)) {
+        // large objects are rare, e.g. huge vectors. let the system handle it
+        return ::operator new(size);
+    }
+    auto index = size_class(size);
+    auto rounded_size = (index + 1) * granularity;
+    bytes_in_use_ += rounded_size;
+    // large objects and chunks go through operator new and are left to the binary
+    if (allocation_tracking()) count_allocation(rounded_size);
+    // reuse freed memory first
+    if (free_lists_[index]) {
+        auto node = free_lists_[index];
+        free_lists_[index] = node->next;
+        return node;
+    }
+    if (current_ + rounded_size > end_) {
+        // the tail of the current chunk is wasted, which is at most max_small_size
+        auto chunk = static_cast<char *>(pool_->acquire());
+        chunks_.emplace_back(chunk);
+        current_ = chunk;
+        end_ = chunk + ArenaChunkPool::chunk_size;
+    }
+    auto result = current_;
+    current_ += rounded_size;
+    return result;
+}
+
+void IRArena::deallocate(void *ptr, std::size_t size, std::size_t alignment) noexcept {
+    if (!is_small(size, alignment)) {
+        ::operator delete(ptr);
+        return;
+    }
+    auto index = size_class(size);
+    bytes_in_use_ -= (index + 1) * granularity;
+    auto node = static_cast<FreeNode *>(ptr);
+    node->next = free_lists_[index];
+    free_lists_[index] = node;
+}
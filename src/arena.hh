@@ -0,0 +1,129 @@
+#ifndef KRATOS_ARENA_HH
+#define KRATOS_ARENA_HH
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// allocation counters for pass profiling. IR nodes served from an arena are counted here.
+// the library doesn't replace the global allocator: a binary that wants every other heap
+// allocation counted as well, such as kratos_bench, replaces operator new and calls
+// count_allocation whenever allocation_tracking is on
+struct AllocationCount {
+    uint64_t num_allocations = 0;
+    uint64_t allocated_bytes = 0;
+};
+bool allocation_tracking();
+void count_allocation(std::size_t size);
+// resets the counters. tracking is process-wide, so only one profiled pass can run at a time
+void start_allocation_tracking();
+AllocationCount stop_allocation_tracking();
+
+// fixed-size chunks shared by every arena in the context. chunks released by a dropped
+// generator are kept and handed out to the next arena instead of going back to the system
+class ArenaChunkPool {
+public:
+    static constexpr std::size_t chunk_size = 16 * 1024;
+
+    ArenaChunkPool() = default;
+    ~ArenaChunkPool();
+
+    void *acquire();
+    void release(void *chunk);
+
+    uint64_t num_chunks() const { return num_chunks_; }
+    uint64_t num_free_chunks() const;
+
+    ArenaChunkPool(const ArenaChunkPool &) = delete;
+    ArenaChunkPool &operator=(const ArenaChunkPool &) = delete;
+
+private:
+    mutable std::mutex mutex_;
+    std::vector<void *> free_chunks_;
+    uint64_t num_chunks_ = 0;
+};
+
+// per-generator pool allocator for IR nodes. small allocations are bumped out of chunks and
+// recycled through size-class free lists; all the chunks are returned together once the
+// arena is destroyed. NOTE: this is not thread-safe, same as the rest of generator mutation
+class IRArena {
+public:
+    explicit IRArena(std::shared_ptr<ArenaChunkPool> pool);
+    ~IRArena();
+
+    void *allocate(std::size_t size, std::size_t alignment);
+    void deallocate(void *ptr, std::size_t size, std::size_t alignment) noexcept;
+
+    uint64_t bytes_in_use() const { return bytes_in_use_; }
+    uint64_t bytes_reserved() const { return chunks_.size() * ArenaChunkPool::chunk_size; }
+
+    IRArena(const IRArena &) = delete;
+    IRArena &operator=(const IRArena &) = delete;
+
+private:
+    static constexpr std::size_t granularity = alignof(std::max_align_t);
+    static constexpr std::size_t max_small_size = 1024;
+    static constexpr std::size_t num_size_classes = max_small_size / granularity;
+
+    struct FreeNode {
+        FreeNode *next;
+    };
+
+    std::shared_ptr<ArenaChunkPool> pool_;
+    std::vector<void *> chunks_;
+    char *current_ = nullptr;
+    char *end_ = nullptr;
+    std::array<FreeNode *, num_size_classes> free_lists_{};
+    uint64_t bytes_in_use_ = 0;
+
+    static bool inline is_small(std::size_t size, std::size_t alignment) {
+        return size <= max_small_size && alignment <= granularity;
+    }
+    static std::size_t inline size_class(std::size_t size) {
+        return (size + granularity - 1) / granularity - 1;
+    }
+};
+
+// standard allocator interface so that nodes can be created with std::allocate_shared.
+// the control block keeps a reference to the arena, so the memory is always valid as long
+// as any node allocated from it is alive
+template <typename T>
+class ArenaAllocator {
+public:
+    using value_type = T;
+
+    explicit ArenaAllocator(std::shared_ptr<IRArena> arena) : arena_(std::move(arena)) {}
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U> &other) : arena_(other.arena()) {}  // NOLINT
+
+    T *allocate(std::size_t n) {
+        return static_cast<T *>(arena_->allocate(n * sizeof(T), alignof(T)));
+    }
+    void deallocate(T *ptr, std::size_t n) noexcept {
+        arena_->deallocate(ptr, n * sizeof(T), alignof(T));
+    }
+
+    const std::shared_ptr<IRArena> &arena() const { return arena_; }
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U> &other) const {
+        return arena_ == other.arena();
+    }
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U> &other) const {
+        return arena_ != other.arena();
+    }
+
+private:
+    std::shared_ptr<IRArena> arena_;
+};
+
+template <typename T, typename... Args>
+std::shared_ptr<T> make_ir_node(const std::shared_ptr<IRArena> &arena, Args &&... args) {
+    return std::allocate_shared<T>(ArenaAllocator<T>(arena), std::forward<Args>(args)...);
+}
+
+#endif  // KRATOS_ARENA_HH
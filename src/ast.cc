@@ -1,6 +1,48 @@
 #include "ast.hh"
+#include <atomic>
+#include <limits>
 #include "generator.hh"
 
+// one bit per visit slot that no visitor owns
+static std::atomic<uint32_t> free_visit_slots = (1u << ASTNode::num_visit_slots) - 1;
+// the last epoch handed out for each slot
+static std::atomic<uint32_t> visit_slot_epochs[ASTNode::num_visit_slots] = {};
+
+ASTVisitor::~ASTVisitor() {
+    if (slot_ >= 0) free_visit_slots.fetch_or(1u << slot_, std::memory_order_release);
+}
+
+void ASTVisitor::acquire_slot() {
+    slot_ = no_slot;
+    auto free_slots = free_visit_slots.load(std::memory_order_relaxed);
+    while (free_slots) {
+        int32_t slot = 0;
+        while (!(free_slots & (1u << slot))) slot++;
+        if (free_visit_slots.compare_exchange_weak(free_slots, free_slots & ~(1u << slot),
+                                                   std::memory_order_acquire,
+                                                   std::memory_order_relaxed)) {
+            slot_ = slot;
+            break;
+        }
+    }
+    if (slot_ < 0) return;
+    epoch_ = visit_slot_epochs[slot_].fetch_add(1, std::memory_order_relaxed) + 1;
+    if (epoch_ == std::numeric_limits<uint32_t>::max()) {
+        // the epochs of this slot are used up. the slot is never released again, otherwise
+        // stale marks could match a new epoch
+        slot_ = no_slot;
+    }
+}
+
+bool ASTVisitor::mark_visited(ASTNode *node) {
+    if (slot_ == unassigned_slot) acquire_slot();
+    if (slot_ == no_slot) return visited_.emplace(node).second;
+    auto &epoch = node->visit_epochs_[slot_];
+    if (epoch == epoch_) return false;
+    epoch = epoch_;
+    return true;
+}
+
 void ASTVisitor::visit_root(ASTNode *root) {
     // recursively call visits
     root->accept(this);
@@ -8,10 +50,7 @@ void ASTVisitor::visit_root(ASTNode *root) {
     level++;
     for (uint64_t i = 0; i < child_count; i++) {
         auto child = root->get_child(i);
-        if (visited_.find(child) == visited_.end()) {
-            visited_.emplace(child);
-            visit_root(child);
-        }
+        if (mark_visited(child)) visit_root(child);
     }
     level--;
 }
@@ -30,20 +69,12 @@ void ASTVisitor::visit_content(Generator *generator) {
     uint64_t stmts_count = generator->stmts_count();
     for (uint64_t i = 0; i < stmts_count; i++) {
         auto child = generator->get_child(i);
-        if (visited_.find(child) == visited_.end()) {
-            visited_.emplace(child);
-            visit_root(child);
-        }
+        if (mark_visited(child)) visit_root(child);
     }
-    // visit the vars
-    auto var_names = generator->get_all_var_names();
-    for (auto const &name: var_names) {
-        auto var = generator->get_var(name);
-        auto ptr = var.get();
-        if (visited_.find(ptr) == visited_.end()) {
-            visited_.emplace(ptr);
-            visit(var.get());
-        }
+    // visit the vars that no statement uses. ports go to visit(Port *), same as in the walk
+    for (auto const &iter : generator->vars()) {
+        auto var = iter.second.get();
+        if (mark_visited(var)) var->accept(this);
     }
     level--;
 }
\ No newline at end of file
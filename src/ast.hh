@@ -46,13 +46,29 @@ public:
         attributes_.emplace_back(attribute);
     }
 
+    // number of traversals that can mark nodes at the same time. see ASTVisitor
+    static constexpr uint32_t num_visit_slots = 4;
+
 private:
+    friend class ASTVisitor;
+
     ASTNodeKind ast_node_type_;
     std::vector<std::shared_ptr<Attribute>> attributes_;
+    // epoch of the last traversal that visited the node, one per slot
+    uint32_t visit_epochs_[num_visit_slots] = {};
 };
 
+// a visitor marks the nodes it has visited by writing its epoch into one of the nodes' visit
+// slots. a slot is owned by one visitor at a time, so visitors on different threads, or nested
+// visitors, never share one. when every slot is taken the visitor keeps a set of the visited
+// nodes instead
 class ASTVisitor {
 public:
+    ASTVisitor() = default;
+    ASTVisitor(const ASTVisitor &) = delete;
+    ASTVisitor &operator=(const ASTVisitor &) = delete;
+    virtual ~ASTVisitor();
+
     virtual void visit_root(ASTNode *root);
     // visit generators only
     virtual void visit_generator_root(Generator *generator);
@@ -80,7 +96,49 @@ public:
 protected:
     uint32_t level = 0;
 
+    // returns false if the node has been visited already
+    bool mark_visited(ASTNode *node);
+
+private:
+    // no slot has been acquired yet, or there was no free slot
+    static constexpr int32_t unassigned_slot = -1;
+    static constexpr int32_t no_slot = -2;
+
+    int32_t slot_ = unassigned_slot;
+    uint32_t epoch_ = 0;
     std::unordered_set<ASTNode *> visited_;
+
+    void acquire_slot();
+};
+
+// dispatches every node to the added visitors, in the order they are added, so that several
+// visitors share one walk. only their visit methods are used; the walk is the composite's own
+class CompositeVisitor : public ASTVisitor {
+public:
+    void add_visitor(ASTVisitor *visitor) { visitors_.emplace_back(visitor); }
+
+    void visit(Var *var) override { dispatch(var); }
+    void visit(Port *port) override { dispatch(port); }
+    void visit(VarSlice *slice) override { dispatch(slice); }
+    void visit(VarConcat *concat) override { dispatch(concat); }
+    void visit(Expr *expr) override { dispatch(expr); }
+    void visit(Const *constant) override { dispatch(constant); }
+    void visit(Parameter *param) override { dispatch(param); }
+    void visit(AssignStmt *stmt) override { dispatch(stmt); }
+    void visit(IfStmt *stmt) override { dispatch(stmt); }
+    void visit(SwitchStmt *stmt) override { dispatch(stmt); }
+    void visit(CombinationalStmtBlock *block) override { dispatch(block); }
+    void visit(SequentialStmtBlock *block) override { dispatch(block); }
+    void visit(ModuleInstantiationStmt *stmt) override { dispatch(stmt); }
+    void visit(Generator *generator) override { dispatch(generator); }
+
+private:
+    std::vector<ASTVisitor *> visitors_;
+
+    template <typename T>
+    void inline dispatch(T *node) {
+        for (auto const &visitor : visitors_) visitor->visit(node);
+    }
 };
 
 // TODO
@@ -0,0 +1,190 @@
+#include "bitvector.hh"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include "fmt/format.h"
+
+using fmt::format;
+
+BitVector::BitVector(uint32_t width) : width_(width), word_(0) {
+    if (width == 0) throw std::runtime_error("width cannot be 0");
+    if (!is_small()) words_ = new uint64_t[num_words()]();
+}
+
+BitVector::BitVector(int64_t value, uint32_t width) : BitVector(width) {
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    auto words = data();
+    words[0] = bits;
+    // sign extension for the upper words
+    for (uint32_t i = 1; i < num_words(); i++) words[i] = value < 0 ? ~0ull : 0;
+    clear_unused_bits();
+}
+
+BitVector BitVector::from_hex(const std::string &hex, uint32_t width) {
+    BitVector result(width);
+    auto words = result.data();
+    uint32_t index = 0;
+    for (auto iter = hex.rbegin(); iter != hex.rend(); iter++) {
+        auto c = *iter;
+        if (c == '_') continue;
+        uint64_t digit;
+        if (c >= '0' && c <= '9')
+            digit = c - '0';
+        else if (c >= 'a' && c <= 'f')
+            digit = c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F')
+            digit = c - 'A' + 10;
+        else
+            throw std::runtime_error(::format("invalid hex digit {0} in {1}", c, hex));
+        if (digit) {
+            // highest bit set by this digit
+            uint32_t high = index * 4 + 3;
+            while (!((digit >> (high - index * 4)) & 1u)) high--;
+            if (high >= width)
+                throw std::runtime_error(
+                    ::format("{0} is larger than the maximum value given width {1}", hex, width));
+            words[index / 16] |= digit << ((index % 16) * 4);
+        }
+        index++;
+    }
+    return result;
+}
+
+BitVector::BitVector(const BitVector &value) : width_(value.width_), word_(value.word_) {
+    if (!is_small()) {
+        words_ = new uint64_t[num_words()];
+        std::copy(value.words_, value.words_ + num_words(), words_);
+    }
+}
+
+BitVector::BitVector(BitVector &&value) noexcept : width_(value.width_), word_(value.word_) {
+    // leave the other one as a valid small value
+    value.width_ = 1;
+    value.word_ = 0;
+}
+
+BitVector &BitVector::operator=(const BitVector &value) {
+    if (this != &value) *this = BitVector(value);
+    return *this;
+}
+
+BitVector &BitVector::operator=(BitVector &&value) noexcept {
+    if (this != &value) {
+        if (!is_small()) delete[] words_;
+        width_ = value.width_;
+        word_ = value.word_;
+        value.width_ = 1;
+        value.word_ = 0;
+    }
+    return *this;
+}
+
+BitVector::~BitVector() {
+    if (!is_small()) delete[] words_;
+}
+
+bool BitVector::is_zero() const {
+    auto words = data();
+    return std::all_of(words, words + num_words(), [](uint64_t w) { return w == 0; });
+}
+
+BitVector BitVector::negated() const {
+    BitVector result(width_);
+    auto src = data();
+    auto dst = result.data();
+    uint64_t carry = 1;
+    for (uint32_t i = 0; i < num_words(); i++) {
+        dst[i] = ~src[i] + carry;
+        carry = carry && dst[i] == 0;
+    }
+    result.clear_unused_bits();
+    return result;
+}
+
+BitVector BitVector::resized(uint32_t width, bool is_signed) const {
+    BitVector result(width);
+    auto src = data();
+    auto dst = result.data();
+    auto const extend = is_signed && msb();
+    for (uint32_t i = 0; i < result.num_words(); i++) dst[i] = i < num_words() ? src[i] : 0;
+    if (extend) {
+        for (uint32_t i = width_; i < width; i++) dst[i / 64] |= 1ull << (i % 64);
+    }
+    result.clear_unused_bits();
+    return result;
+}
+
+bool BitVector::fits(uint32_t width, bool is_signed) const {
+    if (width >= width_) return true;
+    // every dropped bit, plus the new sign bit, has to match the extension
+    auto const fill = is_signed && msb();
+    for (uint32_t i = is_signed ? width - 1 : width; i < width_; i++) {
+        if (bit(i) != fill) return false;
+    }
+    return true;
+}
+
+int64_t BitVector::to_int64(bool is_signed) const {
+    if (!fits(64, is_signed))
+        throw std::runtime_error(::format("{0} does not fit into 64 bits", to_string(is_signed)));
+    uint64_t bits = word(0);
+    if (is_signed && width_ < 64 && msb()) bits |= (~0ull) << width_;
+    int64_t result;
+    std::memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+std::string BitVector::to_hex() const {
+    static constexpr char digits[] = "0123456789ABCDEF";
+    std::string result;
+    result.reserve((width_ + 3) / 4);
+    auto words = data();
+    for (uint32_t i = num_words(); i > 0; i--) {
+        auto const w = words[i - 1];
+        for (int32_t shift = 60; shift >= 0; shift -= 4) {
+            auto const digit = (w >> static_cast<uint32_t>(shift)) & 0xFu;
+            if (digit || !result.empty()) result.push_back(digits[digit]);
+        }
+    }
+    if (result.empty()) result.push_back('0');
+    return result;
+}
+
+std::string BitVector::to_string(bool is_signed) const {
+    std::string result;
+    if (is_signed && msb()) {
+        result.push_back('-');
+        result.append(std::to_string(width_));
+        result.append("'h");
+        result.append(negated().to_hex());
+    } else {
+        result.append(std::to_string(width_));
+        result.append("'h");
+        result.append(to_hex());
+    }
+    return result;
+}
+
+uint64_t BitVector::hash() const {
+    // FNV-1a over the width and the words
+    uint64_t hash = 0xcbf29ce484222325ull;
+    auto mix = [&hash](uint64_t value) {
+        hash ^= value;
+        hash *= 0x100000001b3ull;
+    };
+    mix(width_);
+    auto words = data();
+    for (uint32_t i = 0; i < num_words(); i++) mix(words[i]);
+    return hash;
+}
+
+bool BitVector::operator==(const BitVector &value) const {
+    if (width_ != value.width_) return false;
+    return std::equal(data(), data() + num_words(), value.data());
+}
+
+void BitVector::clear_unused_bits() {
+    auto const used = width_ % 64;
+    if (used) data()[num_words() - 1] &= (1ull << used) - 1;
+}
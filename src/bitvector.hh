@@ -0,0 +1,62 @@
+#ifndef KRATOS_BITVECTOR_HH
+#define KRATOS_BITVECTOR_HH
+
+#include <cstdint>
+#include <string>
+
+// fixed-width packed bit vector used as the value of constants. values up to 64 bits are
+// stored inline; wider values use a heap array of 64-bit words, least significant first.
+// bits above the width are always kept as zero
+class BitVector {
+public:
+    // value is truncated to width, i.e. negative values are stored as two's complement
+    BitVector(int64_t value, uint32_t width);
+    // hex digits, most significant first. throws if the value does not fit into width
+    static BitVector from_hex(const std::string &hex, uint32_t width);
+
+    BitVector(const BitVector &value);
+    BitVector(BitVector &&value) noexcept;
+    BitVector &operator=(const BitVector &value);
+    BitVector &operator=(BitVector &&value) noexcept;
+    ~BitVector();
+
+    uint32_t width() const { return width_; }
+    uint32_t num_words() const { return (width_ + 63) / 64; }
+    uint64_t word(uint32_t index) const { return is_small() ? word_ : words_[index]; }
+    bool bit(uint32_t index) const { return (word(index / 64) >> (index % 64)) & 1u; }
+    bool msb() const { return bit(width_ - 1); }
+    bool is_zero() const;
+
+    // two's complement negation within the same width
+    BitVector negated() const;
+    // zero or sign extension, or truncation
+    BitVector resized(uint32_t width, bool is_signed) const;
+    // whether resizing to width keeps the value
+    bool fits(uint32_t width, bool is_signed) const;
+    int64_t to_int64(bool is_signed) const;
+
+    // upper case, no leading zeros
+    std::string to_hex() const;
+    // sized SystemVerilog literal, e.g. 8'hFF or -4'h8
+    std::string to_string(bool is_signed) const;
+
+    uint64_t hash() const;
+    bool operator==(const BitVector &value) const;
+    bool operator!=(const BitVector &value) const { return !(*this == value); }
+
+private:
+    explicit BitVector(uint32_t width);
+
+    uint32_t width_;
+    union {
+        uint64_t word_;
+        uint64_t *words_;
+    };
+
+    bool is_small() const { return width_ <= 64; }
+    uint64_t *data() { return is_small() ? &word_ : words_; }
+    const uint64_t *data() const { return is_small() ? &word_ : words_; }
+    void clear_unused_bits();
+};
+
+#endif  // KRATOS_BITVECTOR_HH
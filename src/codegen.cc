@@ -13,6 +13,29 @@ using std::runtime_error;
 Stream::Stream(Generator* generator, SystemVerilogCodeGen* codegen)
     : generator_(generator), codegen_(codegen), line_no_(1) {}
 
+void Stream::append(const char* data, uint64_t size) {
+    // start a new chunk instead of growing the current one, which would copy everything
+    // written so far
+    if (chunks_.empty() || chunks_.back().size() + size > chunk_size) {
+        chunks_.emplace_back();
+        chunks_.back().reserve(std::max(chunk_size, size));
+    }
+    chunks_.back().append(data, size);
+}
+
+uint64_t Stream::size() const {
+    uint64_t result = 0;
+    for (auto const& chunk : chunks_) result += chunk.size();
+    return result;
+}
+
+std::string Stream::str() const {
+    std::string result;
+    result.reserve(size());
+    for (auto const& chunk : chunks_) result.append(chunk);
+    return result;
+}
+
 Stream& Stream::operator<<(AssignStmt* stmt) {
     const auto& left = stmt->left()->to_string();
     const auto& right = stmt->right()->to_string();
@@ -25,12 +48,12 @@ Stream& Stream::operator<<(AssignStmt* stmt) {
         if (stmt->assign_type() != AssignmentType::Blocking)
             throw ::runtime_error(
                 ::format("Top level assignment for {0} <- {1} has to be blocking", left, right));
-        (*this) << ::format("assign {0} = {1};", left, right) << endl();
+        (*this) << "assign " << left << " = " << right << ';' << endl();
     } else {
         if (stmt->assign_type() == AssignmentType::Blocking)
-            (*this) << ::format("{0}{1} = {2};", codegen_->indent(), left, right) << endl();
+            (*this) << codegen_->indent() << left << " = " << right << ';' << endl();
         else if (stmt->assign_type() == AssignmentType::NonBlocking)
-            (*this) << ::format("{0}{1} <= {2};", codegen_->indent(), left, right) << endl();
+            (*this) << codegen_->indent() << left << " <= " << right << ';' << endl();
         else
             throw ::runtime_error(::format("Undefined assignment for {0} <- {1}", left, right));
     }
@@ -53,8 +76,8 @@ Stream& Stream::operator<<(const std::shared_ptr<Var>& var) {
         var->verilog_ln = line_no_;
     }
 
-    (*this) << ::format("logic {0} {1} {2};", var->is_signed ? "signed" : "",
-                        SystemVerilogCodeGen::get_var_width_str(var.get()), var->name)
+    (*this) << "logic " << (var->is_signed ? "signed" : "") << ' '
+            << SystemVerilogCodeGen::get_var_width_str(var.get()) << ' ' << var->name << ';'
             << endl();
     return *this;
 }
@@ -63,52 +86,109 @@ void VerilogModule::run_passes(bool use_parallel, bool run_if_to_case_pass, bool
                                bool run_fanout_one_pass) {
     // run multiple passes using pass manager
 
-    if (remove_passthrough)
-        manager_.add_pass("remove_pass_through_modules", &remove_pass_through_modules);
+    // these passes only touch one generator at a time and keep the hierarchy intact, so they
+    // share the generator order and levels computed by the pass manager
+    auto* analyses = &manager_.analyses();
+    auto generator_pass = [=](std::function<void(Generator*)> generator_fn) {
+        return std::function<void(Generator*)>([=](Generator* top) {
+            if (use_parallel) {
+                auto levels = analyses->get<GeneratorLevels>(generator_levels_analysis, top);
+                parallel_generator_pass(*levels, generator_fn);
+            } else {
+                auto order = analyses->get<GeneratorOrder>(generator_order_analysis, top);
+                for (auto const& generator : order->generators) generator_fn(generator);
+            }
+        });
+    };
+    PassInfo generator_pass_info;
+    generator_pass_info.uses = {use_parallel ? generator_levels_analysis
+                                             : generator_order_analysis};
+    generator_pass_info.preserves = {generator_order_analysis, generator_levels_analysis};
+    // passes that change the IR but not the hierarchy
+    PassInfo hierarchy_info;
+    hierarchy_info.preserves = generator_pass_info.preserves;
+
+    if (inline_policy_.max_size || !inline_policy_.attribute.empty() ||
+        !inline_policy_.name_pattern.empty()) {
+        auto const policy = inline_policy_;
+        manager_.add_pass("inline_generators",
+                          [=](Generator* top) { inline_generators(top, policy); });
+    }
 
-    if (run_if_to_case_pass) manager_.add_pass("transform_if_to_case", &transform_if_to_case);
+    if (fold_constants_)
+        manager_.add_pass("fold_constants", generator_pass(&fold_constants_generator),
+                          generator_pass_info);
 
-    manager_.add_pass("fix_assignment_type", &fix_assignment_type);
+    if (remove_dead_logic_) manager_.add_pass("remove_dead_logic", &remove_dead_logic);
 
-    manager_.add_pass("zero_out_stubs", &zero_out_stubs);
+    if (remove_passthrough)
+        manager_.add_pass("remove_pass_through_modules", &remove_pass_through_modules);
 
-    if (run_fanout_one_pass) manager_.add_pass("remove_fanout_one_wires", &remove_fanout_one_wires);
+    if (run_if_to_case_pass)
+        manager_.add_pass("transform_if_to_case", &transform_if_to_case, hierarchy_info);
 
-    manager_.add_pass("decouple_generator_ports", &decouple_generator_ports);
+    manager_.add_pass("fix_assignment_type", generator_pass(&fix_assignment_type_generator),
+                      generator_pass_info);
 
-    manager_.add_pass("remove_unused_vars", &remove_unused_vars);
+    manager_.add_pass("zero_out_stubs", generator_pass(&zero_out_stub_generator),
+                      generator_pass_info);
 
-    manager_.add_pass("verify_assignments", &verify_assignments);
+    if (cse_min_size_) {
+        auto const min_size = cse_min_size_;
+        manager_.add_pass("eliminate_common_subexpressions",
+                          generator_pass([=](Generator* generator) {
+                              eliminate_common_subexpressions_generator(generator, min_size);
+                          }),
+                          generator_pass_info);
+    }
+
+    if (run_fanout_one_pass)
+        manager_.add_pass("remove_fanout_one_wires", &remove_fanout_one_wires, hierarchy_info);
 
-    manager_.add_pass("verify_generator_connectivity", &verify_generator_connectivity);
+    manager_.add_pass("decouple_generator_ports", &decouple_generator_ports, hierarchy_info);
 
-    manager_.add_pass("check_mixed_assignment", &check_mixed_assignment);
+    manager_.add_pass("remove_unused_vars", &remove_unused_vars, hierarchy_info);
 
-    manager_.add_pass("merge_wire_assignments", &merge_wire_assignments);
+    // verify_assignments, verify_generator_connectivity and check_mixed_assignment in one walk
+    manager_.add_pass("verify_generators",
+                      [=](Generator* top) {
+                          generator_pass([=](Generator* generator) {
+                              verify_generator(generator, generator == top);
+                          })(top);
+                      },
+                      generator_pass_info);
 
-    // TODO:
-    //  add inline pass
+    manager_.add_pass("merge_wire_assignments", &merge_wire_assignments, hierarchy_info);
 
     if (use_parallel) {
         manager_.add_pass("hash_generators", [=](Generator* generator) {
           hash_generators(generator, HashStrategy::ParallelHash);
-        });
+        }, hierarchy_info);
     } else {
         manager_.add_pass("hash_generators", [=](Generator* generator) {
             hash_generators(generator, HashStrategy::SequentialHash);
-        });
+        }, hierarchy_info);
     }
 
-    manager_.add_pass("uniquify_generators", &uniquify_generators);
+    manager_.add_pass("uniquify_generators", &uniquify_generators, hierarchy_info);
 
-    manager_.add_pass("uniquify_module_instances", &uniquify_module_instances);
+    manager_.add_pass("uniquify_module_instances", &uniquify_module_instances, hierarchy_info);
 
-    manager_.add_pass("create_module_instantiation", &create_module_instantiation);
+    manager_.add_pass("create_module_instantiation", &create_module_instantiation,
+                      hierarchy_info);
 
     // tun the passes
     manager_.run_passes(generator_);
 
-    verilog_src_ = generate_verilog(generator_);
+    if (output_path_.empty())
+        verilog_src_ = generate_verilog(generator_, use_parallel);
+    else
+        manifest_ = generate_verilog(generator_, output_path_, split_files_, use_parallel);
+}
+
+void VerilogModule::set_output_path(const std::string& path, bool split_files) {
+    output_path_ = path;
+    split_files_ = split_files;
 }
 
 SystemVerilogCodeGen::SystemVerilogCodeGen(Generator* generator)
@@ -117,7 +197,7 @@ SystemVerilogCodeGen::SystemVerilogCodeGen(Generator* generator)
     if (generator->external()) return;
 
     // output module definition
-    stream_ << ::format("module {0} (", generator->name) << stream_.endl();
+    stream_ << "module " << generator->name << " (" << stream_.endl();
     generate_ports(generator);
     stream_ << ");" << stream_.endl() << stream_.endl();
     generate_parameters(generator);
@@ -127,7 +207,7 @@ SystemVerilogCodeGen::SystemVerilogCodeGen(Generator* generator)
         dispatch_node(generator->get_stmt(i).get());
     }
 
-    stream_ << ::format("endmodule   // {0}", generator->name) << stream_.endl();
+    stream_ << "endmodule   // " << generator->name << stream_.endl();
 }
 
 std::string SystemVerilogCodeGen::get_var_width_str(const Var* var) {
@@ -161,20 +241,19 @@ void SystemVerilogCodeGen::generate_variables(Generator* generator) {
 void SystemVerilogCodeGen::generate_parameters(Generator* generator) {
     auto& params = generator->get_params();
     for (auto const& [name, param] : params) {
-        stream_ << ::format("parameter {0} = {1};", name, param->value_str()) << stream_.endl();
+        stream_ << "parameter " << name << " = " << param->value_str() << ';' << stream_.endl();
     }
 }
 
-std::string SystemVerilogCodeGen::indent() {
+const std::string& SystemVerilogCodeGen::indent() {
+    static const std::string empty;
     if (skip_indent_) {
         skip_indent_ = false;
-        return "";
+        return empty;
     }
-    std::string result;
-    uint32_t num_indent = indent_ * indent_size;
-    result.resize(num_indent);
-    for (uint32_t i = 0; i < num_indent; i++) result[i] = ' ';
-    return result;
+    // indent strings are only built once per level
+    while (indents_.size() <= indent_) indents_.emplace_back(indents_.size() * indent_size, ' ');
+    return indents_[indent_];
 }
 
 void SystemVerilogCodeGen::dispatch_node(ASTNode* node) {
@@ -253,7 +332,7 @@ void SystemVerilogCodeGen::stmt_code(IfStmt* stmt) {
     if (generator_->debug) {
         stmt->verilog_ln = stream_.line_no();
     }
-    stream_ << indent() << ::format("if ({0}) begin", stmt->predicate()->to_string())
+    stream_ << indent() << "if (" << stmt->predicate()->to_string() << ") begin"
             << stream_.endl();
     indent_++;
 
@@ -305,10 +384,11 @@ void SystemVerilogCodeGen::stmt_code(ModuleInstantiationStmt* stmt) {
 
         uint32_t count = 0;
         for (auto const& [name, param] : params) {
-            stream_ << indent()
-                    << ::format(
-                           ".{0}({1}){2}", name, param->value_str(),
-                           ++count == params.size() ? ")" : "," + std::string(1, stream_.endl()));
+            stream_ << indent() << '.' << name << '(' << param->value_str() << ')';
+            if (++count == params.size())
+                stream_ << ')';
+            else
+                stream_ << ',' << stream_.endl();
         }
 
         indent_--;
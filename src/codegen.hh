@@ -1,6 +1,7 @@
 #ifndef KRATOS_CODEGEN_HH
 #define KRATOS_CODEGEN_HH
 
+#include <cstring>
 #include <sstream>
 #include "ast.hh"
 #include "context.hh"
@@ -18,24 +19,59 @@ public:
                     bool run_fanout_one_pass);
 
     const inline std::map<std::string, std::string>& verilog_src() const { return verilog_src_; }
+    // stream the modules to disk instead of keeping them in verilog_src
+    void set_output_path(const std::string& path, bool split_files);
+    // runs the constant folding pass before any of the other passes, except for inlining. off by
+    // default
+    void set_fold_constants(bool value) { fold_constants_ = value; }
+    // runs common subexpression elimination with the given minimum expression size. 0 disables
+    // it, which is the default
+    void set_cse_min_size(uint32_t min_size) { cse_min_size_ = min_size; }
+    // runs remove_dead_logic, after constant folding if that is enabled. off by default
+    void set_remove_dead_logic(bool value) { remove_dead_logic_ = value; }
+    // runs inline_generators before any other pass. nothing is inlined by default
+    void set_inline_policy(const InlinePolicy& policy) { inline_policy_ = policy; }
+    const inline VerilogManifest& manifest() const { return manifest_; }
     const inline std::map<std::string, DebugInfo>& debug_info() const { return debug_info_; }
     inline PassManager& pass_manager() { return manager_; }
 
 private:
     std::map<std::string, std::string> verilog_src_;
     std::map<std::string, DebugInfo> debug_info_;
+    VerilogManifest manifest_;
+    std::string output_path_;
+    bool split_files_ = false;
+    bool fold_constants_ = false;
+    uint32_t cse_min_size_ = 0;
+    bool remove_dead_logic_ = false;
+    InlinePolicy inline_policy_;
     Generator* generator_;
 
     PassManager manager_;
 };
 
-class Stream : public std::stringstream {
+// output buffer for the codegen. text is appended into fixed-size chunks, so the buffer never
+// copies what has been written when it grows
+class Stream {
 public:
     explicit Stream(Generator* generator, SystemVerilogCodeGen* codegen);
     Stream& operator<<(AssignStmt* stmt);
     Stream& operator<<(const std::pair<Port*, std::string>& port);
     Stream& operator<<(const std::shared_ptr<Var>& var);
 
+    inline Stream& operator<<(const std::string& value) {
+        append(value.data(), value.size());
+        return *this;
+    }
+    inline Stream& operator<<(const char* value) {
+        append(value, std::strlen(value));
+        return *this;
+    }
+    inline Stream& operator<<(char value) {
+        append(&value, 1);
+        return *this;
+    }
+
     inline char endl() {
         line_no_++;
         return '\n';
@@ -43,20 +79,28 @@ public:
 
     inline uint32_t line_no() const { return line_no_; }
 
+    uint64_t size() const;
+    std::string str() const;
+
 private:
+    static constexpr uint64_t chunk_size = 16 * 1024;
+
     Generator* generator_;
     SystemVerilogCodeGen* codegen_;
     uint64_t line_no_;
+    std::vector<std::string> chunks_;
+
+    void append(const char* data, uint64_t size);
 };
 
 class SystemVerilogCodeGen {
 public:
     explicit SystemVerilogCodeGen(Generator* generator);
-    const std::string str() { return stream_.str(); }
+    std::string str() const { return stream_.str(); }
 
     uint32_t indent_size = 2;
 
-    std::string indent();
+    const std::string& indent();
 
     // helper function
     std::string static get_port_str(Port* port);
@@ -64,6 +108,7 @@ public:
 
 private:
     uint32_t indent_ = 0;
+    std::vector<std::string> indents_;
     Stream stream_;
     Generator* generator_;
     bool skip_indent_ = false;
@@ -0,0 +1,175 @@
+#ifndef KRATOS_CONTAINER_HH
+#define KRATOS_CONTAINER_HH
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+// insertion-ordered set of nullable handles, e.g. shared_ptr. most nets only have one driver
+// and a handful of loads, so small sets are a plain vector searched linearly. once a set grows
+// past index_threshold, a position index is built and removal leaves an empty slot, which
+// keeps both the order and O(1) removal. iteration and positional access skip the empty slots.
+// positions before the first empty slot are O(1), the ones after it are found by a linear scan
+// until the set is compacted. empty handles cannot be stored
+template <typename T>
+class OrderedSet {
+public:
+    static constexpr uint64_t index_threshold = 16;
+
+    class const_iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const T *;
+        using reference = const T &;
+
+        const_iterator() = default;
+        const_iterator(const T *pos, const T *end) : pos_(pos), end_(end) { skip(); }
+
+        reference operator*() const { return *pos_; }
+        pointer operator->() const { return pos_; }
+        const_iterator &operator++() {
+            pos_++;
+            skip();
+            return *this;
+        }
+        const_iterator operator++(int) {
+            auto result = *this;
+            ++(*this);
+            return result;
+        }
+        bool operator==(const const_iterator &iter) const { return pos_ == iter.pos_; }
+        bool operator!=(const const_iterator &iter) const { return pos_ != iter.pos_; }
+
+    private:
+        const T *pos_ = nullptr;
+        const T *end_ = nullptr;
+
+        void skip() {
+            while (pos_ != end_ && !(*pos_)) pos_++;
+        }
+    };
+    using iterator = const_iterator;
+
+    OrderedSet() = default;
+    OrderedSet(const OrderedSet &set) { *this = set; }
+    OrderedSet(OrderedSet &&set) noexcept = default;
+    OrderedSet &operator=(const OrderedSet &set) {
+        if (this == &set) return *this;
+        clear();
+        items_.reserve(set.size_);
+        for (auto const &item : set) items_.emplace_back(item);
+        size_ = set.size_;
+        if (size_ > index_threshold) build_index();
+        return *this;
+    }
+    OrderedSet &operator=(OrderedSet &&set) noexcept = default;
+
+    const_iterator begin() const { return const_iterator(data(), data() + items_.size()); }
+    const_iterator end() const {
+        return const_iterator(data() + items_.size(), data() + items_.size());
+    }
+
+    uint64_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    // random access by position, which has to be less than size()
+    const T &at(uint64_t index) const {
+        if (items_.size() == size_ || index < first_empty_) return items_[index];
+        auto pos = first_empty_;
+        auto remaining = index - first_empty_;
+        while (true) {
+            if (items_[pos]) {
+                if (remaining == 0) return items_[pos];
+                remaining--;
+            }
+            pos++;
+        }
+    }
+
+    const_iterator find(const T &item) const {
+        auto pos = position(item);
+        return pos == items_.size() ? end()
+                                    : const_iterator(data() + pos, data() + items_.size());
+    }
+    uint64_t count(const T &item) const { return position(item) == items_.size() ? 0 : 1; }
+
+    bool emplace(const T &item) {
+        if (!item || position(item) != items_.size()) return false;
+        items_.emplace_back(item);
+        size_++;
+        if (index_) {
+            index_->emplace(item, items_.size() - 1);
+        } else if (size_ > index_threshold) {
+            build_index();
+        }
+        return true;
+    }
+
+    uint64_t erase(const T &item) {
+        auto pos = position(item);
+        if (pos == items_.size()) return 0;
+        size_--;
+        if (index_) {
+            index_->erase(item);
+            items_[pos] = T();
+            // the set had no empty slot before this one
+            if (items_.size() == size_ + 1 || pos < first_empty_) first_empty_ = pos;
+            // compact once half of the slots are empty
+            if (items_.size() > 2 * size_) compact();
+        } else {
+            // small sets never have empty slots
+            items_.erase(items_.begin() + pos);
+        }
+        return 1;
+    }
+
+    void clear() {
+        items_.clear();
+        index_.reset();
+        size_ = 0;
+    }
+
+    // removes the empty slots left by erase. only the positions after the first empty slot
+    // are re-indexed
+    void compact() {
+        if (items_.size() == size_) return;
+        auto first_pos = first_empty_;
+        items_.erase(std::remove(items_.begin() + first_pos, items_.end(), T()), items_.end());
+        if (size_ <= index_threshold) {
+            index_.reset();
+            return;
+        }
+        for (uint64_t i = first_pos; i < items_.size(); i++) (*index_)[items_[i]] = i;
+    }
+
+private:
+    std::vector<T> items_;
+    std::unique_ptr<std::unordered_map<T, uint64_t>> index_;
+    uint64_t size_ = 0;
+    // only meaningful while there are empty slots
+    uint64_t first_empty_ = 0;
+
+    const T *data() const { return items_.data(); }
+
+    uint64_t position(const T &item) const {
+        if (index_) {
+            auto iter = index_->find(item);
+            return iter == index_->end() ? items_.size() : iter->second;
+        }
+        auto iter = std::find(items_.begin(), items_.end(), item);
+        return static_cast<uint64_t>(iter - items_.begin());
+    }
+
+    void build_index() {
+        index_ = std::make_unique<std::unordered_map<T, uint64_t>>();
+        index_->reserve(items_.size());
+        for (uint64_t i = 0; i < items_.size(); i++) index_->emplace(items_[i], i);
+    }
+};
+
+#endif  // KRATOS_CONTAINER_HH
@@ -24,8 +24,9 @@ void Context::add(Generator *generator) {
 }
 
 void Context::remove(Generator *generator) {
-    if (modules_.find(generator->name) == modules_.end()) return;
-    auto &module_set = modules_.at(generator->name);
+    auto iter = modules_.find(generator->name);
+    if (iter == modules_.end()) return;
+    auto &module_set = iter->second;
     // TODO:
     //  Write a complete pass to remove the generator
     //  1. remove any connections/assignments
@@ -35,8 +36,7 @@ void Context::remove(Generator *generator) {
 }
 
 void Context::add_hash(Generator *generator, uint64_t hash) {
-    if (generator_hash_.find(generator) != generator_hash_.end())
-        throw ::runtime_error(::format("{0}'s hash has already been computed", generator->name));
+    // dirty generators are re-hashed, in which case the old value gets replaced
     generator_hash_[generator] = hash;
 }
 
@@ -57,20 +57,23 @@ void Context::change_generator_name(Generator *generator, const std::string &new
         throw ::runtime_error(::format("{0}'s context is different", old_name));
     // remove it from the list
     auto shared_ptr = generator->shared_from_this();
-    if (modules_.find(generator->name) == modules_.end())
+    auto iter = modules_.find(generator->name);
+    if (iter == modules_.end())
         throw ::runtime_error(::format("cannot find generator {0} in context", old_name));
-    auto &list = modules_.at(generator->name);
-    auto pos = std::find(list.begin(), list.end(), shared_ptr);
+    auto &list = iter->second;
+    auto pos = list.find(shared_ptr);
     if (pos == list.end())
         throw ::runtime_error(::format("unable to find generator {0} in context", old_name));
     // we need to erase it
     list.erase(pos);
     // change it's name and put it to a new list
     generator->name = new_name;
+    generator->mark_dirty();
     modules_[new_name].emplace(shared_ptr);
     // change the cloned names as well
     for (auto &g : generator->get_clones()) {
         g->name = new_name;
+        g->mark_dirty();
     }
 }
 
@@ -80,8 +83,14 @@ bool Context::generator_name_exists(const std::string &name) const {
 
 std::set<std::shared_ptr<Generator>> Context::get_generators_by_name(
     const std::string &name) const {
-    if (!generator_name_exists(name)) return {};
-    return modules_.at(name);
+    auto iter = modules_.find(name);
+    if (iter == modules_.end()) return {};
+    return iter->second;
+}
+
+uint64_t Context::num_generators_by_name(const std::string &name) const {
+    auto iter = modules_.find(name);
+    return iter == modules_.end() ? 0 : iter->second.size();
 }
 
 std::unordered_set<std::string> Context::get_generator_names() const {
@@ -4,8 +4,10 @@
 #include <map>
 #include <memory>
 #include <set>
+#include <string>
 #include <unordered_map>
 #include <unordered_set>
+#include "arena.hh"
 
 struct Port;
 class Generator;
@@ -31,6 +33,9 @@ class Context {
 private:
     std::unordered_map<std::string, std::set<std::shared_ptr<Generator>>> modules_;
     std::unordered_map<Generator*, uint64_t> generator_hash_;
+    std::shared_ptr<ArenaChunkPool> chunk_pool_ = std::make_shared<ArenaChunkPool>();
+    std::string codegen_cache_dir_;
+    uint64_t generator_count_ = 0;
 
 public:
     Context() = default;
@@ -51,9 +56,28 @@ public:
     void change_generator_name(Generator* generator, const std::string& new_name);
     bool generator_name_exists(const std::string& name) const;
     std::set<std::shared_ptr<Generator>> get_generators_by_name(const std::string& name) const;
+    // same as get_generators_by_name(name).size(), without copying the set
+    uint64_t num_generators_by_name(const std::string& name) const;
     std::unordered_set<std::string> get_generator_names() const;
 
     void clear();
+
+    // if set, generated modules are cached on disk keyed by their content hash
+    const std::string& codegen_cache_dir() const { return codegen_cache_dir_; }
+    void set_codegen_cache_dir(const std::string& dir) { codegen_cache_dir_ = dir; }
+
+    // generators are numbered in creation order, which passes use instead of heap addresses
+    // whenever the output depends on the order
+    uint64_t next_generator_order() { return generator_count_++; }
+
+    // per-generator arenas for IR nodes. memory is shared through the context chunk pool
+    std::shared_ptr<IRArena> create_arena() { return std::make_shared<IRArena>(chunk_pool_); }
+    uint64_t arena_memory_size() const {
+        return chunk_pool_->num_chunks() * ArenaChunkPool::chunk_size;
+    }
+    uint64_t arena_free_memory_size() const {
+        return chunk_pool_->num_free_chunks() * ArenaChunkPool::chunk_size;
+    }
 };
 
 #endif  // KRATOS_CONTEXT_HH
@@ -8,7 +8,6 @@
 #include "util.hh"
 
 using fmt::format;
-using std::make_shared;
 using std::runtime_error;
 using std::shared_ptr;
 using std::string;
@@ -141,7 +140,7 @@ VarSlice &Var::operator[](std::pair<uint32_t, uint32_t> slice) {
     // create a new one
     // notice that slice is not part of generator's variables. It's handled by the parent (var)
     // itself
-    auto var_slice = ::make_shared<VarSlice>(this, high, low);
+    auto var_slice = generator->make_node<VarSlice>(this, high, low);
     slices_.emplace(slice, var_slice);
     return *slices_.at(slice);
 }
@@ -157,7 +156,7 @@ VarConcat &Var::concat(Var &var) {
             return *exist_var;
         }
     }
-    auto concat_ptr = std::make_shared<VarConcat>(generator, shared_from_this(), ptr);
+    auto concat_ptr = generator->make_node<VarConcat>(generator, shared_from_this(), ptr);
     concat_vars_.emplace(concat_ptr);
     return *concat_ptr;
 }
@@ -219,6 +218,11 @@ Var::Var(Generator *module, const std::string &name, uint32_t width, bool is_sig
 ASTNode *Var::parent() { return generator; }
 ASTNode *VarSlice::parent() { return parent_var; }
 
+void VarSlice::set_parent(Var *parent) {
+    parent_var = parent;
+    if (generator) generator->mark_dirty();
+}
+
 AssignStmt &Var::assign(const std::shared_ptr<Var> &var) {
     return assign(var, AssignmentType::Undefined);
 }
@@ -233,7 +237,7 @@ AssignStmt &Var::assign(const std::shared_ptr<Var> &var, AssignmentType type) {
     else if (type_ == VarType::Expression)
         throw VarException(::format("Cannot assign {0} to an expression", var->to_string(), name),
                            {this, var.get()});
-    auto const &stmt = ::make_shared<AssignStmt>(shared_from_this(), var, type);
+    auto const &stmt = generator->make_node<AssignStmt>(shared_from_this(), var, type);
     // determine the type
     if (type != AssignmentType::Undefined) {
         for (auto const &src : sources_) {
@@ -260,33 +264,45 @@ void Var::unassign(const std::shared_ptr<AssignStmt> &stmt) {
 }
 
 Const::Const(Generator *generator, int64_t value, uint32_t width, bool is_signed)
-    : Var(generator, std::to_string(value), width, is_signed, VarType::ConstValue), value_() {
+    : Var(generator, std::to_string(value), width, is_signed, VarType::ConstValue),
+      value_(value, width) {
     // need to deal with the signed value
     if (is_signed) {
-        // compute the -max value
-        uint64_t temp = (~0ull) << (width - 1);
-        int64_t min = 0;
-        std::memcpy(&min, &temp, sizeof(min));
-        if (value < min)
-            throw ::runtime_error(::format(
-                "{0} is smaller than the minimum value ({1}) given width {2}", value, min, width));
-        temp = (1ull << (width - 1)) - 1;
-        int64_t max;
-        std::memcpy(&max, &temp, sizeof(max));
-        if (value > max)
-            throw ::runtime_error(::format(
-                "{0} is larger than the maximum value ({1}) given width {2}", value, max, width));
-    } else {
+        if (width < 64) {
+            // compute the -max value
+            uint64_t temp = (~0ull) << (width - 1);
+            int64_t min = 0;
+            std::memcpy(&min, &temp, sizeof(min));
+            if (value < min)
+                throw ::runtime_error(
+                    ::format("{0} is smaller than the minimum value ({1}) given width {2}", value,
+                             min, width));
+            temp = (1ull << (width - 1)) - 1;
+            int64_t max;
+            std::memcpy(&max, &temp, sizeof(max));
+            if (value > max)
+                throw ::runtime_error(
+                    ::format("{0} is larger than the maximum value ({1}) given width {2}", value,
+                             max, width));
+        }
+    } else if (width < 64) {
         uint64_t max = (1ull << width) - 1;
         uint64_t unsigned_value;
         std::memcpy(&unsigned_value, &value, sizeof(unsigned_value));
         if (unsigned_value > max)
             throw ::runtime_error(::format(
                 "{0} is larger than the maximum value ({1}) given width {2}", value, max, width));
+    } else if (value < 0 && width > 64) {
+        // a 64-bit value takes the bit pattern as is
+        throw ::runtime_error(
+            ::format("{0} is negative but the {1}-bit constant is unsigned", value, width));
     }
-    value_ = value;
 }
 
+Const::Const(Generator *generator, const BitVector &value, bool is_signed)
+    : Var(generator, value.to_string(is_signed), value.width(), is_signed, VarType::ConstValue),
+      value_(value) {}
+
 VarCasted::VarCasted(Var *parent, VarCastType cast_type)
     : Var(parent->generator, "", parent->width, true, parent->type()),
       parent_var_(parent),
@@ -315,7 +331,7 @@ std::shared_ptr<Var> Var::cast(VarCastType cast_type) {
     } else if (casted_.find(cast_type) != casted_.end()) {
         return casted_.at(cast_type);
     } else {
-        casted_.emplace(cast_type, std::make_shared<VarCasted>(this, cast_type));
+        casted_.emplace(cast_type, generator->make_node<VarCasted>(this, cast_type));
         return casted_.at(cast_type);
     }
 }
@@ -323,13 +339,22 @@ std::shared_ptr<Var> Var::cast(VarCastType cast_type) {
 void Const::set_value(int64_t new_value) {
     try {
         Const c(generator, new_value, width, is_signed);
-        value_ = new_value;
+        value_ = c.bits();
+        if (generator) generator->mark_dirty();
     } catch (::runtime_error &) {
-        std::cerr << ::format("Unable to set value from {0} to {1}", value_, new_value)
+        std::cerr << ::format("Unable to set value from {0} to {1}", to_string(), new_value)
                   << std::endl;
     }
 }
 
+void Const::set_value(const BitVector &new_value) {
+    if (new_value.width() != width)
+        throw ::runtime_error(::format("cannot set {0} to {1}: width mismatch", to_string(),
+                                       new_value.to_string(is_signed)));
+    value_ = new_value;
+    if (generator) generator->mark_dirty();
+}
+
 void Const::add_source(const std::shared_ptr<AssignStmt> &) {
     throw VarException(::format("const {0} is not allowed to be driven by a net", to_string()),
                        {this});
@@ -350,7 +375,7 @@ VarConcat::VarConcat(Generator *m, const std::shared_ptr<Var> &first,
 }
 
 VarConcat &VarConcat::concat(Var &var) {
-    std::shared_ptr<VarConcat> new_var = std::make_shared<VarConcat>(*this);
+    std::shared_ptr<VarConcat> new_var = generator->make_node<VarConcat>(*this);
     new_var->vars.emplace_back(var.shared_from_this());
     new_var->width += var.width;
     // update the upstream vars about linking
@@ -372,13 +397,7 @@ VarConcat::VarConcat(const VarConcat &var)
     vars = std::vector<std::shared_ptr<Var>>(var.vars.begin(), var.vars.end());
 }
 
-std::string Const::to_string() const {
-    if (is_signed && value_ < 0) {
-        return ::format("-{0}\'h{1:X}", width, -value_);
-    } else {
-        return ::format("{0}\'h{1:X}", width, value_);
-    }
-}
+std::string Const::to_string() const { return value_.to_string(is_signed); }
 
 AssignStmt &Var::assign(Var &var, AssignmentType type) {
     // need to find the pointer
@@ -431,6 +450,8 @@ void change_var_expr(std::shared_ptr<Expr> expr, Var *target, Var *new_var) {
     } else {
         if (expr->left.get() == target) expr->left = new_var->shared_from_this();
         if (expr->right && expr->right.get() == target) expr->right = new_var->shared_from_this();
+        // the operands are rewritten in place, which the generator can't see
+        if (expr->generator) expr->generator->mark_dirty();
     }
 }
 
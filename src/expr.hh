@@ -6,6 +6,8 @@
 #include <unordered_set>
 #include <vector>
 #include "ast.hh"
+#include "bitvector.hh"
+#include "container.hh"
 #include "context.hh"
 
 enum ExprOp : uint64_t {
@@ -42,6 +44,9 @@ enum VarType { Base, Expression, Slice, ConstValue, PortIO, Parameter, BaseCaste
 
 enum VarCastType { Signed, Clock, AsyncReset};
 
+// sinks and sources of a var, kept in the order they are connected
+using AssignStmtSet = OrderedSet<std::shared_ptr<AssignStmt>>;
+
 struct Var : public std::enable_shared_from_this<Var>, public ASTNode {
 public:
     Var(Generator *m, const std::string &name, uint32_t width, bool is_signed);
@@ -94,9 +99,9 @@ public:
     ASTNode *parent() override;
 
     VarType type() const { return type_; }
-    const std::unordered_set<std::shared_ptr<AssignStmt>> &sinks() const { return sinks_; };
+    const AssignStmtSet &sinks() const { return sinks_; };
     void remove_sink(const std::shared_ptr<AssignStmt> &stmt) { sinks_.erase(stmt); }
-    const std::unordered_set<std::shared_ptr<AssignStmt>> &sources() const { return sources_; };
+    const AssignStmtSet &sources() const { return sources_; };
     void remove_source(const std::shared_ptr<AssignStmt> &stmt) { sources_.erase(stmt); }
     std::map<std::pair<uint32_t, uint32_t>, std::shared_ptr<VarSlice>> &get_slices() {
         return slices_;
@@ -123,8 +128,8 @@ public:
     Var() = delete;
 
 protected:
-    std::unordered_set<std::shared_ptr<AssignStmt>> sinks_;
-    std::unordered_set<std::shared_ptr<AssignStmt>> sources_;
+    AssignStmtSet sinks_;
+    AssignStmtSet sources_;
 
     VarType type_ = VarType::Base;
 
@@ -146,6 +151,9 @@ public:
 
     std::string to_string() const override;
 
+    Var *parent_var() const { return parent_var_; }
+    VarCastType cast_type() const { return cast_type_; }
+
 private:
     Var *parent_var_ = nullptr;
 
@@ -165,7 +173,8 @@ public:
     void add_sink(const std::shared_ptr<AssignStmt> &stmt) override;
     void add_source(const std::shared_ptr<AssignStmt> &stmt) override;
 
-    void set_parent(Var* parent) { parent_var = parent; }
+    // marks the generator dirty
+    void set_parent(Var* parent);
 
     void accept(ASTVisitor *visitor) override { visitor->visit(this); }
 
@@ -187,12 +196,16 @@ public:
 };
 
 struct Const : public Var {
-    // need to rewrite the const backend since the biggest number is uint64_t, which may not
 public:
     Const(Generator *m, int64_t value, uint32_t width, bool is_signed);
+    // arbitrary width. the width is taken from the value
+    Const(Generator *m, const BitVector &value, bool is_signed);
 
-    int64_t value() { return value_; }
+    // throws if the value doesn't fit into 64 bits
+    int64_t value() { return value_.to_int64(is_signed); }
+    const BitVector &bits() const { return value_; }
     void set_value(int64_t new_value);
+    void set_value(const BitVector &new_value);
     void add_source(const std::shared_ptr<AssignStmt> &stmt) override;
 
     std::string to_string() const override;
@@ -200,7 +213,7 @@ public:
     void accept(ASTVisitor *visitor) override { visitor->visit(this); }
 
 private:
-    int64_t value_;
+    BitVector value_;
 };
 
 struct Param: public Const {
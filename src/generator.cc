@@ -59,7 +59,7 @@ std::map<::string, std::shared_ptr<Port>> get_port_from_verilog(Generator *modul
             const auto &type = p.getType();
             const auto width = type.getBitWidth();
             const auto is_signed = type.isSigned();
-            ports.emplace(name, std::make_shared<Port>(module, direction, name, width,
+            ports.emplace(name, module->make_node<Port>(module, direction, name, width,
                                                        PortType::Data, is_signed));
         }
     }
@@ -93,8 +93,7 @@ Generator Generator::from_verilog(Context *context, const std::string &src_file,
     for (auto const &[port_name, port_type] : port_types) {
         if (mod.ports_.find(port_name) == mod.ports_.end())
             throw ::runtime_error(::format("unable to find port {0}", port_name));
-        std::shared_ptr<Var> &var_p = mod.vars_.at(port_name);
-        std::shared_ptr<Port> port_p = std::static_pointer_cast<Port>(var_p);
+        std::shared_ptr<Port> port_p = std::static_pointer_cast<Port>(mod.get_var(port_name));
         port_p->set_port_type(port_type);
     }
 
@@ -106,21 +105,26 @@ Var &Generator::var(const std::string &var_name, uint32_t width) {
 }
 
 Var &Generator::var(const std::string &var_name, uint32_t width, bool is_signed) {
-    if (vars_.find(var_name) != vars_.end()) {
-        auto v_p = get_var(var_name);
+    if (auto v_p = get_var(var_name)) {
         if (v_p->width != width || v_p->is_signed != is_signed)
             throw std::runtime_error(
                 ::format("redefinition of {0} with different width/sign", var_name));
         return *v_p;
     }
-    auto p = std::make_shared<Var>(this, var_name, width, is_signed);
+    auto p = make_node<Var>(this, var_name, width, is_signed);
     vars_.emplace(var_name, p);
+    mark_dirty();
     return *p;
 }
 
 std::shared_ptr<Var> Generator::get_var(const std::string &var_name) {
-    if (vars_.find(var_name) == vars_.end()) return nullptr;
-    return vars_.at(var_name);
+    auto iter = vars_.find(var_name);
+    if (iter == vars_.end()) return nullptr;
+    return iter->second;
+}
+
+void Generator::remove_port(const std::string &port_name) {
+    if (ports_.erase(port_name)) remove_var(port_name);
 }
 
 Port &Generator::port(PortDirection direction, const std::string &port_name, uint32_t width) {
@@ -131,29 +135,52 @@ Port &Generator::port(PortDirection direction, const std::string &port_name, uin
                       PortType type, bool is_signed) {
     if (ports_.find(port_name) != ports_.end())
         throw ::runtime_error(::format("{0} already exists in {1}", port_name, name));
-    auto p = std::make_shared<Port>(this, direction, port_name, width, type, is_signed);
+    auto p = make_node<Port>(this, direction, port_name, width, type, is_signed);
     vars_.emplace(port_name, p);
     ports_.emplace(port_name);
+    mark_dirty();
     return *p;
 }
 
 std::shared_ptr<Port> Generator::get_port(const std::string &port_name) {
     if (ports_.find(port_name) == ports_.end()) return nullptr;
-    auto var_p = vars_.at(port_name);
-    return std::static_pointer_cast<Port>(var_p);
+    return std::static_pointer_cast<Port>(get_var(port_name));
 }
 
 Expr &Generator::expr(ExprOp op, const std::shared_ptr<Var> &left,
                       const std::shared_ptr<Var> &right) {
-    auto expr = std::make_shared<Expr>(op, left, right);
+    ExprKey key{op, left.get(), right.get()};
+    auto iter = expr_table_.find(key);
+    if (iter != expr_table_.end()) {
+        auto *expr = iter->second;
+        // passes may rewire the operands in place, e.g. Var::move_sink_to. only reuse the
+        // node if it still matches
+        if (expr->op == op && expr->left == left && expr->right == right) return *expr;
+    }
+    auto expr = make_node<Expr>(op, left, right);
     exprs_.emplace(expr);
+    expr_table_[key] = expr.get();
     return *expr;
 }
 
+std::size_t Generator::ExprKeyHash::operator()(const ExprKey &key) const {
+    auto const &[op, left, right] = key;
+    auto seed = std::hash<const Var *>()(left);
+    seed ^= std::hash<const Var *>()(right) + 0x9e3779b9 + (seed << 6u) + (seed >> 2u);
+    seed ^= static_cast<std::size_t>(op) + 0x9e3779b9 + (seed << 6u) + (seed >> 2u);
+    return seed;
+}
+
 Const &Generator::constant(int64_t value, uint32_t width) { return constant(value, width, false); }
 
 Const &Generator::constant(int64_t value, uint32_t width, bool is_signed) {
-    auto ptr = std::make_shared<Const>(this, value, width, is_signed);
+    auto ptr = make_node<Const>(this, value, width, is_signed);
+    consts_.emplace(ptr);
+    return *ptr;
+}
+
+Const &Generator::constant(const BitVector &value, bool is_signed) {
+    auto ptr = make_node<Const>(this, value, is_signed);
     consts_.emplace(ptr);
     return *ptr;
 }
@@ -165,14 +192,15 @@ Param &Generator::parameter(const std::string &parameter_name, uint32_t width) {
 Param &Generator::parameter(const std::string &parameter_name, uint32_t width, bool is_signed) {
     if (params_.find(parameter_name) != params_.end())
         throw runtime_error(::format("parameter {0} already exists", parameter_name));
-    auto ptr = std::make_shared<Param>(this, parameter_name, width, is_signed);
+    auto ptr = make_node<Param>(this, parameter_name, width, is_signed);
     params_.emplace(parameter_name, ptr);
+    mark_dirty();
     return *ptr;
 }
 
 ASTNode *Generator::get_child(uint64_t index) {
     if (index < stmts_count())
-        return stmts_[index].get();
+        return stmts_.at(index).get();
     else if (index < stmts_count() + get_child_generator_size())
         return children_[index - stmts_count()].get();
     else
@@ -183,6 +211,7 @@ void Generator::add_child_generator(const std::shared_ptr<Generator> &child) {
     if (std::find(children_.begin(), children_.end(), child) == children_.end()) {
         children_.emplace_back(child);
         child->parent_generator_ = this;
+        mark_dirty();
     }
 }
 
@@ -198,6 +227,7 @@ void Generator::remove_child_generator(const std::shared_ptr<Generator> &child)
     auto pos = std::find(children_.begin(), children_.end(), child);
     if (pos != children_.end()) {
         children_.erase(pos);
+        mark_dirty();
     }
 }
 
@@ -223,7 +253,7 @@ std::set<std::string> Generator::get_all_var_names() {
 
 void Generator::add_stmt(std::shared_ptr<Stmt> stmt) {
     stmt->set_parent(this);
-    stmts_.emplace_back(std::move(stmt));
+    if (stmts_.emplace(stmt)) mark_dirty();
 }
 
 std::string Generator::get_unique_variable_name(const std::string &prefix,
@@ -249,10 +279,15 @@ std::string Generator::get_unique_variable_name(const std::string &prefix,
 void Generator::rename_var(const std::string &old_name, const std::string &new_name) {
     auto var = get_var(old_name);
     if (!var) return;
+    if (get_var(new_name))
+        throw ::runtime_error(::format("{0} already exists in {1}", new_name, name));
     // Using C++17 to replace the key
-    vars_.extract(old_name).key() = new_name;
+    auto node = vars_.extract(old_name);
+    node.key() = new_name;
+    vars_.insert(std::move(node));
     // rename the var
     var->name = new_name;
+    mark_dirty();
 }
 
 std::shared_ptr<Param> Generator::get_param(const std::string &param_name) const {
@@ -262,20 +297,30 @@ std::shared_ptr<Param> Generator::get_param(const std::string &param_name) const
 }
 
 void Generator::remove_stmt(const std::shared_ptr<Stmt> &stmt) {
-    auto pos = std::find(stmts_.begin(), stmts_.end(), stmt);
-    if (pos != stmts_.end()) {
-        stmts_.erase(pos);
+    if (stmts_.erase(stmt)) mark_dirty();
+}
+
+void Generator::remove_stmts(const std::vector<std::shared_ptr<Stmt>> &stmts) {
+    uint64_t count = 0;
+    for (auto const &stmt : stmts) count += stmts_.erase(stmt);
+    if (count) mark_dirty();
+}
+
+void Generator::mark_dirty() {
+    // dirty generators always have dirty ancestors, so we can stop early
+    for (auto *generator = this; generator != nullptr; generator = generator->parent_generator_) {
+        if (generator->dirty_.value.exchange(true)) break;
     }
 }
 
 std::shared_ptr<SequentialStmtBlock> Generator::sequential() {
-    auto stmt = std::make_shared<SequentialStmtBlock>();
+    auto stmt = make_node<SequentialStmtBlock>();
     add_stmt(stmt);
     return stmt;
 }
 
 std::shared_ptr<CombinationalStmtBlock> Generator::combinational() {
-    auto stmt = std::make_shared<CombinationalStmtBlock>();
+    auto stmt = make_node<CombinationalStmtBlock>();
     add_stmt(stmt);
     return stmt;
 }
@@ -428,8 +473,9 @@ PortPacked& Generator::port_packed(PortDirection direction, const std::string &p
                                    const PackedStruct &packed_struct_) {
     if (ports_.find(port_name) != ports_.end())
         throw ::runtime_error(::format("{0} already exists in {1}", port_name, name));
-    auto p = std::make_shared<PortPacked>(this, direction, port_name, packed_struct_);
+    auto p = make_node<PortPacked>(this, direction, port_name, packed_struct_);
     vars_.emplace(port_name, p);
     ports_.emplace(port_name);
+    mark_dirty();
     return *p;
 }
\ No newline at end of file
@@ -2,11 +2,14 @@
 
 #ifndef KRATOS_MODULE_HH
 #define KRATOS_MODULE_HH
+#include <atomic>
 #include <map>
 #include <string>
+#include <tuple>
 #include <unordered_map>
 #include <vector>
 
+#include "arena.hh"
 #include "context.hh"
 #include "port.hh"
 
@@ -21,7 +24,13 @@ public:
                                   const std::map<std::string, PortType> &port_types);
 
     Generator(Context *context, const std::string &name)
-        : ASTNode(ASTNodeKind::GeneratorKind), name(name), instance_name(name), context_(context) {}
+        : ASTNode(ASTNodeKind::GeneratorKind),
+          name(name),
+          instance_name(name),
+          context_(context),
+          arena_(context ? context->create_arena()
+                         : std::make_shared<IRArena>(std::make_shared<ArenaChunkPool>())),
+          creation_order_(context ? context->next_generator_order() : 0) {}
 
     Var &var(const std::string &var_name, uint32_t width);
     Var &var(const std::string &var_name, uint32_t width, bool is_signed);
@@ -32,10 +41,14 @@ public:
                             const PackedStruct &packed_struct_);
     Const &constant(int64_t value, uint32_t width);
     Const &constant(int64_t value, uint32_t width, bool is_signed);
+    // constants wider than 64 bits
+    Const &constant(const BitVector &value, bool is_signed);
     Param &parameter(const std::string &parameter_name, uint32_t width);
     Param &parameter(const std::string &parameter_name, uint32_t width, bool is_signed);
 
+    // structurally identical expressions share the same node
     Expr &expr(ExprOp op, const std::shared_ptr<Var> &left, const std::shared_ptr<Var> &right);
+    uint64_t inline exprs_count() const { return exprs_.size(); }
 
     // ports and vars
     std::shared_ptr<Port> get_port(const std::string &port_name);
@@ -43,21 +56,31 @@ public:
     const std::set<std::string> &get_port_names() const { return ports_; }
     const std::map<std::string, std::shared_ptr<Var>> &vars() const { return vars_; }
     void remove_var(const std::string &var_name) {
-        if (vars_.find(var_name) != vars_.end()) vars_.erase(var_name);
+        if (vars_.find(var_name) != vars_.end()) {
+            vars_.erase(var_name);
+            mark_dirty();
+        }
     }
+    void remove_port(const std::string &port_name);
     void rename_var(const std::string &old_name, const std::string &new_name);
     const inline std::map<std::string, std::shared_ptr<Param>> &get_params() const {
         return params_;
     }
     std::shared_ptr<Param> get_param(const std::string &param_name) const;
 
-    // statements
+    // statements. adding a statement that is already in the generator does nothing
     void add_stmt(std::shared_ptr<Stmt> stmt);
     uint64_t stmts_count() { return stmts_.size(); }
     std::shared_ptr<Stmt> get_stmt(uint32_t index) {
-        return index < stmts_.size() ? stmts_[index] : nullptr;
+        return index < stmts_.size() ? stmts_.at(index) : nullptr;
     }
+    // removal is amortized O(1) and keeps the order of the remaining statements. it leaves an
+    // empty slot behind, which makes get_stmt past that slot a linear scan until the statements
+    // are compacted. PassManager compacts the hierarchy before every pass and after the last
+    // one; reading statements never modifies the generator
     void remove_stmt(const std::shared_ptr<Stmt> &stmt);
+    void remove_stmts(const std::vector<std::shared_ptr<Stmt>> &stmts);
+    void compact_stmts() { stmts_.compact(); }
     // helper function to initiate the blocks
     std::shared_ptr<SequentialStmtBlock> sequential();
     std::shared_ptr<CombinationalStmtBlock> combinational();
@@ -87,16 +110,37 @@ public:
     std::string get_unique_variable_name(const std::string &prefix, const std::string &var_name);
 
     Context *context() const { return context_; }
+    uint64_t creation_order() const { return creation_order_; }
+
+    // IR nodes that belong to this generator are allocated from its arena
+    const std::shared_ptr<IRArena> &arena() const { return arena_; }
+    template <typename T, typename... Args>
+    std::shared_ptr<T> make_node(Args &&... args) {
+        return make_ir_node<T>(arena_, std::forward<Args>(args)...);
+    }
 
     ASTNode *parent() override { return parent_generator_; }
 
+    // the parent's hash covers the instance name, so the parent is marked dirty
+    void set_instance_name(const std::string &value) {
+        if (instance_name == value) return;
+        instance_name = value;
+        if (parent_generator_) parent_generator_->mark_dirty();
+    }
+
     bool is_stub() const { return is_stub_; }
-    void set_is_stub(bool value) { is_stub_ = value; }
+    void set_is_stub(bool value) {
+        is_stub_ = value;
+        mark_dirty();
+    }
 
     // if imported from verilog or specified
     bool external() { return (!lib_files_.empty()) || is_external_; }
     std::string external_filename() const { return lib_files_.empty() ? "" : lib_files_[0]; }
-    void set_external(bool value) { is_external_ = value; }
+    void set_external(bool value) {
+        is_external_ = value;
+        mark_dirty();
+    }
 
     std::shared_ptr<Stmt> wire_ports(std::shared_ptr<Port> &port1, std::shared_ptr<Port> &port2);
 
@@ -108,6 +152,14 @@ public:
     // this is for internal libraries only. use it only if you know what you're doing
     void set_is_cloned(bool value) { is_cloned_ = value; }
 
+    // mutation tracking for incremental hashing. a generator is dirty until it gets hashed;
+    // marking a generator also marks all its ancestors. the setters of statements and
+    // constants, renaming and set_instance_name mark the generator; code that writes to other
+    // fields directly needs to call mark_dirty itself
+    bool is_dirty() const { return dirty_.value; }
+    void mark_dirty();
+    void clear_dirty() { dirty_.value = false; }
+
     // debug info
     const std::unordered_map<std::shared_ptr<Generator>, std::pair<std::string, uint32_t>>
         &children_debug() const {
@@ -117,13 +169,21 @@ public:
 private:
     std::vector<std::string> lib_files_;
     Context *context_;
+    std::shared_ptr<IRArena> arena_;
+    uint64_t creation_order_;
 
     std::map<std::string, std::shared_ptr<Var>> vars_;
     std::set<std::string> ports_;
     std::map<std::string, std::shared_ptr<Param>> params_;
     std::unordered_set<std::shared_ptr<Expr>> exprs_;
+    // hash-consing table for expressions, keyed by (op, left, right)
+    using ExprKey = std::tuple<ExprOp, const Var *, const Var *>;
+    struct ExprKeyHash {
+        std::size_t operator()(const ExprKey &key) const;
+    };
+    std::unordered_map<ExprKey, Expr *, ExprKeyHash> expr_table_;
 
-    std::vector<std::shared_ptr<Stmt>> stmts_;
+    OrderedSet<std::shared_ptr<Stmt>> stmts_;
 
     std::vector<std::shared_ptr<Generator>> children_;
     std::unordered_map<std::shared_ptr<Generator>, std::pair<std::string, uint32_t>>
@@ -139,6 +199,18 @@ private:
     // used for shallow cloning
     std::unordered_set<std::shared_ptr<Generator>> clones_;
     bool is_cloned_ = false;
+
+    // atomic since siblings in a parallel pass may mark their parent at the same time
+    struct DirtyFlag {
+        std::atomic<bool> value = true;
+        DirtyFlag() = default;
+        DirtyFlag(const DirtyFlag &flag) : value(flag.value.load()) {}
+        DirtyFlag &operator=(const DirtyFlag &flag) {
+            value = flag.value.load();
+            return *this;
+        }
+    };
+    DirtyFlag dirty_;
 };
 
 #endif  // KRATOS_MODULE_HH22
@@ -112,7 +112,8 @@ std::vector<std::unordered_set<Generator *>> GeneratorGraph::get_leveled_generat
     uint32_t max_level = 0;
 
     while (!queue.empty()) {
-        const auto &[generator, current_level] = queue.front();
+        // copy it since pop() destroys the front element
+        const auto [generator, current_level] = queue.front();
         queue.pop();
         auto const &node = get_node(generator);
         if (level_index.find(node) == level_index.end() || level_index.at(node) < current_level) {
@@ -3,10 +3,13 @@
 #include "ast.hh"
 #include "expr.hh"
 #include "generator.hh"
-#include "graph.hh"
 #include "pass.hh"
+#include "port.hh"
 #include "stmt.hh"
 #include "cxxpool.h"
+#include "fmt/format.h"
+
+using fmt::format;
 
 /*
  * Once this project is moved to gcc-9, we will use the parallel execution
@@ -294,6 +297,211 @@ private:
     }
 };
 
+// Merkle-style hash of a generator. every node is hashed from its own fields and the hashes of
+// its children, and var hashes are memoized since expressions are shared. child generators
+// contribute the hash they already have in the context, or only their name without a context
+class StructuralHasher {
+public:
+    StructuralHasher(Context* context, Generator* root) : context_(context), root_(root) {}
+
+    uint64_t hash() {
+        std::vector<uint64_t> values;
+        values.emplace_back(hash_string(root_->name));
+        // both maps are sorted by name
+        for (auto const& iter : root_->vars()) values.emplace_back(hash_var(iter.second.get()));
+        for (auto const& [name, param] : root_->get_params()) {
+            values.emplace_back(hash_string(name));
+            values.emplace_back(param->bits().hash());
+        }
+        for (uint64_t i = 0; i < root_->stmts_count(); i++) {
+            values.emplace_back(hash_stmt(root_->get_stmt(i).get()));
+        }
+        for (auto const& child : root_->get_child_generators()) {
+            values.emplace_back(hash_string(child->instance_name));
+            values.emplace_back(context_ && context_->has_hash(child.get())
+                                    ? context_->get_hash(child.get())
+                                    : hash_string(child->name));
+        }
+        return hash_values(values);
+    }
+
+private:
+    Context* context_;
+    Generator* root_;
+    std::unordered_map<const Var*, uint64_t> var_hashes_;
+
+    // distinguishes node kinds that have the same fields
+    enum NodeTag : uint64_t {
+        VarTag = 0x9e3779b97f4a7c15,
+        PortTag,
+        ConstTag,
+        ParamTag,
+        SliceTag,
+        ExprTag,
+        ConcatTag,
+        CastTag,
+        AssignTag,
+        IfTag,
+        SwitchTag,
+        CombinationalTag,
+        SequentialTag,
+        InstantiationTag
+    };
+
+    static uint64_t hash_string(const std::string& value) {
+        return hash_64_fnv1a(value.c_str(), value.size());
+    }
+
+    static uint64_t hash_values(const std::vector<uint64_t>& values) {
+        return XXHash64::hash(values.data(), values.size() * sizeof(uint64_t), 0);
+    }
+
+    uint64_t hash_var(Var* var) {
+        if (!var) return 0;
+        auto iter = var_hashes_.find(var);
+        if (iter != var_hashes_.end()) return iter->second;
+
+        std::vector<uint64_t> values{var->width, var->is_signed};
+        // concatenations of three or more vars are copy-constructed as base vars
+        if (auto concat = dynamic_cast<VarConcat*>(var)) {
+            values.emplace_back(ConcatTag);
+            for (auto const& v : concat->vars) values.emplace_back(hash_var(v.get()));
+            auto hash = hash_values(values);
+            var_hashes_.emplace(var, hash);
+            return hash;
+        }
+        switch (var->type()) {
+            case VarType::Base:
+            case VarType::PortIO: {
+                values.emplace_back(hash_string(var->name));
+                // ports of child generators show up in the parent
+                if (var->generator != root_)
+                    values.emplace_back(hash_string(var->generator->instance_name));
+                if (var->type() == VarType::PortIO) {
+                    auto port = reinterpret_cast<Port*>(var);
+                    values.emplace_back(PortTag);
+                    values.emplace_back(static_cast<uint64_t>(port->port_direction()));
+                    values.emplace_back(static_cast<uint64_t>(port->port_type()));
+                    if (port->is_packed()) {
+                        auto packed = reinterpret_cast<PortPacked*>(port);
+                        values.emplace_back(hash_string(packed->packed_struct().struct_name));
+                    }
+                } else {
+                    values.emplace_back(VarTag);
+                }
+                break;
+            }
+            case VarType::ConstValue: {
+                auto const_ = reinterpret_cast<Const*>(var);
+                values.emplace_back(ConstTag);
+                values.emplace_back(const_->bits().hash());
+                break;
+            }
+            case VarType::Parameter: {
+                auto param = reinterpret_cast<Param*>(var);
+                values.emplace_back(ParamTag);
+                values.emplace_back(hash_string(param->to_string()));
+                values.emplace_back(param->bits().hash());
+                break;
+            }
+            case VarType::Slice: {
+                auto slice = reinterpret_cast<VarSlice*>(var);
+                values.emplace_back(SliceTag);
+                values.emplace_back(hash_var(slice->parent_var));
+                values.emplace_back(slice->high);
+                values.emplace_back(slice->low);
+                break;
+            }
+            case VarType::Expression: {
+                auto expr = reinterpret_cast<Expr*>(var);
+                values.emplace_back(ExprTag);
+                values.emplace_back(expr->op);
+                values.emplace_back(hash_var(expr->left.get()));
+                values.emplace_back(hash_var(expr->right.get()));
+                break;
+            }
+            case VarType::BaseCasted: {
+                auto casted = reinterpret_cast<VarCasted*>(var);
+                values.emplace_back(CastTag);
+                values.emplace_back(casted->cast_type());
+                values.emplace_back(hash_var(casted->parent_var()));
+                break;
+            }
+        }
+        auto hash = hash_values(values);
+        var_hashes_.emplace(var, hash);
+        return hash;
+    }
+
+    uint64_t hash_stmts(const std::vector<std::shared_ptr<Stmt>>& stmts) {
+        std::vector<uint64_t> values;
+        values.reserve(stmts.size());
+        for (auto const& stmt : stmts) values.emplace_back(hash_stmt(stmt.get()));
+        return hash_values(values);
+    }
+
+    uint64_t hash_stmt(Stmt* stmt) {
+        std::vector<uint64_t> values;
+        switch (stmt->type()) {
+            case StatementType::Assign: {
+                auto assign = reinterpret_cast<AssignStmt*>(stmt);
+                values = {AssignTag, hash_var(assign->left().get()),
+                          hash_var(assign->right().get()),
+                          static_cast<uint64_t>(assign->assign_type())};
+                break;
+            }
+            case StatementType::If: {
+                auto if_ = reinterpret_cast<IfStmt*>(stmt);
+                values = {IfTag, hash_var(if_->predicate().get()), hash_stmts(if_->then_body()),
+                          hash_stmts(if_->else_body())};
+                break;
+            }
+            case StatementType::Switch: {
+                auto switch_ = reinterpret_cast<SwitchStmt*>(stmt);
+                values = {SwitchTag, hash_var(switch_->target().get())};
+                for (auto const& [label, body] : switch_->body()) {
+                    values.emplace_back(hash_var(label.get()));
+                    values.emplace_back(hash_stmts(body));
+                }
+                break;
+            }
+            case StatementType::Block: {
+                auto block = reinterpret_cast<StmtBlock*>(stmt);
+                if (block->block_type() == StatementBlockType::Sequential) {
+                    auto seq = reinterpret_cast<SequentialStmtBlock*>(stmt);
+                    values.emplace_back(SequentialTag);
+                    for (auto const& [edge, var] : seq->get_conditions()) {
+                        values.emplace_back(edge);
+                        values.emplace_back(hash_var(var.get()));
+                    }
+                } else {
+                    values.emplace_back(CombinationalTag);
+                }
+                for (uint64_t i = 0; i < block->child_count(); i++) {
+                    values.emplace_back(hash_stmt(reinterpret_cast<Stmt*>(block->get_child(i))));
+                }
+                break;
+            }
+            case StatementType::ModuleInstantiation: {
+                auto inst = reinterpret_cast<ModuleInstantiationStmt*>(stmt);
+                values = {InstantiationTag, hash_string(inst->target()->name),
+                          hash_string(inst->target()->instance_name)};
+                for (auto const& [internal, external] : inst->port_mapping()) {
+                    values.emplace_back(hash_var(internal.get()));
+                    values.emplace_back(hash_var(external.get()));
+                }
+                break;
+            }
+        }
+        return hash_values(values);
+    }
+};
+
+uint64_t hash_generator_structural(Context* context, Generator* generator) {
+    StructuralHasher hasher(context, generator);
+    return hasher.hash();
+}
+
 uint64_t hash_generator(Generator* generator) {
     // we use a visitor to compute all the hashes
     HashVisitor hash_visitor(generator);
@@ -317,12 +525,161 @@ void hash_generator_name(Context* context, Generator* generator) {
     context->add_hash(generator, hash);
 }
 
+uint64_t hash_generator_codegen(Generator* generator) {
+    // bump the version whenever the codegen output format changes
+    constexpr uint64_t codegen_version = 2;
+    // the module text only depends on the names of the children, which the structural hash
+    // covers through the instantiation statements. their hashes in the context may be stale
+    // by now, e.g. after uniquification
+    StructuralHasher hasher(nullptr, generator);
+    auto const& filename = generator->external_filename();
+    std::vector<uint64_t> values = {codegen_version, hasher.hash(), generator->external(),
+                                    hash_64_fnv1a(filename.c_str(), filename.size())};
+    return XXHash64::hash(values.data(), values.size() * sizeof(uint64_t), 0);
+}
+
+// serializes everything the SystemVerilog codegen reads from a generator, in the same order it
+// is emitted. two generators with the same key produce the same module text
+class VerilogKeyBuilder {
+public:
+    explicit VerilogKeyBuilder(Generator* generator) : generator_(generator) {}
+
+    const std::string& key() {
+        if (!key_.empty()) return key_;
+        add(generator_->name);
+        auto const& port_names = generator_->get_port_names();
+        for (auto const& port_name : port_names) {
+            auto port = generator_->get_port(port_name);
+            add(port_name);
+            add(static_cast<uint64_t>(port->port_direction()));
+            add(port->width);
+            add(port->is_signed);
+            add(port->is_packed()
+                    ? reinterpret_cast<PortPacked*>(port.get())->packed_struct().struct_name
+                    : "");
+        }
+        for (auto const& [name, param] : generator_->get_params()) {
+            add(name);
+            add(param->value_str());
+        }
+        for (auto const& var_name : generator_->get_vars()) {
+            auto var = generator_->get_var(var_name);
+            if (var->type() != VarType::Base) continue;
+            add(var_name);
+            add(var->width);
+            add(var->is_signed);
+        }
+        for (uint64_t i = 0; i < generator_->stmts_count(); i++) {
+            add_stmt(generator_->get_stmt(i).get());
+        }
+        return key_;
+    }
+
+private:
+    Generator* generator_;
+    std::string key_;
+
+    void add(const std::string& value) {
+        key_.append(value);
+        key_.push_back('\0');
+    }
+    void add(uint64_t value) { add(std::to_string(value)); }
+
+    void add_stmts(const std::vector<std::shared_ptr<Stmt>>& stmts) {
+        add(stmts.size());
+        for (auto const& stmt : stmts) add_stmt(stmt.get());
+    }
+
+    void add_stmt(Stmt* stmt) {
+        add(static_cast<uint64_t>(stmt->type()));
+        if (stmt->type() == StatementType::Assign) {
+            auto assign = reinterpret_cast<AssignStmt*>(stmt);
+            add(assign->left()->to_string());
+            add(assign->right()->to_string());
+            add(assign->left()->generator == generator_);
+            add(assign->right()->generator == generator_);
+            add(static_cast<uint64_t>(assign->assign_type()));
+            add(assign->parent() == generator_);
+        } else if (stmt->type() == StatementType::Block) {
+            auto block = reinterpret_cast<StmtBlock*>(stmt);
+            add(static_cast<uint64_t>(block->block_type()));
+            if (block->block_type() == StatementBlockType::Sequential) {
+                auto seq = reinterpret_cast<SequentialStmtBlock*>(stmt);
+                for (auto const& [edge, var] : seq->get_conditions()) {
+                    add(static_cast<uint64_t>(edge));
+                    add(var->to_string());
+                }
+            }
+            add(block->child_count());
+            for (uint64_t i = 0; i < block->child_count(); i++) {
+                add_stmt(reinterpret_cast<Stmt*>(block->get_child(i)));
+            }
+        } else if (stmt->type() == StatementType::If) {
+            auto if_ = reinterpret_cast<IfStmt*>(stmt);
+            add(if_->predicate()->to_string());
+            add_stmts(if_->then_body());
+            add_stmts(if_->else_body());
+        } else if (stmt->type() == StatementType::Switch) {
+            auto switch_ = reinterpret_cast<SwitchStmt*>(stmt);
+            add(switch_->target()->to_string());
+            for (auto const& [label, body] : switch_->body()) {
+                add(label ? label->to_string() : "default");
+                add_stmts(body);
+            }
+        } else if (stmt->type() == StatementType::ModuleInstantiation) {
+            auto inst = reinterpret_cast<ModuleInstantiationStmt*>(stmt);
+            add(inst->target()->name);
+            add(inst->target()->instance_name);
+            for (auto const& [name, param] : inst->target()->get_params()) {
+                add(name);
+                add(param->value_str());
+            }
+            for (auto const& [internal, external] : inst->port_mapping()) {
+                add(internal->to_string());
+                add(external->to_string());
+            }
+        }
+    }
+};
+
+bool generator_structural_equal(Generator* generator1, Generator* generator2) {
+    if (generator1 == generator2) return true;
+    if (generator1->external() || generator2->external())
+        return generator1->external_filename() == generator2->external_filename() &&
+               generator1->name == generator2->name;
+    if (VerilogKeyBuilder(generator1).key() != VerilogKeyBuilder(generator2).key()) return false;
+    // module instantiations may not have been created yet, so compare the children directly
+    auto const& children1 = generator1->get_child_generators();
+    auto const& children2 = generator2->get_child_generators();
+    if (children1.size() != children2.size()) return false;
+    for (uint64_t i = 0; i < children1.size(); i++) {
+        if (children1[i]->instance_name != children2[i]->instance_name ||
+            !generator_structural_equal(children1[i].get(), children2[i].get()))
+            return false;
+    }
+    return true;
+}
+
+// collects the generators that need to be hashed, children first. a clean generator that
+// already has a hash only has clean descendants, so its whole subtree is skipped
+void collect_dirty_generators(Context* context, Generator* generator, uint64_t level,
+                              std::vector<Generator*>& sequence,
+                              std::unordered_map<Generator*, uint64_t>& node_level) {
+    if (!generator->is_dirty() && context->has_hash(generator)) return;
+    if (node_level.find(generator) != node_level.end())
+        throw std::runtime_error(
+            ::format("{0} was used in another generator!", generator->instance_name));
+    node_level.emplace(generator, level);
+    for (auto const& child : generator->get_child_generators())
+        collect_dirty_generators(context, child.get(), level + 1, sequence, node_level);
+    sequence.emplace_back(generator);
+}
+
 void hash_generators_context(Context* context, Generator* root, HashStrategy strategy) {
-    // compute the generator graph
-    GeneratorGraph g(root);
-    // if it's sequential, do topological sort
-    // if it's parallel, do level sort
-    auto const& sequence = g.get_sorted_generators();
+    // only the generators changed since the last run are hashed again
+    std::vector<Generator*> sequence;
+    std::unordered_map<Generator*, uint64_t> node_level;
+    collect_dirty_generators(context, root, 0, sequence, node_level);
     std::vector<Generator *> list;
     // reserve for list
     list.reserve(sequence.size());
@@ -336,7 +693,7 @@ void hash_generators_context(Context* context, Generator* root, HashStrategy str
             } else {
                 hash_generator_src(context, node);
             }
-        } else if (context->get_generators_by_name(node->name).size() == 1) {
+        } else if (context->num_generators_by_name(node->name) == 1) {
             // just need to hash the name
             hash_generator_name(context, node);
         } else {
@@ -347,32 +704,67 @@ void hash_generators_context(Context* context, Generator* root, HashStrategy str
         }
     }
 
-    std::vector<uint64_t> hash_values;
-    hash_values.reserve(list.size());
-
-    if (strategy == HashStrategy::SequentialHash) {
-        for (auto& node : list) {
-            uint64_t hash = hash_generator(node);
-            hash_values.emplace_back(hash);
+    if (strategy == HashStrategy::StructuralHash) {
+        // the sequence is sorted children first, so every child hash is ready by the time its
+        // parent is hashed
+        for (auto const& node : list) {
+            context->add_hash(node, hash_generator_structural(context, node));
         }
-    } else if (strategy == HashStrategy::ParallelHash) {
+    } else if (strategy == HashStrategy::ParallelStructuralHash) {
+        // hash level by level from the bottom, in parallel within each level
+        uint64_t num_levels = 0;
+        for (auto const& node : list) num_levels = std::max(num_levels, node_level.at(node) + 1);
         uint32_t num_cpus = std::thread::hardware_concurrency();
         num_cpus = std::max(1u, num_cpus / 2);
         cxxpool::thread_pool pool{num_cpus};
 
-        std::vector<std::future<uint64_t>> thread_tasks;
-        thread_tasks.reserve(list.size());
-
-        for (auto const &node: list) {
-            auto task = pool.push(hash_generator, node);
-            thread_tasks.emplace_back(std::move(task));
+        for (uint64_t i = num_levels; i > 0; i--) {
+            std::vector<Generator*> level_list;
+            std::vector<std::future<uint64_t>> thread_tasks;
+            for (auto const& node : list) {
+                if (node_level.at(node) != i - 1) continue;
+                level_list.emplace_back(node);
+                thread_tasks.emplace_back(pool.push(hash_generator_structural, context, node));
+            }
+            // the tasks read the hashes of the level below from the context, so nothing is
+            // written to it until the entire level is finished
+            std::vector<uint64_t> level_hashes;
+            level_hashes.reserve(level_list.size());
+            for (auto& task : thread_tasks) level_hashes.emplace_back(task.get());
+            for (uint64_t j = 0; j < level_list.size(); j++) {
+                context->add_hash(level_list[j], level_hashes[j]);
+            }
         }
+    } else {
+        std::vector<uint64_t> hash_values;
+        hash_values.reserve(list.size());
+
+        if (strategy == HashStrategy::SequentialHash) {
+            for (auto& node : list) {
+                uint64_t hash = hash_generator(node);
+                hash_values.emplace_back(hash);
+            }
+        } else if (strategy == HashStrategy::ParallelHash) {
+            uint32_t num_cpus = std::thread::hardware_concurrency();
+            num_cpus = std::max(1u, num_cpus / 2);
+            cxxpool::thread_pool pool{num_cpus};
 
-        cxxpool::get(thread_tasks.begin(), thread_tasks.end(), hash_values);
-    }
-    for (uint32_t i = 0; i < list.size(); i++) {
-        auto const &node = list[i];
-        auto const hash = hash_values[i];
-        context->add_hash(node, hash);
+            std::vector<std::future<uint64_t>> thread_tasks;
+            thread_tasks.reserve(list.size());
+
+            for (auto const &node: list) {
+                auto task = pool.push(hash_generator, node);
+                thread_tasks.emplace_back(std::move(task));
+            }
+
+            cxxpool::get(thread_tasks.begin(), thread_tasks.end(), hash_values);
+        }
+        for (uint32_t i = 0; i < list.size(); i++) {
+            auto const &node = list[i];
+            auto const hash = hash_values[i];
+            context->add_hash(node, hash);
+        }
     }
+
+    for (auto const& node : sequence) node->clear_dirty();
 }
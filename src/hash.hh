@@ -5,4 +5,14 @@
 
 void hash_generators_context(Context *context, Generator *root, HashStrategy strategy);
 
+// string-free Merkle hash of a generator. child generators need to be hashed first
+uint64_t hash_generator_structural(Context *context, Generator *generator);
+
+// codegen cache key. the structural hash of the generator, with the children only contributing
+// their names, plus the codegen format version and the external file
+uint64_t hash_generator_codegen(Generator *generator);
+
+// full comparison of two generators, including their children. used to rule out hash collisions
+bool generator_structural_equal(Generator *generator1, Generator *generator2);
+
 #endif  // KRATOS_HASH_HH
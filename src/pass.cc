@@ -1,12 +1,23 @@
 #include "pass.hh"
 #include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <deque>
+#include <exception>
+#include <fstream>
 #include <iostream>
+#include <queue>
+#include <random>
+#include <regex>
 #include <sstream>
 #include "codegen.hh"
+#include "cxxpool.h"
 #include "except.hh"
 #include "fmt/format.h"
 #include "generator.hh"
+#include "graph.hh"
 #include "port.hh"
+#include "sim.hh"
 #include "util.hh"
 
 using fmt::format;
@@ -42,15 +53,91 @@ class AssignmentTypeBlockVisitor : public ASTVisitor {
     }
 };
 
-void fix_assignment_type(Generator* top) {
-    // first we fix all the block assignment
-    AssignmentTypeBlockVisitor visitor;
-    visitor.visit_root(top);
+void fix_assignment_type_generator(Generator* generator) {
+    // first we fix all the block assignment, then we assign any existing assignment as blocking
+    // assignment. a block is visited before its statements, so one walk does both
+    AssignmentTypeBlockVisitor block_visitor;
+    AssignmentTypeVisitor final_visitor(AssignmentType::Blocking, false);
+    CompositeVisitor visitor;
+    visitor.add_visitor(&block_visitor);
+    visitor.add_visitor(&final_visitor);
+    visitor.visit_content(generator);
+}
+
+class GeneratorOrderVisitor : public ASTVisitor {
+public:
+    void visit(Generator* generator) override { generators.emplace_back(generator); }
+
+    std::vector<Generator*> generators;
+};
+
+// calls fn on every generator in the hierarchy, parents before children
+void sequential_generator_pass(Generator* top, const std::function<void(Generator*)>& fn) {
+    GeneratorOrderVisitor visitor;
     visitor.visit_generator_root(top);
+    for (auto const& generator : visitor.generators) fn(generator);
+}
 
-    // then we assign any existing assignment as blocking assignment
-    AssignmentTypeVisitor final_visitor(AssignmentType::Blocking, false);
-    final_visitor.visit_root(top->ast_node());
+GeneratorOrder generator_order(Generator* top) {
+    GeneratorOrderVisitor visitor;
+    visitor.visit_generator_root(top);
+    return {std::move(visitor.generators)};
+}
+
+GeneratorLevels generator_levels(Generator* top) {
+    auto const generators = generator_order(top).generators;
+    std::unordered_map<Generator*, uint64_t> order;
+    order.reserve(generators.size());
+    for (auto const& generator : generators) order.emplace(generator, order.size());
+
+    GeneratorGraph graph(top);
+    GeneratorLevels result;
+    for (auto const& level : graph.get_leveled_generators()) {
+        // sort them in hierarchy order so that the reported error is always the same
+        std::vector<Generator*> sorted(level.begin(), level.end());
+        std::sort(sorted.begin(), sorted.end(),
+                  [&](Generator* a, Generator* b) { return order.at(a) < order.at(b); });
+        result.levels.emplace_back(std::move(sorted));
+    }
+    return result;
+}
+
+void parallel_generator_pass(Generator* top, const std::function<void(Generator*)>& fn) {
+    parallel_generator_pass(generator_levels(top), fn);
+}
+
+void parallel_generator_pass(const GeneratorLevels& levels,
+                             const std::function<void(Generator*)>& fn) {
+    uint32_t num_cpus = std::thread::hardware_concurrency();
+    num_cpus = std::max(1u, num_cpus / 2);
+    cxxpool::thread_pool pool{num_cpus};
+
+    for (auto const& generators : levels.levels) {
+        if (generators.size() == 1) {
+            fn(generators[0]);
+            continue;
+        }
+
+        std::vector<std::future<void>> thread_tasks;
+        thread_tasks.reserve(generators.size());
+        for (auto const& generator : generators) {
+            thread_tasks.emplace_back(pool.push(fn, generator));
+        }
+        // wait for the entire level before re-throwing the first error
+        std::exception_ptr error;
+        for (auto& task : thread_tasks) {
+            try {
+                task.get();
+            } catch (...) {
+                if (!error) error = std::current_exception();
+            }
+        }
+        if (error) std::rethrow_exception(error);
+    }
+}
+
+void fix_assignment_type(Generator* top) {
+    sequential_generator_pass(top, &fix_assignment_type_generator);
 }
 
 class VerifyAssignmentVisitor : public ASTVisitor {
@@ -65,8 +152,13 @@ public:
             if (right->type() == VarType::ConstValue) {
                 auto old_value = right->as<Const>();
                 try {
+                    auto const& bits = old_value->bits();
+                    auto const is_signed = old_value->is_signed;
+                    if (!bits.fits(left->width, is_signed))
+                        throw ::runtime_error(::format("{0} does not fit into {1} bits",
+                                                       old_value->to_string(), left->width));
                     auto& new_const =
-                        generator_->constant(old_value->value(), left->width, old_value->is_signed);
+                        generator_->constant(bits.resized(left->width, is_signed), is_signed);
                     stmt->set_right(new_const.shared_from_this());
                     right = new_const.shared_from_this();
                 } catch (::runtime_error&) {
@@ -86,12 +178,13 @@ public:
                 {stmt});
     }
 
-    void visit(Generator* generator) override {
-        auto vars = generator->get_all_var_names();
-        for (auto const& var_name : vars) {
-            auto var = generator->get_var(var_name);
-            check_var(var.get());
-        }
+    // the statement walk also reaches the ports of child generators, which are checked with
+    // their own generator
+    void visit(Var* var) override {
+        if (var->generator == generator_) check_var(var);
+    }
+    void visit(Port* port) override {
+        if (port->generator == generator_) check_var(port);
     }
 
 private:
@@ -99,7 +192,7 @@ private:
 
     void inline static check_var(Var* var) {
         bool is_top_level = false;
-        auto sources = var->sources();
+        auto const& sources = var->sources();
         for (auto const& stmt : sources) {
             if (stmt->parent()->ast_node_kind() == ASTNodeKind::GeneratorKind) {
                 is_top_level = true;
@@ -131,10 +224,14 @@ private:
     }
 };
 
-void verify_assignments(Generator* top) {
+void verify_assignments_generator(Generator* generator) {
     // verify the assignment width match, and sign as well
-    VerifyAssignmentVisitor visitor(top);
-    visitor.visit_root(top);
+    VerifyAssignmentVisitor visitor(generator);
+    visitor.visit_content(generator);
+}
+
+void verify_assignments(Generator* top) {
+    sequential_generator_pass(top, &verify_assignments_generator);
 }
 
 class VarAccumulationVisitor : public ASTVisitor {
@@ -165,73 +262,76 @@ void remove_unused_vars(Generator* top) {
     }
 }
 
-class GeneratorConnectivityVisitor : public ASTVisitor {
-public:
-    GeneratorConnectivityVisitor() : is_top_level_(true) {}
-    void visit(Generator* generator) override {
-        // skip if it's an external module or stub module
-        if (generator->external() || generator->is_stub()) return;
-        const auto& port_names = generator->get_port_names();
-        for (const auto& port_name : port_names) {
-            auto const& port = generator->get_port(port_name);
-
-            // based on whether it's an input or output
-            // for inputs, if it's not top generator, we need to check if
-            // something is driving it
-            if (port->port_direction() == PortDirection::In) {
-                if (is_top_level_) continue;
-            }
-
-            bool has_error = true;
-            std::unordered_set<uint32_t> bits;
-            bits.reserve(port->width);
-            if (!port->sources().empty()) {
-                // it has been assigned. need to compute all the slices
-                auto sources = port->sources();
-                for (auto& stmt : sources) {
-                    auto src = stmt->right();
-                    if (src->type() == VarType::Slice) {
-                        auto ptr = src->as<VarSlice>();
-                        auto low = ptr->low;
-                        auto high = ptr->high;
-                        for (uint32_t i = low; i <= high; i++) {
-                            bits.emplace(i);
-                        }
-                    } else {
-                        has_error = false;
-                        for (uint32_t i = 0; i < port->width; i++) bits.emplace(i);
-                        break;
-                    }
+void check_port_connectivity(Port* port) {
+    bool has_error = true;
+    std::unordered_set<uint32_t> bits;
+    bits.reserve(port->width);
+    if (!port->sources().empty()) {
+        // it has been assigned. need to compute all the slices
+        auto const& sources = port->sources();
+        for (auto const& stmt : sources) {
+            auto src = stmt->right();
+            if (src->type() == VarType::Slice) {
+                auto ptr = src->as<VarSlice>();
+                auto low = ptr->low;
+                auto high = ptr->high;
+                for (uint32_t i = low; i <= high; i++) {
+                    bits.emplace(i);
                 }
+            } else {
+                has_error = false;
+                for (uint32_t i = 0; i < port->width; i++) bits.emplace(i);
+                break;
             }
-            if (!has_error && bits.size() != port->width) has_error = true;
+        }
+    }
+    if (!has_error && bits.size() != port->width) has_error = true;
 
-            if (has_error) {
-                std::vector<Stmt*> stmt_list;
-                for (auto const& stmt : port->sources()) {
-                    stmt_list.emplace_back(stmt.get());
-                }
-                for (uint32_t i = 0; i < port->width; i++) {
-                    if (bits.find(i) == bits.end()) {
-                        throw StmtException(
-                            ::format("{0}[{1}] is a floating net. Please check your connections",
-                                     port_name, i),
-                            stmt_list);
-                    }
-                }
+    if (has_error) {
+        std::vector<Stmt*> stmt_list;
+        for (auto const& stmt : port->sources()) {
+            stmt_list.emplace_back(stmt.get());
+        }
+        for (uint32_t i = 0; i < port->width; i++) {
+            if (bits.find(i) == bits.end()) {
+                throw StmtException(
+                    ::format("{0}[{1}] is a floating net. Please check your connections",
+                             port->name, i),
+                    stmt_list);
             }
         }
+    }
+}
 
-        is_top_level_ = false;
+class GeneratorConnectivityVisitor : public ASTVisitor {
+public:
+    GeneratorConnectivityVisitor(Generator* generator, bool is_top_level)
+        : generator_(generator),
+          is_top_level_(is_top_level),
+          // skip if it's an external module or stub module
+          skip_(generator->external() || generator->is_stub()) {}
+
+    void visit(Port* port) override {
+        if (skip_ || port->generator != generator_) return;
+        // based on whether it's an input or output
+        // for inputs, if it's not top generator, we need to check if
+        // something is driving it
+        if (port->port_direction() == PortDirection::In && is_top_level_) return;
+        check_port_connectivity(port);
     }
 
 private:
+    Generator* generator_;
     bool is_top_level_;
+    bool skip_;
 };
 
 void verify_generator_connectivity(Generator* top) {
-    GeneratorConnectivityVisitor visitor;
-    visitor.visit_generator_root(top);
+    sequential_generator_pass(top, [=](Generator* generator) {
+        GeneratorConnectivityVisitor visitor(generator, generator == top);
+        for (auto const& port_name : generator->get_port_names())
+            visitor.visit(generator->get_port(port_name).get());
+    });
 }
 
 class ModuleInstantiationVisitor : public ASTVisitor {
@@ -239,7 +339,7 @@ public:
     void visit(Generator* generator) override {
         for (auto& child : generator->get_child_generators()) {
             // create instantiation statement
-            auto stmt = std::make_shared<ModuleInstantiationStmt>(child.get(), generator);
+            auto stmt = generator->make_node<ModuleInstantiationStmt>(child.get(), generator);
             if (generator->debug) {
                 // get the debug info from the add_generator, if possible
                 auto debug_info = generator->children_debug();
@@ -271,59 +371,180 @@ public:
 };
 
 std::map<std::string, std::string> generate_verilog(Generator* top) {
+    return generate_verilog(top, false);
+}
+
+std::string generate_module_verilog(Generator* generator) {
+    auto context = generator->context();
+    // debug mode needs the codegen to fill in the line numbers, so the cache is bypassed
+    if (!context || context->codegen_cache_dir().empty() || generator->debug) {
+        SystemVerilogCodeGen codegen(generator);
+        return codegen.str();
+    }
+
+    auto const filename = ::format("{0}/{1:016x}.sv", context->codegen_cache_dir(),
+                                   hash_generator_codegen(generator));
+    std::ifstream cached(filename);
+    if (cached.good()) {
+        return std::string(std::istreambuf_iterator<char>(cached),
+                           std::istreambuf_iterator<char>());
+    }
+
+    SystemVerilogCodeGen codegen(generator);
+    auto src = codegen.str();
+    // the cache is best effort. write to a temporary file first so that other processes
+    // sharing the same cache never see a partial module
+    auto const tmp_filename = ::format("{0}.{1:x}.tmp", filename, std::random_device()());
+    std::ofstream stream(tmp_filename);
+    if (stream.is_open()) {
+        stream << src;
+        stream.close();
+        if (!stream.good() || std::rename(tmp_filename.c_str(), filename.c_str()) != 0)
+            std::remove(tmp_filename.c_str());
+    }
+    return src;
+}
+
+// hands the source of every unique module to the consumer in module name order, so the
+// output is deterministic regardless of use_parallel
+void for_each_module_verilog(
+    Generator* top, bool use_parallel,
+    const std::function<void(const std::string&, const std::string&)>& consumer) {
     // this pass assumes that all the generators has been uniquified
-    std::map<std::string, std::string> result;
-    std::map<std::string, DebugInfo> debug_info;
     // first get all the unique generators
     UniqueGeneratorVisitor unique_visitor;
     unique_visitor.visit_generator_root(top);
-    for (auto& [module_name, module_gen] : unique_visitor.generator_map) {
-        SystemVerilogCodeGen codegen(module_gen);
-        result.emplace(module_name, codegen.str());
+    auto const& generator_map = unique_visitor.generator_map;
+    if (use_parallel && generator_map.size() > 1) {
+        // the codegen only writes to the generator it is working on, so the modules can be
+        // generated independently. if there is an error, the first one in name order is
+        // re-thrown
+        uint32_t num_cpus = std::thread::hardware_concurrency();
+        num_cpus = std::max(1u, num_cpus / 2);
+        num_cpus = std::min(num_cpus, static_cast<uint32_t>(generator_map.size()));
+        cxxpool::thread_pool pool{num_cpus};
+
+        // only a few modules are in flight at any time so that the finished ones don't pile up
+        const uint64_t max_tasks = 2 * num_cpus;
+        std::deque<std::pair<std::string, std::future<std::string>>> thread_tasks;
+        for (auto const& [module_name, module_gen] : generator_map) {
+            if (thread_tasks.size() == max_tasks) {
+                auto& [name, task] = thread_tasks.front();
+                consumer(name, task.get());
+                thread_tasks.pop_front();
+            }
+            thread_tasks.emplace_back(module_name,
+                                      pool.push(generate_module_verilog, module_gen));
+        }
+        for (auto& [name, task] : thread_tasks) {
+            consumer(name, task.get());
+        }
+    } else {
+        for (auto const& [module_name, module_gen] : generator_map) {
+            consumer(module_name, generate_module_verilog(module_gen));
+        }
     }
+}
+
+std::map<std::string, std::string> generate_verilog(Generator* top, bool use_parallel) {
+    std::map<std::string, std::string> result;
+    for_each_module_verilog(top, use_parallel,
+                            [&](const std::string& module_name, const std::string& src) {
+                                result.emplace(module_name, src);
+                            });
     return result;
 }
 
+VerilogManifest generate_verilog(Generator* top, const std::string& path, bool split_files,
+                                 bool use_parallel) {
+    VerilogManifest manifest;
+    std::ofstream stream;
+    std::string filename;
+    uint64_t line_offset = 0;
+
+    auto open_file = [&](const std::string& name) {
+        filename = name;
+        stream.close();
+        stream.open(filename, std::ios::out | std::ios::trunc);
+        if (!stream.is_open()) throw ::runtime_error(::format("Unable to open {0}", filename));
+        line_offset = 0;
+    };
+    if (!split_files) open_file(path);
+
+    for_each_module_verilog(
+        top, use_parallel, [&](const std::string& module_name, const std::string& src) {
+            if (split_files) open_file(::format("{0}/{1}.sv", path, module_name));
+            stream << src;
+            if (!stream.good())
+                throw ::runtime_error(::format("Unable to write {0} to {1}", module_name, filename));
+            auto num_lines = static_cast<uint64_t>(std::count(src.begin(), src.end(), '\n'));
+            manifest.emplace(module_name, VerilogFileEntry{filename, line_offset, num_lines});
+            line_offset += num_lines;
+        });
+    stream.close();
+    return manifest;
+}
+
 void hash_generators(Generator* top, HashStrategy strategy) {
     // this is a helper function
     hash_generators_context(top->context(), top, strategy);
 }
 
-void uniquify_generators(Generator* top) {
+void uniquify_generators(Generator* top) { uniquify_generators(top, false); }
+
+void uniquify_generators(Generator* top, bool verify) {
     // we assume users has run the hash_generators function
     Context* context = top->context();
     auto const& names = context->get_generator_names();
     for (auto const& name : names) {
-        const auto module_instances = context->get_generators_by_name(name);
-        // notice that since it is a set copied by value, it is fine to iterate through it
-        if (module_instances.size() == 1)
+        const auto instance_set = context->get_generators_by_name(name);
+        if (instance_set.size() == 1)
             // only one module. we are good
             continue;
-        // there is almost little change that the hash value will be 0
-        // but still, there is a tiny chance...
-        uint64_t hash = 0;
-        for (auto& instance : module_instances) {
-            auto ptr = instance.get();
-            if (context->has_hash(ptr)) {
-                if (hash == 0) {
-                    hash = context->get_hash(ptr);
-                } else if (context->get_hash(ptr) != hash) {
-                    // we need to uniquify it
-                    // this is a naive way
-                    uint32_t count = 0;
-                    while (true) {
-                        const std::string new_name = ::format("{0}_unq{1}", name, count++);
-                        if (!context->generator_name_exists(new_name)) {
-                            context->change_generator_name(ptr, new_name);
-                            break;
-                        }
-                    }
-                }
-            } else {
+        // the set is ordered by address. sort it by creation order so that the names don't
+        // depend on the allocator
+        std::vector<Generator*> module_instances;
+        module_instances.reserve(instance_set.size());
+        for (auto const& instance : instance_set) module_instances.emplace_back(instance.get());
+        std::sort(module_instances.begin(), module_instances.end(),
+                  [](Generator* a, Generator* b) {
+                      return a->creation_order() < b->creation_order();
+                  });
+        // group the generators by hash. every group holds structurally identical generators
+        // and the group of the first generator keeps the original name
+        std::vector<std::vector<Generator*>> groups;
+        std::unordered_map<uint64_t, std::vector<uint64_t>> hash_groups;
+        for (auto ptr : module_instances) {
+            if (!context->has_hash(ptr))
                 throw ::runtime_error(
                     ::format("{0} ({1}) doesn't have hash", ptr->instance_name, ptr->name));
+            auto& candidates = hash_groups[context->get_hash(ptr)];
+            bool found = false;
+            for (auto const index : candidates) {
+                // only compare against one representative of the group
+                if (!verify || generator_structural_equal(groups[index].front(), ptr)) {
+                    groups[index].emplace_back(ptr);
+                    found = true;
+                    break;
+                }
+            }
+            if (!found) {
+                // either a new hash or a hash collision
+                candidates.emplace_back(groups.size());
+                groups.emplace_back(std::vector<Generator*>{ptr});
             }
         }
+
+        // the suffix counter only goes up, so each group finds a free name in amortized
+        // constant time
+        uint32_t count = 0;
+        for (uint64_t i = 1; i < groups.size(); i++) {
+            std::string new_name;
+            do {
+                new_name = ::format("{0}_unq{1}", name, count++);
+            } while (context->generator_name_exists(new_name));
+            for (auto const& ptr : groups[i]) context->change_generator_name(ptr, new_name);
+        }
     }
 }
 
@@ -342,14 +563,14 @@ public:
             }
             if (names.find(instance_name) == names.end()) {
                 // we are good
-                child->instance_name = instance_name;
+                child->set_instance_name(instance_name);
             } else {
                 uint32_t count = 0;
                 while (true) {
                     std::string new_name = ::format("{0}{1}", instance_name, count++);
                     if (names.find(new_name) == names.end()) {
                         // we are good
-                        child->instance_name = new_name;
+                        child->set_instance_name(new_name);
                         break;
                     }
                 }
@@ -455,81 +676,102 @@ void decouple_generator_ports(Generator* top) {
     visitor.visit_generator_root(top);
 }
 
-class StubGeneratorVisitor : public ASTVisitor {
-public:
-    void visit(Generator* generator) override {
-        if (!generator->is_stub()) return;
-        // to be a stub, there shouldn't be any extra variables
-        if (generator->stmts_count() > 0) {
-            throw ::runtime_error(::format("{0} is marked as a stub but contains statements"));
-        }
+void zero_out_stub_generator(Generator* generator) {
+    if (!generator->is_stub()) return;
+    // to be a stub, there shouldn't be any extra variables
+    if (generator->stmts_count() > 0) {
+        throw ::runtime_error(
+            ::format("{0} is marked as a stub but contains statements", generator->name));
+    }
+
+    // has to be the exact same number of ports and vars, otherwise it means there are
+    // some variables being declared
+    auto vars = generator->get_vars();
+    auto ports = generator->get_port_names();
+    if (!vars.empty()) {
+        throw ::runtime_error(
+            fmt::format("{0} is declared as stub but has declared variables", generator->name));
+    }
 
-        // has to be the exact same number of ports and vars, otherwise it means there are
-        // some variables being declared
-        auto vars = generator->get_vars();
-        auto ports = generator->get_port_names();
-        if (!vars.empty()) {
-            throw ::runtime_error(
-                fmt::format("{0} is declared as stub but has declared variables", generator->name));
+    for (auto const& port_name : ports) {
+        auto port = generator->get_port(port_name);
+        if (port->port_direction() == PortDirection::In) {
+            if (!port->sinks().empty())
+                throw ::runtime_error(
+                    fmt::format("{0}.{1} is driving a net, but {0} is declared as a stub",
+                                generator->name, port_name));
+        } else {
+            if (!port->sources().empty())
+                throw ::runtime_error(
+                    fmt::format("{0}.{1} is driven by a net, but {0} is declared as a stub",
+                                generator->name, port_name));
+            generator->add_stmt(
+                port->assign(generator->constant(0, port->width)).shared_from_this());
         }
+    }
+}
 
-        for (auto const& port_name : ports) {
-            auto port = generator->get_port(port_name);
-            if (port->port_direction() == PortDirection::In) {
-                if (!port->sinks().empty())
-                    throw ::runtime_error(
-                        fmt::format("{0}.{1} is driving a net, but {0} is declared as a stub",
-                                    generator->name, port_name));
-            } else {
-                if (!port->sources().empty())
-                    throw ::runtime_error(
-                        fmt::format("{0}.{1} is driven by a net, but {0} is declared as a stub",
-                                    generator->name, port_name));
-                generator->add_stmt(
-                    port->assign(generator->constant(0, port->width)).shared_from_this());
-            }
+void zero_out_stubs(Generator* top) { sequential_generator_pass(top, &zero_out_stub_generator); }
+
+void checkout_assignment(Generator* generator, Var* var) {
+    AssignmentType type = Undefined;
+    for (auto const& stmt : var->sources()) {
+        if (type == Undefined)
+            type = stmt->assign_type();
+        else if (type != stmt->assign_type()) {
+            std::vector<Stmt*> stmt_list;
+            stmt_list.reserve(var->sources().size());
+            for (const auto& st : var->sources()) stmt_list.emplace_back(st.get());
+            throw StmtException(::format("Mixed assignment detected for variable {0}.{1}",
+                                         generator->name, var->name),
+                                stmt_list);
         }
     }
-};
+}
 
-void zero_out_stubs(Generator* top) {
-    StubGeneratorVisitor visitor;
-    visitor.visit_generator_root(top);
+void check_mixed_assignment_generator(Generator* generator) {
+    for (auto const& [name, var] : generator->vars()) {
+        if (var->type() == VarType::Base || var->type() == VarType::PortIO)
+            checkout_assignment(generator, var.get());
+    }
+}
+
+void check_mixed_assignment(Generator* top) {
+    sequential_generator_pass(top, &check_mixed_assignment_generator);
 }
 
 class MixedAssignmentVisitor : public ASTVisitor {
 public:
-    void visit(Generator* generator) override {
-        auto const vars = generator->get_vars();
-        auto const ports = generator->get_port_names();
-        for (const auto& var_name : vars) {
-            checkout_assignment(generator, var_name);
-        }
-        for (const auto& port_name : ports) {
-            checkout_assignment(generator, port_name);
-        }
+    explicit MixedAssignmentVisitor(Generator* generator) : generator_(generator) {}
+
+    void visit(Var* var) override {
+        if (var->generator == generator_ && var->type() == VarType::Base)
+            checkout_assignment(generator_, var);
     }
-    void checkout_assignment(Generator* generator, const std::string& name) const {
-        auto const& var = generator->get_var(name);
-        AssignmentType type = Undefined;
-        for (auto const& stmt : var->sources()) {
-            if (type == Undefined)
-                type = stmt->assign_type();
-            else if (type != stmt->assign_type()) {
-                std::vector<Stmt*> stmt_list;
-                stmt_list.reserve(var->sources().size());
-                for (const auto& st : var->sources()) stmt_list.emplace_back(st.get());
-                throw StmtException(::format("Mixed assignment detected for variable {0}.{1}",
-                                             generator->name, name),
-                                    stmt_list);
-            }
-        }
+    void visit(Port* port) override {
+        if (port->generator == generator_) checkout_assignment(generator_, port);
     }
+
+private:
+    Generator* generator_;
 };
 
-void check_mixed_assignment(Generator* top) {
-    MixedAssignmentVisitor visitor;
-    visitor.visit_generator_root(top);
+// every var of the generator is visited once, either through the statements or through the
+// var sweep of visit_content, and all the checks run on it while it's in cache
+void verify_generator(Generator* generator, bool is_top_level) {
+    VerifyAssignmentVisitor assignment_visitor(generator);
+    GeneratorConnectivityVisitor connectivity_visitor(generator, is_top_level);
+    MixedAssignmentVisitor mixed_visitor(generator);
+    CompositeVisitor visitor;
+    visitor.add_visitor(&assignment_visitor);
+    visitor.add_visitor(&connectivity_visitor);
+    visitor.add_visitor(&mixed_visitor);
+    visitor.visit_content(generator);
+}
+
+void verify_generators(Generator* top) {
+    sequential_generator_pass(
+        top, [=](Generator* generator) { verify_generator(generator, generator == top); });
 }
 
 class TransformIfCase : public ASTVisitor {
@@ -589,7 +831,7 @@ private:
         auto expr = stmt->predicate()->as<Expr>();
         // we assume that this is a valid case (see has_target_if)
         auto target = expr->left;
-        std::shared_ptr<SwitchStmt> switch_ = std::make_shared<SwitchStmt>(target);
+        std::shared_ptr<SwitchStmt> switch_ = target->generator->make_node<SwitchStmt>(target);
         if (target->generator->debug) {
             switch_->fn_name_ln.emplace_back(std::make_pair(__FILE__, __LINE__));
         }
@@ -625,6 +867,7 @@ class VarFanOutVisitor : public ASTVisitor {
 public:
     void visit(Generator* generator) override {
         auto var_names = generator->get_all_var_names();
+        std::vector<std::shared_ptr<Stmt>> stmts_to_remove;
         for (auto const& var_name : var_names) {
             auto var = generator->get_var(var_name);
             std::vector<std::pair<std::shared_ptr<Var>, std::shared_ptr<AssignStmt>>> chain;
@@ -643,7 +886,10 @@ public:
                                       stmt->fn_name_ln.end());
                 }
 
-                next->unassign(stmt);
+                // same as unassign, but the statements are removed in bulk
+                next->remove_source(stmt);
+                pre->remove_sink(stmt);
+                stmts_to_remove.emplace_back(stmt);
             }
 
             auto dst = chain.back().first;
@@ -661,6 +907,7 @@ public:
                 generator->add_stmt(stmt);
             }
         }
+        generator->remove_stmts(stmts_to_remove);
     }
 
     void static compute_assign_chain(
@@ -743,10 +990,9 @@ private:
         for (const auto& port_name : port_names) {
             auto const port = generator->get_port(port_name);
             if (port->port_direction() == PortDirection::In) {
-                auto sinks = port->sinks();
-                if (sinks.size() != 1) return false;
+                if (port->sinks().size() != 1) return false;
             } else {
-                auto sources = port->sources();
+                auto const& sources = port->sources();
                 if (sources.size() != 1) return false;
                 // maybe some add stuff
                 auto stmt = *(sources.begin());
@@ -883,10 +1129,10 @@ std::map<std::string, std::string> extract_struct_info(Generator* top) {
 class MergeWireAssignmentsVisitor : public ASTVisitor {
 public:
     void visit(Generator* generator) override {
-        std::set<std::shared_ptr<Stmt>> stmts_to_remove;
+        std::vector<std::shared_ptr<Stmt>> stmts_to_remove;
 
-        // first filter out sliced assignments
-        std::set<std::shared_ptr<AssignStmt>> sliced_stmts;
+        // first filter out sliced assignments, in program order
+        std::vector<std::shared_ptr<AssignStmt>> sliced_stmts;
         uint64_t stmt_count = generator->stmts_count();
         for (uint32_t i = 0; i < stmt_count; i++) {
             auto stmt = generator->get_stmt(i);
@@ -894,7 +1140,7 @@ public:
                 auto assign_stmt = stmt->as<AssignStmt>();
                 if (assign_stmt->left()->type() == VarType::Slice &&
                     assign_stmt->right()->type() == VarType::Slice) {
-                    sliced_stmts.emplace(assign_stmt);
+                    sliced_stmts.emplace_back(assign_stmt);
                 }
             }
         }
@@ -928,7 +1174,7 @@ public:
             for (auto const& stmt : stmts) {
                 left->remove_source(stmt);
                 right->remove_sink(stmt);
-                stmts_to_remove.emplace(stmt);
+                stmts_to_remove.emplace_back(stmt);
             }
             // make new assignment
             auto new_stmt = left->assign(right->shared_from_this(), AssignmentType::Blocking)
@@ -944,9 +1190,7 @@ public:
             }
         }
 
-        for (auto const& stmt : stmts_to_remove) {
-            generator->remove_stmt(stmt);
-        }
+        generator->remove_stmts(stmts_to_remove);
     }
 };
 
@@ -956,24 +1200,1517 @@ void merge_wire_assignments(Generator* top) {
     visitor.visit_generator_root(top);
 }
 
-void PassManager::add_pass(const std::string& name, std::function<void(Generator*)> fn) {
-    if (has_pass(name))
-        throw ::runtime_error(::format("{0} already exists in the pass manager", name));
-    passes_.emplace(name, fn);
-    passes_order_.emplace_back(name);
+uint64_t static fold_mask(uint32_t width) { return width >= 64 ? ~0ull : (1ull << width) - 1; }
+
+// mirrors the add_sink overrides, which register the statement on the leaves of the expression
+void static remove_sink_from(Var* var, const std::shared_ptr<AssignStmt>& stmt) {
+    if (var->type() == VarType::Expression) {
+        auto expr = dynamic_cast<Expr*>(var);
+        if (expr) {
+            remove_sink_from(expr->left.get(), stmt);
+            if (expr->right) remove_sink_from(expr->right.get(), stmt);
+            return;
+        }
+    } else if (var->type() == VarType::Slice) {
+        remove_sink_from(reinterpret_cast<VarSlice*>(var)->parent_var, stmt);
+        return;
+    } else if (var->type() == VarType::BaseCasted) {
+        remove_sink_from(reinterpret_cast<VarCasted*>(var)->parent_var(), stmt);
+        return;
+    }
+    var->remove_sink(stmt);
 }
 
-void PassManager::add_pass(const std::string& name, void(fn)(Generator*)) {
-    if (has_pass(name))
-        throw ::runtime_error(::format("{0} already exists in the pass manager", name));
-    auto func = [=](Generator* generator) { (*fn)(generator); };
-    passes_.emplace(name, func);
-    passes_order_.emplace_back(name);
+void static replace_right(const std::shared_ptr<AssignStmt>& stmt,
+                          const std::shared_ptr<Var>& right) {
+    remove_sink_from(stmt->right().get(), stmt);
+    stmt->set_right(right);
+    right->add_sink(stmt);
 }
 
-void PassManager::run_passes(Generator* generator) {
-    for (const auto& fn_name : passes_order_) {
-        auto fn = passes_.at(fn_name);
-        fn(generator);
+void static remove_source_from(Var* var, const std::shared_ptr<AssignStmt>& stmt) {
+    while (var->type() == VarType::Slice) var = reinterpret_cast<VarSlice*>(var)->parent_var;
+    var->remove_source(stmt);
+}
+
+// disconnects the assignments of a statement that is about to be dropped
+void static unlink_stmt(const std::shared_ptr<Stmt>& stmt) {
+    if (stmt->type() == StatementType::Assign) {
+        auto assign = stmt->as<AssignStmt>();
+        remove_sink_from(assign->right().get(), assign);
+        remove_source_from(assign->left().get(), assign);
+        return;
+    }
+    for (uint64_t i = 0; i < stmt->child_count(); i++) {
+        auto child = stmt->get_child(i);
+        if (child->ast_node_kind() == ASTNodeKind::StmtKind)
+            unlink_stmt(reinterpret_cast<Stmt*>(child)->shared_from_this());
+    }
+}
+
+// unregisters a generator that is dropped from the hierarchy, along with its children, so that
+// the passes that go through the context, e.g. uniquify_generators, don't see it anymore
+void static remove_from_context(Generator* generator) {
+    auto context = generator->context();
+    if (context) context->remove(generator);
+    for (auto const& child : generator->get_child_generators()) remove_from_context(child.get());
+}
+
+// folds the expressions of a single generator. a var is replaced by a constant only if it is
+// driven by a single top level assignment of a constant with the same width and sign, so ports
+// and parameters are never propagated. every replacement keeps the width and sign of the node
+// it replaces, so the rebuilt expressions type check the same way. the arithmetic is the same
+// as the simulator, i.e. 64 bits at most; division by zero is left alone
+class ConstantFolder {
+public:
+    explicit ConstantFolder(Generator* generator) : generator_(generator) {}
+
+    void run() {
+        std::vector<std::shared_ptr<Stmt>> empty_blocks;
+        for (uint64_t i = 0; i < generator_->stmts_count(); i++) {
+            auto stmt = generator_->get_stmt(i);
+            if (stmt->type() == StatementType::Assign) {
+                fold_assign(stmt->as<AssignStmt>());
+            } else if (stmt->type() == StatementType::Block) {
+                auto block = stmt->as<StmtBlock>();
+                std::vector<std::shared_ptr<Stmt>> stmts;
+                stmts.reserve(block->child_count());
+                for (uint64_t j = 0; j < block->child_count(); j++)
+                    stmts.emplace_back(
+                        reinterpret_cast<Stmt*>(block->get_child(j))->shared_from_this());
+                if (fold_stmts(stmts)) block->set_statements(stmts);
+                if (stmts.empty()) empty_blocks.emplace_back(block);
+            }
+        }
+        generator_->remove_stmts(empty_blocks);
+        if (changed_) generator_->mark_dirty();
+    }
+
+private:
+    Generator* generator_;
+    // folded version of every var visited so far
+    std::unordered_map<Var*, std::shared_ptr<Var>> folded_;
+    bool changed_ = false;
+
+    bool static constant_value(const std::shared_ptr<Var>& var, uint64_t& value) {
+        if (var->type() != VarType::ConstValue || var->width > 64) return false;
+        value = var->as<Const>()->bits().word(0) & fold_mask(var->width);
+        return true;
+    }
+
+    std::shared_ptr<Var> static make_constant(Var* var, uint64_t value) {
+        value &= fold_mask(var->width);
+        auto& result = var->generator->constant(
+            BitVector(static_cast<int64_t>(value), var->width), var->is_signed);
+        return result.shared_from_this();
+    }
+
+    std::shared_ptr<Var> fold(const std::shared_ptr<Var>& var) {
+        auto iter = folded_.find(var.get());
+        if (iter != folded_.end()) return iter->second;
+        // guards against combinational loops
+        folded_.emplace(var.get(), var);
+        auto result = fold_var(var);
+        folded_[var.get()] = result;
+        return result;
+    }
+
+    std::shared_ptr<Var> fold_var(const std::shared_ptr<Var>& var) {
+        switch (var->type()) {
+            case VarType::Base:
+            case VarType::Expression: {
+                // concatenations of more than two vars are not typed as expressions
+                auto concat = std::dynamic_pointer_cast<VarConcat>(var);
+                if (concat) return fold_concat(concat);
+                if (var->type() == VarType::Expression)
+                    return fold_expr(var->as<Expr>());
+                return fold_base(var);
+            }
+            case VarType::Slice: {
+                auto slice = var->as<VarSlice>();
+                auto parent = fold(slice->parent_var->shared_from_this());
+                uint64_t value;
+                if (constant_value(parent, value)) return make_constant(var.get(), value >> slice->low);
+                if (parent.get() != slice->parent_var)
+                    return (*parent)[{slice->high, slice->low}].shared_from_this();
+                return var;
+            }
+            case VarType::BaseCasted: {
+                auto casted = var->as<VarCasted>();
+                if (casted->cast_type() != VarCastType::Signed) return var;
+                auto parent = fold(casted->parent_var()->shared_from_this());
+                uint64_t value;
+                if (constant_value(parent, value)) return make_constant(var.get(), value);
+                if (parent.get() != casted->parent_var()) return parent->cast(VarCastType::Signed);
+                return var;
+            }
+            default:
+                return var;
+        }
+    }
+
+    std::shared_ptr<Var> fold_base(const std::shared_ptr<Var>& var) {
+        if (var->sources().size() != 1) return var;
+        auto const& stmt = *var->sources().begin();
+        if (stmt->left() != var || stmt->parent() != generator_) return var;
+        auto right = fold(stmt->right());
+        if (right->type() == VarType::ConstValue && right->width == var->width &&
+            right->is_signed == var->is_signed)
+            return right;
+        return var;
+    }
+
+    std::shared_ptr<Var> fold_concat(const std::shared_ptr<VarConcat>& concat) {
+        std::vector<std::shared_ptr<Var>> vars;
+        vars.reserve(concat->vars.size());
+        bool changed = false;
+        bool all_constant = concat->width <= 64;
+        uint64_t result = 0;
+        for (auto const& var : concat->vars) {
+            vars.emplace_back(fold(var));
+            changed |= vars.back() != var;
+            uint64_t value;
+            if (all_constant && constant_value(vars.back(), value))
+                result = var->width >= 64 ? value : (result << var->width) | value;
+            else
+                all_constant = false;
+        }
+        if (all_constant) return make_constant(concat.get(), result);
+        if (!changed) return concat;
+        auto* new_concat = &vars[0]->concat(*vars[1]);
+        for (uint64_t i = 2; i < vars.size(); i++) new_concat = &new_concat->concat(*vars[i]);
+        return new_concat->shared_from_this();
+    }
+
+    std::shared_ptr<Var> fold_expr(const std::shared_ptr<Expr>& expr) {
+        auto left = fold(expr->left);
+        auto right = expr->right ? fold(expr->right) : nullptr;
+        uint64_t a = 0, b = 0;
+        bool const left_constant = constant_value(left, a);
+        bool const right_constant = right && constant_value(right, b);
+        if (!right && left_constant) {
+            return make_constant(expr.get(), eval_unary(expr->op, a, left->width));
+        } else if (left_constant && right_constant) {
+            auto const divide = expr->op == ExprOp::Divide || expr->op == ExprOp::Mod;
+            if (!divide || b)
+                return make_constant(expr.get(), eval_binary(expr->op, a, b, left->width,
+                                                             left->is_signed, right->is_signed,
+                                                             expr->width));
+        } else if (left_constant || right_constant) {
+            auto result = fold_identity(expr.get(), left, right, left_constant ? a : b,
+                                        left_constant);
+            if (result) return result;
+        }
+        if (left == expr->left && right == expr->right) return expr;
+        return expr->generator->expr(expr->op, left, right).shared_from_this();
+    }
+
+    // x & 0, x | 1s, x + 0, x << 0, etc. returns nullptr if nothing applies
+    std::shared_ptr<Var> static fold_identity(Expr* expr, const std::shared_ptr<Var>& left,
+                                              const std::shared_ptr<Var>& right, uint64_t value,
+                                              bool left_constant) {
+        auto const& other = left_constant ? right : left;
+        // the other operand can only stand in for the expression if it has the same sign
+        bool const same_sign = other->is_signed == expr->is_signed;
+        bool const zero = value == 0;
+        bool const ones = value == fold_mask(expr->width);
+        switch (expr->op) {
+            case ExprOp::And:
+                if (zero) return make_constant(expr, 0);
+                if (ones && same_sign) return other;
+                break;
+            case ExprOp::Or:
+                if (ones) return make_constant(expr, value);
+                if (zero && same_sign) return other;
+                break;
+            case ExprOp::Xor:
+            case ExprOp::Add:
+                if (zero && same_sign) return other;
+                break;
+            case ExprOp::Multiply:
+                if (zero) return make_constant(expr, 0);
+                if (value == 1 && same_sign) return other;
+                break;
+            case ExprOp::Minus:
+            case ExprOp::LogicalShiftRight:
+            case ExprOp::SignedShiftRight:
+            case ExprOp::ShiftLeft:
+                if (!left_constant && zero && same_sign) return left;
+                if (left_constant && zero && expr->op != ExprOp::Minus)
+                    return make_constant(expr, 0);
+                break;
+            case ExprOp::Divide:
+                if (!left_constant && value == 1 && same_sign) return left;
+                break;
+            default:
+                break;
+        }
+        return nullptr;
+    }
+
+    void fold_assign(const std::shared_ptr<AssignStmt>& stmt) {
+        auto right = fold(stmt->right());
+        if (right == stmt->right()) return;
+        replace_right(stmt, right);
+        changed_ = true;
+    }
+
+    // folds the statements in place. branches with a constant predicate or target are spliced
+    // into stmts. returns true if stmts changed
+    bool fold_stmts(std::vector<std::shared_ptr<Stmt>>& stmts) {
+        std::vector<std::shared_ptr<Stmt>> result;
+        result.reserve(stmts.size());
+        bool changed = false;
+        for (auto const& stmt : stmts) {
+            switch (stmt->type()) {
+                case StatementType::Assign:
+                    fold_assign(stmt->as<AssignStmt>());
+                    break;
+                case StatementType::If: {
+                    auto if_ = stmt->as<IfStmt>();
+                    auto predicate = fold(if_->predicate());
+                    uint64_t value;
+                    if (constant_value(predicate, value)) {
+                        auto taken = value ? if_->then_body() : if_->else_body();
+                        for (auto const& s : value ? if_->else_body() : if_->then_body())
+                            unlink_stmt(s);
+                        fold_stmts(taken);
+                        result.insert(result.end(), taken.begin(), taken.end());
+                        changed = true;
+                        continue;
+                    }
+                    if (predicate != if_->predicate()) {
+                        if_->set_predicate(predicate);
+                        changed_ = true;
+                    }
+                    auto then_body = if_->then_body();
+                    if (fold_stmts(then_body)) if_->set_then_body(then_body);
+                    auto else_body = if_->else_body();
+                    if (fold_stmts(else_body)) if_->set_else_body(else_body);
+                    if (then_body.empty() && else_body.empty()) {
+                        changed = true;
+                        continue;
+                    }
+                    break;
+                }
+                case StatementType::Switch: {
+                    auto switch_ = stmt->as<SwitchStmt>();
+                    auto taken = switch_case(switch_);
+                    if (taken) {
+                        auto body = *taken;
+                        for (auto const& [condition, case_body] : switch_->body()) {
+                            if (&case_body == taken) continue;
+                            for (auto const& s : case_body) unlink_stmt(s);
+                        }
+                        fold_stmts(body);
+                        result.insert(result.end(), body.begin(), body.end());
+                        changed = true;
+                        continue;
+                    }
+                    bool empty = true;
+                    // copy the cases since set_switch_case changes the body
+                    auto cases = switch_->body();
+                    for (auto& [condition, body] : cases) {
+                        if (fold_stmts(body)) switch_->set_switch_case(condition, body);
+                        empty &= body.empty();
+                    }
+                    if (empty) {
+                        changed = true;
+                        continue;
+                    }
+                    break;
+                }
+                default:
+                    break;
+            }
+            result.emplace_back(stmt);
+        }
+        if (changed) {
+            stmts = std::move(result);
+            changed_ = true;
+        }
+        return changed;
+    }
+
+    // the body that will be executed if the target folds into a constant, otherwise nullptr
+    const std::vector<std::shared_ptr<Stmt>>* switch_case(
+        const std::shared_ptr<SwitchStmt>& switch_) {
+        uint64_t value;
+        if (!constant_value(fold(switch_->target()), value)) return nullptr;
+        const std::vector<std::shared_ptr<Stmt>>* result = nullptr;
+        for (auto const& [condition, body] : switch_->body()) {
+            uint64_t case_value;
+            if (!condition) {
+                if (!result) result = &body;
+            } else if (!constant_value(condition, case_value)) {
+                // parameters can be overridden
+                return nullptr;
+            } else if (case_value == value) {
+                result = &body;
+            }
+        }
+        // no case matches and there is no default
+        static const std::vector<std::shared_ptr<Stmt>> empty;
+        return result ? result : &empty;
     }
+};
+
+void fold_constants_generator(Generator* generator) {
+    ConstantFolder folder(generator);
+    folder.run();
+}
+
+void fold_constants(Generator* top) { sequential_generator_pass(top, &fold_constants_generator); }
+
+// operands of a var that are part of the same expression tree
+template <typename Fn>
+void static for_each_operand(Var* var, Fn fn) {
+    switch (var->type()) {
+        case VarType::Base:
+        case VarType::Expression: {
+            auto expr = dynamic_cast<Expr*>(var);
+            if (expr) {
+                fn(expr->left.get());
+                if (expr->right) fn(expr->right.get());
+                return;
+            }
+            // concatenations of more than two vars are not typed as expressions
+            auto concat = dynamic_cast<VarConcat*>(var);
+            if (concat) {
+                for (auto const& operand : concat->vars) fn(operand.get());
+            }
+            return;
+        }
+        case VarType::Slice:
+            fn(reinterpret_cast<VarSlice*>(var)->parent_var);
+            return;
+        case VarType::BaseCasted:
+            fn(reinterpret_cast<VarCasted*>(var)->parent_var());
+            return;
+        default:
+            return;
+    }
+}
+
+// rebuilds var with its operands replaced by rewrite(operand). var itself is returned if none of
+// them changed. the new nodes belong to the generator of their first operand, the same as when
+// they are built by hand
+template <typename Fn>
+std::shared_ptr<Var> static rebuild_operands(Var* var, Fn rewrite) {
+    switch (var->type()) {
+        case VarType::Base:
+        case VarType::Expression: {
+            auto expr = dynamic_cast<Expr*>(var);
+            if (expr) {
+                auto left = rewrite(expr->left);
+                auto right = expr->right ? rewrite(expr->right) : nullptr;
+                if (left == expr->left && right == expr->right) break;
+                return left->generator->expr(expr->op, left, right).shared_from_this();
+            }
+            auto concat = dynamic_cast<VarConcat*>(var);
+            if (!concat) break;
+            std::vector<std::shared_ptr<Var>> vars;
+            vars.reserve(concat->vars.size());
+            for (auto const& operand : concat->vars) vars.emplace_back(rewrite(operand));
+            if (vars == concat->vars) break;
+            auto* new_concat = &vars[0]->concat(*vars[1]);
+            for (uint64_t i = 2; i < vars.size(); i++) new_concat = &new_concat->concat(*vars[i]);
+            return new_concat->shared_from_this();
+        }
+        case VarType::Slice: {
+            auto slice = reinterpret_cast<VarSlice*>(var);
+            auto parent = rewrite(slice->parent_var->shared_from_this());
+            if (parent.get() == slice->parent_var) break;
+            return (*parent)[{slice->high, slice->low}].shared_from_this();
+        }
+        case VarType::BaseCasted: {
+            auto casted = reinterpret_cast<VarCasted*>(var);
+            auto parent = rewrite(casted->parent_var()->shared_from_this());
+            if (parent.get() == casted->parent_var()) break;
+            return parent->cast(casted->cast_type());
+        }
+        default:
+            break;
+    }
+    return var->shared_from_this();
+}
+
+// hoists repeated expressions into wires. expressions are shared by Generator::expr, so a
+// repeated subtree is an Expr node with more than one reference. an expression that reads a
+// var with a blocking assignment inside a block is left alone when it's used in a block,
+// since the value may change between the uses
+class CommonSubexpressionEliminator {
+public:
+    CommonSubexpressionEliminator(Generator* generator, uint32_t min_size)
+        : generator_(generator), min_size_(min_size) {}
+
+    void run() {
+        std::vector<std::shared_ptr<StmtBlock>> blocks;
+        for (uint64_t i = 0; i < generator_->stmts_count(); i++) {
+            auto stmt = generator_->get_stmt(i);
+            if (stmt->type() == StatementType::Block) {
+                auto block = stmt->as<StmtBlock>();
+                blocks.emplace_back(block);
+                auto const combinational =
+                    block->block_type() == StatementBlockType::Combinational;
+                for (uint64_t j = 0; j < block->child_count(); j++)
+                    collect_blocking_vars(reinterpret_cast<Stmt*>(block->get_child(j)),
+                                          combinational);
+            }
+        }
+
+        for (uint64_t i = 0; i < generator_->stmts_count(); i++) {
+            auto stmt = generator_->get_stmt(i);
+            if (stmt->type() == StatementType::Assign)
+                count(stmt->as<AssignStmt>()->right().get(), false);
+        }
+        for (auto const& block : blocks) {
+            for (uint64_t j = 0; j < block->child_count(); j++)
+                count(reinterpret_cast<Stmt*>(block->get_child(j)));
+        }
+
+        std::vector<Expr*> hoisted;
+        for (auto expr : exprs_) {
+            if (references_.at(expr) < 2 || unsafe_.find(expr) != unsafe_.end()) continue;
+            if (size(expr) < min_size_) continue;
+            auto& wire = generator_->var(generator_->get_unique_variable_name("", "cse"),
+                                         expr->width, expr->is_signed);
+            wires_.emplace(expr, wire.shared_from_this());
+            hoisted.emplace_back(expr);
+        }
+        if (hoisted.empty()) return;
+
+        for (uint64_t i = 0; i < generator_->stmts_count(); i++) {
+            auto stmt = generator_->get_stmt(i);
+            if (stmt->type() == StatementType::Assign) {
+                rewrite(stmt);
+            } else if (stmt->type() == StatementType::Block) {
+                for (uint64_t j = 0; j < stmt->child_count(); j++)
+                    rewrite(reinterpret_cast<Stmt*>(stmt->get_child(j))->shared_from_this());
+            }
+        }
+        for (auto expr : hoisted) {
+            auto& stmt = wires_.at(expr)->assign(rewrite_operands(expr), AssignmentType::Blocking);
+            if (generator_->debug) stmt.fn_name_ln.emplace_back(__FILE__, __LINE__);
+            generator_->add_stmt(stmt.shared_from_this());
+        }
+    }
+
+private:
+    Generator* generator_;
+    uint32_t min_size_;
+
+    std::unordered_set<Var*> blocking_vars_;
+    std::unordered_map<Var*, bool> reads_blocking_;
+    // expressions in the order they are first seen, so that the wire names are deterministic
+    std::vector<Expr*> exprs_;
+    std::unordered_map<Var*, uint32_t> references_;
+    std::unordered_set<Var*> unsafe_;
+    std::unordered_map<Var*, uint32_t> sizes_;
+    std::unordered_map<Var*, std::shared_ptr<Var>> wires_;
+    std::unordered_map<Var*, std::shared_ptr<Var>> rewritten_;
+
+    void collect_blocking_vars(Stmt* stmt, bool combinational) {
+        if (stmt->type() == StatementType::Assign) {
+            auto assign = reinterpret_cast<AssignStmt*>(stmt);
+            if (!combinational && assign->assign_type() != AssignmentType::Blocking) return;
+            auto left = assign->left().get();
+            auto concat = dynamic_cast<VarConcat*>(left);
+            if (concat) {
+                for (auto const& var : concat->vars) add_blocking_var(var.get());
+            } else {
+                add_blocking_var(left);
+            }
+        } else {
+            for (uint64_t i = 0; i < stmt->child_count(); i++) {
+                auto child = stmt->get_child(i);
+                if (child->ast_node_kind() == ASTNodeKind::StmtKind)
+                    collect_blocking_vars(reinterpret_cast<Stmt*>(child), combinational);
+            }
+        }
+    }
+
+    void add_blocking_var(Var* var) {
+        while (var->type() == VarType::Slice) var = reinterpret_cast<VarSlice*>(var)->parent_var;
+        blocking_vars_.emplace(var);
+    }
+
+    bool reads_blocking(Var* var) {
+        auto iter = reads_blocking_.find(var);
+        if (iter != reads_blocking_.end()) return iter->second;
+        bool result = blocking_vars_.find(var) != blocking_vars_.end();
+        for_each_operand(var, [&](Var* operand) { result |= reads_blocking(operand); });
+        reads_blocking_.emplace(var, result);
+        return result;
+    }
+
+    void mark_unsafe(Var* var) {
+        if (!unsafe_.emplace(var).second) return;
+        for_each_operand(var, [&](Var* operand) {
+            if (reads_blocking(operand)) mark_unsafe(operand);
+        });
+    }
+
+    void count(Stmt* stmt) {
+        switch (stmt->type()) {
+            case StatementType::Assign:
+                count(reinterpret_cast<AssignStmt*>(stmt)->right().get(), true);
+                break;
+            case StatementType::If:
+                count(reinterpret_cast<IfStmt*>(stmt)->predicate().get(), true);
+                break;
+            case StatementType::Switch:
+                count(reinterpret_cast<SwitchStmt*>(stmt)->target().get(), true);
+                break;
+            default:
+                break;
+        }
+        for (uint64_t i = 0; i < stmt->child_count(); i++) {
+            auto child = stmt->get_child(i);
+            if (child->ast_node_kind() == ASTNodeKind::StmtKind) count(reinterpret_cast<Stmt*>(child));
+        }
+    }
+
+    // every reference from a statement or another expression is counted once; the operands of
+    // an expression are only visited the first time
+    void count(Var* var, bool in_block) {
+        if (in_block && reads_blocking(var)) mark_unsafe(var);
+        auto expr = var->type() == VarType::Expression ? dynamic_cast<Expr*>(var) : nullptr;
+        if (expr && references_[expr]++) return;
+        if (expr) exprs_.emplace_back(expr);
+        for_each_operand(var, [&](Var* operand) { count(operand, in_block); });
+    }
+
+    // number of nodes in the expression tree, up to min_size_
+    uint32_t size(Var* var) {
+        auto iter = sizes_.find(var);
+        if (iter != sizes_.end()) return iter->second;
+        uint32_t result = 1;
+        for_each_operand(var, [&](Var* operand) {
+            result = std::min(result + size(operand), min_size_);
+        });
+        sizes_.emplace(var, result);
+        return result;
+    }
+
+    std::shared_ptr<Var> rewrite(const std::shared_ptr<Var>& var) {
+        auto wire = wires_.find(var.get());
+        if (wire != wires_.end()) return wire->second;
+        auto iter = rewritten_.find(var.get());
+        if (iter != rewritten_.end()) return iter->second;
+        auto result = rewrite_operands(var.get());
+        rewritten_.emplace(var.get(), result);
+        return result;
+    }
+
+    std::shared_ptr<Var> rewrite_operands(Var* var) {
+        return rebuild_operands(var, [&](const std::shared_ptr<Var>& operand) {
+            return rewrite(operand);
+        });
+    }
+
+    void rewrite(const std::shared_ptr<Stmt>& stmt) {
+        switch (stmt->type()) {
+            case StatementType::Assign: {
+                auto assign = stmt->as<AssignStmt>();
+                auto right = rewrite(assign->right());
+                if (right != assign->right()) replace_right(assign, right);
+                break;
+            }
+            case StatementType::If: {
+                auto if_ = stmt->as<IfStmt>();
+                auto predicate = rewrite(if_->predicate());
+                if (predicate != if_->predicate()) if_->set_predicate(predicate);
+                for (auto const& s : if_->then_body()) rewrite(s);
+                for (auto const& s : if_->else_body()) rewrite(s);
+                break;
+            }
+            case StatementType::Switch: {
+                auto switch_ = stmt->as<SwitchStmt>();
+                auto target = rewrite(switch_->target());
+                if (target != switch_->target()) switch_->set_target(target);
+                for (auto const& [condition, body] : switch_->body())
+                    for (auto const& s : body) rewrite(s);
+                break;
+            }
+            default:
+                break;
+        }
+    }
+};
+
+void eliminate_common_subexpressions_generator(Generator* generator, uint32_t min_size) {
+    CommonSubexpressionEliminator eliminator(generator, min_size);
+    eliminator.run();
+}
+
+void eliminate_common_subexpressions_generator(Generator* generator) {
+    eliminate_common_subexpressions_generator(generator, default_cse_min_size);
+}
+
+void eliminate_common_subexpressions(Generator* top, uint32_t min_size) {
+    sequential_generator_pass(top, [=](Generator* generator) {
+        eliminate_common_subexpressions_generator(generator, min_size);
+    });
+}
+
+void eliminate_common_subexpressions(Generator* top) {
+    eliminate_common_subexpressions(top, default_cse_min_size);
+}
+
+// liveness is computed on the whole hierarchy, backward from the outputs of the top generator:
+// an assignment is live if it drives a live var, and a live assignment makes the vars it reads
+// live, as well as the predicates, switch targets and clocks of the statements around it. child
+// ports are vars like any other, so liveness flows through the connections in the parent.
+// external, stub and cloned generators, as well as generators that share their definition with
+// a clone, are black boxes: all their ports are live and they are not changed
+class DeadLogicEliminator {
+public:
+    explicit DeadLogicEliminator(Generator* top) : top_(top) {}
+
+    void run() {
+        GeneratorOrderVisitor visitor;
+        visitor.visit_generator_root(top_);
+        std::unordered_set<std::string> cloned_names;
+        for (auto generator : visitor.generators) {
+            if (generator->is_cloned()) cloned_names.emplace(generator->name);
+        }
+        for (auto generator : visitor.generators) {
+            if (generator->external() || generator->is_stub() || generator->is_cloned() ||
+                cloned_names.find(generator->name) != cloned_names.end()) {
+                black_boxes_.emplace(generator);
+                for (auto const& port_name : generator->get_port_names())
+                    mark_var(generator->get_port(port_name).get());
+            } else {
+                for (uint64_t i = 0; i < generator->stmts_count(); i++)
+                    index(generator->get_stmt(i).get());
+            }
+        }
+        for (auto const& port_name : top_->get_port_names()) {
+            auto port = top_->get_port(port_name);
+            if (port->port_direction() != PortDirection::In) mark_var(port.get());
+        }
+
+        while (!worklist_.empty()) {
+            auto var = worklist_.back();
+            worklist_.pop_back();
+            auto iter = drivers_.find(var);
+            if (iter == drivers_.end()) continue;
+            for (auto stmt : iter->second) mark_stmt(stmt);
+        }
+
+        // children first, so that a child whose ports are all dead can be removed
+        for (auto iter = visitor.generators.rbegin(); iter != visitor.generators.rend(); iter++) {
+            if (black_boxes_.find(*iter) == black_boxes_.end()) remove_dead_logic(*iter);
+        }
+    }
+
+private:
+    Generator* top_;
+    std::unordered_set<Generator*> black_boxes_;
+    // assignments that drive each var, including the slice assignments
+    std::unordered_map<Var*, std::vector<AssignStmt*>> drivers_;
+    std::unordered_set<Var*> live_vars_;
+    std::unordered_set<Var*> visited_;
+    std::unordered_set<Stmt*> live_stmts_;
+    std::vector<Var*> worklist_;
+
+    void index(Stmt* stmt) {
+        if (stmt->type() == StatementType::Assign) {
+            auto assign = reinterpret_cast<AssignStmt*>(stmt);
+            auto left = assign->left().get();
+            auto concat = dynamic_cast<VarConcat*>(left);
+            if (concat) {
+                for (auto const& var : concat->vars) add_driver(var.get(), assign);
+            } else {
+                add_driver(left, assign);
+            }
+            return;
+        }
+        for (uint64_t i = 0; i < stmt->child_count(); i++) {
+            auto child = stmt->get_child(i);
+            if (child->ast_node_kind() == ASTNodeKind::StmtKind) index(reinterpret_cast<Stmt*>(child));
+        }
+    }
+
+    void add_driver(Var* var, AssignStmt* stmt) {
+        while (var->type() == VarType::Slice) var = reinterpret_cast<VarSlice*>(var)->parent_var;
+        drivers_[var].emplace_back(stmt);
+    }
+
+    void mark_var(Var* var) {
+        while (var->type() == VarType::Slice) var = reinterpret_cast<VarSlice*>(var)->parent_var;
+        if (live_vars_.emplace(var).second) worklist_.emplace_back(var);
+    }
+
+    void mark_reads(Var* var) {
+        if (!visited_.emplace(var).second) return;
+        if (var->type() == VarType::Base || var->type() == VarType::PortIO) {
+            // concatenations of more than two vars are typed as base vars
+            if (!dynamic_cast<VarConcat*>(var)) {
+                mark_var(var);
+                return;
+            }
+        }
+        for_each_operand(var, [&](Var* operand) { mark_reads(operand); });
+    }
+
+    void mark_stmt(Stmt* stmt) {
+        if (!live_stmts_.emplace(stmt).second) return;
+        switch (stmt->type()) {
+            case StatementType::Assign: {
+                auto assign = reinterpret_cast<AssignStmt*>(stmt);
+                mark_reads(assign->right().get());
+                // every var assigned by a live statement has to stay declared
+                auto concat = dynamic_cast<VarConcat*>(assign->left().get());
+                if (concat) {
+                    for (auto const& var : concat->vars) mark_var(var.get());
+                } else {
+                    mark_var(assign->left().get());
+                }
+                break;
+            }
+            case StatementType::If:
+                mark_reads(reinterpret_cast<IfStmt*>(stmt)->predicate().get());
+                break;
+            case StatementType::Switch:
+                mark_reads(reinterpret_cast<SwitchStmt*>(stmt)->target().get());
+                break;
+            case StatementType::Block: {
+                auto block = reinterpret_cast<StmtBlock*>(stmt);
+                if (block->block_type() == StatementBlockType::Sequential) {
+                    for (auto const& [edge, var] :
+                         reinterpret_cast<SequentialStmtBlock*>(block)->get_conditions())
+                        mark_reads(var.get());
+                }
+                break;
+            }
+            default:
+                break;
+        }
+        // the statements around it decide whether it runs
+        auto parent = stmt->parent();
+        if (parent && parent->ast_node_kind() == ASTNodeKind::StmtKind)
+            mark_stmt(reinterpret_cast<Stmt*>(parent));
+    }
+
+    bool live(const std::shared_ptr<Stmt>& stmt) const {
+        return live_stmts_.find(stmt.get()) != live_stmts_.end();
+    }
+
+    // removes the dead statements from stmts. returns true if stmts changed
+    bool remove_dead_stmts(std::vector<std::shared_ptr<Stmt>>& stmts) {
+        std::vector<std::shared_ptr<Stmt>> result;
+        result.reserve(stmts.size());
+        for (auto const& stmt : stmts) {
+            if (!live(stmt)) {
+                unlink_stmt(stmt);
+                continue;
+            }
+            if (stmt->type() == StatementType::If) {
+                auto if_ = stmt->as<IfStmt>();
+                auto then_body = if_->then_body();
+                if (remove_dead_stmts(then_body)) if_->set_then_body(then_body);
+                auto else_body = if_->else_body();
+                if (remove_dead_stmts(else_body)) if_->set_else_body(else_body);
+            } else if (stmt->type() == StatementType::Switch) {
+                auto switch_ = stmt->as<SwitchStmt>();
+                // copy the cases since set_switch_case changes the body
+                auto cases = switch_->body();
+                for (auto& [condition, body] : cases) {
+                    if (remove_dead_stmts(body)) switch_->set_switch_case(condition, body);
+                }
+            }
+            result.emplace_back(stmt);
+        }
+        if (result.size() == stmts.size()) return false;
+        stmts = std::move(result);
+        return true;
+    }
+
+    void remove_dead_logic(Generator* generator) {
+        std::vector<std::shared_ptr<Stmt>> dead_stmts;
+        for (uint64_t i = 0; i < generator->stmts_count(); i++) {
+            auto stmt = generator->get_stmt(i);
+            if (stmt->type() != StatementType::Assign && stmt->type() != StatementType::Block)
+                continue;
+            if (!live(stmt)) {
+                unlink_stmt(stmt);
+                dead_stmts.emplace_back(stmt);
+            } else if (stmt->type() == StatementType::Block) {
+                auto block = stmt->as<StmtBlock>();
+                std::vector<std::shared_ptr<Stmt>> stmts;
+                stmts.reserve(block->child_count());
+                for (uint64_t j = 0; j < block->child_count(); j++)
+                    stmts.emplace_back(
+                        reinterpret_cast<Stmt*>(block->get_child(j))->shared_from_this());
+                if (remove_dead_stmts(stmts)) block->set_statements(stmts);
+            }
+        }
+        generator->remove_stmts(dead_stmts);
+
+        for (auto const& var_name : generator->get_vars()) {
+            if (live_vars_.find(generator->get_var(var_name).get()) == live_vars_.end())
+                generator->remove_var(var_name);
+        }
+        if (generator != top_) {
+            // copy the names since the ports are removed while iterating
+            auto const port_names = generator->get_port_names();
+            for (auto const& port_name : port_names) {
+                if (live_vars_.find(generator->get_port(port_name).get()) == live_vars_.end())
+                    generator->remove_port(port_name);
+            }
+        }
+
+        std::vector<std::shared_ptr<Generator>> dead_children;
+        for (auto const& child : generator->get_child_generators()) {
+            if (black_boxes_.find(child.get()) == black_boxes_.end() &&
+                child->get_port_names().empty())
+                dead_children.emplace_back(child);
+        }
+        for (auto const& child : dead_children) {
+            generator->remove_child_generator(child);
+            remove_from_context(child.get());
+        }
+    }
+};
+
+void remove_dead_logic(Generator* top) {
+    DeadLogicEliminator eliminator(top);
+    eliminator.run();
+}
+
+// merges the selected children into their parent. the ports and vars of an inlined child become
+// vars of the parent named after the instance, e.g. child.out becomes child_out, and its
+// statements are rebuilt in the parent along with their debug info. an input port that is wired
+// directly to a var of the parent is replaced by that var, which is also how a clock port stays a
+// port of the parent. children are visited before their parent, so an inlined child brings its
+// own remaining children along
+class GeneratorInliner {
+public:
+    GeneratorInliner(Generator* top, const InlinePolicy& policy) : top_(top), policy_(policy) {
+        if (policy.name_pattern.empty()) return;
+        try {
+            name_pattern_ = std::regex(policy.name_pattern);
+        } catch (const std::regex_error&) {
+            throw ::runtime_error(::format("invalid inline name pattern {0}", policy.name_pattern));
+        }
+    }
+
+    void run() {
+        GeneratorOrderVisitor visitor;
+        visitor.visit_generator_root(top_);
+        for (auto generator : visitor.generators) {
+            if (generator->is_cloned()) cloned_names_.emplace(generator->name);
+        }
+        for (auto iter = visitor.generators.rbegin(); iter != visitor.generators.rend(); iter++)
+            inline_children(*iter);
+    }
+
+private:
+    Generator* top_;
+    InlinePolicy policy_;
+    std::regex name_pattern_;
+    std::unordered_set<std::string> cloned_names_;
+
+    // state for the parent that is being processed
+    Generator* parent_ = nullptr;
+    std::unordered_set<Generator*> inlined_;
+    std::unordered_set<std::string> instance_names_;
+    std::unordered_map<Var*, std::shared_ptr<Var>> vars_;
+
+    bool black_box(Generator* generator) const {
+        return generator->external() || generator->is_stub() || generator->is_cloned() ||
+               cloned_names_.find(generator->name) != cloned_names_.end();
+    }
+
+    bool selected(Generator* generator) const {
+        if (policy_.max_size && size(generator) <= policy_.max_size) return true;
+        if (!policy_.attribute.empty()) {
+            for (auto const& attribute : generator->get_attributes()) {
+                if (attribute->type_str == policy_.attribute) return true;
+            }
+        }
+        return !policy_.name_pattern.empty() && std::regex_match(generator->name, name_pattern_);
+    }
+
+    // number of statements, nested ones included, up to max_size + 1
+    uint32_t size(Generator* generator) const {
+        uint32_t result = 0;
+        for (uint64_t i = 0; i < generator->stmts_count(); i++) {
+            result += size(generator->get_stmt(i).get());
+            if (result > policy_.max_size) break;
+        }
+        return result;
+    }
+
+    uint32_t static size(Stmt* stmt) {
+        uint32_t result = 1;
+        for (uint64_t i = 0; i < stmt->child_count(); i++) {
+            auto child = stmt->get_child(i);
+            if (child->ast_node_kind() == ASTNodeKind::StmtKind)
+                result += size(reinterpret_cast<Stmt*>(child));
+        }
+        return result;
+    }
+
+    // the var of the parent that an input port is wired to by a top level assignment, if any.
+    // outputs of the siblings that are inlined as well count as vars of the parent
+    std::shared_ptr<Var> static direct_driver(Generator* parent, Port* port,
+                                              const std::unordered_set<Generator*>& siblings) {
+        if (port->port_direction() != PortDirection::In || port->sources().size() != 1)
+            return nullptr;
+        auto const& stmt = *port->sources().begin();
+        auto right = stmt->right();
+        if (stmt->left().get() != port || stmt->parent() != parent) return nullptr;
+        if (right->width != port->width || right->is_signed != port->is_signed) return nullptr;
+        if (right->generator != parent) {
+            if (siblings.find(right->generator) == siblings.end() ||
+                right->type() != VarType::PortIO ||
+                right->as<Port>()->port_direction() != PortDirection::Out)
+                return nullptr;
+            return right;
+        }
+        if (right->type() == VarType::PortIO ||
+            (right->type() == VarType::Base && !dynamic_cast<VarConcat*>(right.get())))
+            return right;
+        return nullptr;
+    }
+
+    bool can_inline(Generator* parent, Generator* child,
+                    const std::unordered_set<Var*>& conditions) const {
+        if (black_box(child) || !child->get_params().empty()) return false;
+        for (auto const& port_name : child->get_port_names()) {
+            auto port = child->get_port(port_name);
+            // the parent's sequential blocks can only be triggered by a port
+            if (port->is_packed() || conditions.find(port.get()) != conditions.end())
+                return false;
+            if (port->port_type() != PortType::Clock && port->port_type() != PortType::AsyncReset)
+                continue;
+            auto driver = direct_driver(parent, port.get(), {});
+            if (!driver || driver->type() != VarType::PortIO) return false;
+            auto type = driver->as<Port>()->port_type();
+            if (type != PortType::Clock && type != PortType::AsyncReset) return false;
+        }
+        return true;
+    }
+
+    void inline_children(Generator* parent) {
+        if (black_box(parent)) return;
+        std::unordered_set<Var*> conditions;
+        for (uint64_t i = 0; i < parent->stmts_count(); i++) {
+            auto stmt = parent->get_stmt(i);
+            if (stmt->type() != StatementType::Block ||
+                stmt->as<StmtBlock>()->block_type() != StatementBlockType::Sequential)
+                continue;
+            for (auto const& condition : stmt->as<SequentialStmtBlock>()->get_conditions())
+                conditions.emplace(condition.second.get());
+        }
+        std::vector<std::shared_ptr<Generator>> children;
+        for (auto const& child : parent->get_child_generators()) {
+            if (selected(child.get()) && can_inline(parent, child.get(), conditions))
+                children.emplace_back(child);
+        }
+        if (children.empty()) return;
+
+        parent_ = parent;
+        inlined_.clear();
+        instance_names_.clear();
+        vars_.clear();
+        for (auto const& child : parent->get_child_generators())
+            instance_names_.emplace(child->instance_name);
+        for (auto const& child : children) inlined_.emplace(child.get());
+
+        std::vector<std::shared_ptr<Stmt>> connections;
+        // the outputs first, so that an input can be wired to the output of a sibling
+        for (auto const& child : children) map_vars(child.get(), false, connections);
+        for (auto const& child : children) map_vars(child.get(), true, connections);
+        for (auto const& stmt : connections) unlink_stmt(stmt);
+        parent->remove_stmts(connections);
+        for (uint64_t i = 0; i < parent->stmts_count(); i++) rewrite(parent->get_stmt(i));
+
+        for (auto const& child : children) move_logic(child);
+    }
+
+    std::string unique_name(const std::string& name) {
+        auto result = name;
+        while (parent_->get_var(result) || instance_names_.find(result) != instance_names_.end())
+            result = parent_->get_unique_variable_name("", name);
+        return result;
+    }
+
+    // maps either the input ports or all the other vars of a child. the connections that are
+    // replaced by a direct driver are added to connections
+    void map_vars(Generator* child, bool inputs, std::vector<std::shared_ptr<Stmt>>& connections) {
+        for (auto const& [name, var] : child->vars()) {
+            auto const is_input = var->type() == VarType::PortIO &&
+                                  var->as<Port>()->port_direction() == PortDirection::In;
+            if (is_input != inputs) continue;
+            if (is_input) {
+                auto driver = direct_driver(parent_, var->as<Port>().get(), inlined_);
+                if (driver) {
+                    connections.emplace_back(*var->sources().begin());
+                    vars_.emplace(var.get(), substitute(driver));
+                    continue;
+                }
+            } else if (var->type() != VarType::PortIO && var->type() != VarType::Base) {
+                continue;
+            }
+            auto& new_var =
+                parent_->var(unique_name(::format("{0}_{1}", child->instance_name, name)),
+                             var->width, var->is_signed);
+            new_var.fn_name_ln = var->fn_name_ln;
+            if (parent_->debug) new_var.fn_name_ln.emplace_back(__FILE__, __LINE__);
+            vars_.emplace(var.get(), new_var.shared_from_this());
+        }
+    }
+
+    std::shared_ptr<Var> substitute(const std::shared_ptr<Var>& var) {
+        auto iter = vars_.find(var.get());
+        if (iter != vars_.end()) return iter->second;
+        std::shared_ptr<Var> result;
+        if (var->type() == VarType::ConstValue && inlined_.find(var->generator) != inlined_.end()) {
+            auto constant = var->as<Const>();
+            result = parent_->constant(constant->bits(), constant->is_signed).shared_from_this();
+        } else {
+            result = rebuild_operands(var.get(), [&](const std::shared_ptr<Var>& operand) {
+                return substitute(operand);
+            });
+        }
+        vars_.emplace(var.get(), result);
+        return result;
+    }
+
+    // replaces the references to the children's ports in a statement of the parent
+    void rewrite(const std::shared_ptr<Stmt>& stmt) {
+        switch (stmt->type()) {
+            case StatementType::Assign: {
+                auto assign = stmt->as<AssignStmt>();
+                auto left = substitute(assign->left());
+                if (left != assign->left()) {
+                    remove_source_from(assign->left().get(), assign);
+                    assign->set_left(left);
+                    left->add_source(assign);
+                }
+                auto right = substitute(assign->right());
+                if (right != assign->right()) replace_right(assign, right);
+                break;
+            }
+            case StatementType::If: {
+                auto if_ = stmt->as<IfStmt>();
+                auto predicate = substitute(if_->predicate());
+                if (predicate != if_->predicate()) if_->set_predicate(predicate);
+                for (auto const& s : if_->then_body()) rewrite(s);
+                for (auto const& s : if_->else_body()) rewrite(s);
+                break;
+            }
+            case StatementType::Switch: {
+                auto switch_ = stmt->as<SwitchStmt>();
+                auto target = substitute(switch_->target());
+                if (target != switch_->target()) switch_->set_target(target);
+                for (auto const& [condition, body] : switch_->body())
+                    for (auto const& s : body) rewrite(s);
+                break;
+            }
+            case StatementType::Block: {
+                for (uint64_t i = 0; i < stmt->child_count(); i++)
+                    rewrite(reinterpret_cast<Stmt*>(stmt->get_child(i))->shared_from_this());
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+    // builds a statement of a child in the parent
+    std::shared_ptr<Stmt> copy(const std::shared_ptr<Stmt>& stmt) {
+        std::shared_ptr<Stmt> result;
+        switch (stmt->type()) {
+            case StatementType::Assign: {
+                auto assign = stmt->as<AssignStmt>();
+                auto left = substitute(assign->left());
+                result = left->assign(substitute(assign->right()), assign->assign_type())
+                             .shared_from_this();
+                break;
+            }
+            case StatementType::If: {
+                auto if_ = stmt->as<IfStmt>();
+                auto new_if = parent_->make_node<IfStmt>(substitute(if_->predicate()));
+                for (auto const& s : if_->then_body()) new_if->add_then_stmt(copy(s));
+                for (auto const& s : if_->else_body()) new_if->add_else_stmt(copy(s));
+                result = new_if;
+                break;
+            }
+            case StatementType::Switch: {
+                auto switch_ = stmt->as<SwitchStmt>();
+                auto new_switch = parent_->make_node<SwitchStmt>(substitute(switch_->target()));
+                for (auto const& [condition, body] : switch_->body()) {
+                    auto new_condition = condition ? substitute(condition)->as<Const>() : nullptr;
+                    std::vector<std::shared_ptr<Stmt>> stmts;
+                    stmts.reserve(body.size());
+                    for (auto const& s : body) stmts.emplace_back(copy(s));
+                    // unlike add_switch_case, this keeps the empty cases
+                    new_switch->set_switch_case(new_condition, stmts);
+                }
+                result = new_switch;
+                break;
+            }
+            case StatementType::Block: {
+                auto block = stmt->as<StmtBlock>();
+                std::shared_ptr<StmtBlock> new_block;
+                if (block->block_type() == StatementBlockType::Sequential) {
+                    auto sequential = parent_->make_node<SequentialStmtBlock>();
+                    for (auto const& [edge, var] :
+                         block->as<SequentialStmtBlock>()->get_conditions())
+                        sequential->add_condition({edge, substitute(var)});
+                    new_block = sequential;
+                } else {
+                    new_block = parent_->make_node<CombinationalStmtBlock>();
+                }
+                for (uint64_t i = 0; i < block->child_count(); i++)
+                    new_block->add_statement(
+                        copy(reinterpret_cast<Stmt*>(block->get_child(i))->shared_from_this()));
+                result = new_block;
+                break;
+            }
+            default:
+                // module instantiations are created from the hierarchy later on
+                return nullptr;
+        }
+        result->fn_name_ln = stmt->fn_name_ln;
+        if (parent_->debug) result->fn_name_ln.emplace_back(__FILE__, __LINE__);
+        for (auto const& attribute : stmt->get_attributes()) result->add_attribute(attribute);
+        return result;
+    }
+
+    void move_logic(const std::shared_ptr<Generator>& child) {
+        for (uint64_t i = 0; i < child->stmts_count(); i++) {
+            auto stmt = copy(child->get_stmt(i));
+            if (stmt) parent_->add_stmt(stmt);
+        }
+        // the old statements are still connected to the ports of the grandchildren
+        for (uint64_t i = 0; i < child->stmts_count(); i++) unlink_stmt(child->get_stmt(i));
+
+        auto const& children_debug = child->children_debug();
+        for (auto const& grandchild : child->get_child_generators()) {
+            grandchild->set_instance_name(
+                unique_name(::format("{0}_{1}", child->instance_name, grandchild->instance_name)));
+            instance_names_.emplace(grandchild->instance_name);
+            auto debug = children_debug.find(grandchild);
+            if (debug != children_debug.end())
+                parent_->add_child_generator(grandchild, debug->second);
+            else
+                parent_->add_child_generator(grandchild);
+        }
+        parent_->remove_child_generator(child);
+        // unlike remove_from_context, the grandchildren stay registered
+        if (child->context()) child->context()->remove(child.get());
+    }
+};
+
+void inline_generators(Generator* top, const InlinePolicy& policy) {
+    GeneratorInliner inliner(top, policy);
+    inliner.run();
+}
+
+void AnalysisManager::add_analysis(const std::string& name, AnalysisFn fn) {
+    if (has_analysis(name))
+        throw ::runtime_error(::format("analysis {0} already exists", name));
+    analyses_.emplace(name, std::move(fn));
+}
+
+std::shared_ptr<void> AnalysisManager::get(const std::string& name, Generator* top) {
+    if (!has_analysis(name)) throw ::runtime_error(::format("unknown analysis {0}", name));
+    std::lock_guard<std::mutex> guard(mutex_);
+    // results computed for another hierarchy are of no use
+    if (top != top_) {
+        results_.clear();
+        top_ = top;
+    }
+    auto iter = results_.find(name);
+    if (iter != results_.end()) return iter->second;
+    auto result = analyses_.at(name)(top);
+    num_computations_++;
+    results_.emplace(name, result);
+    return result;
+}
+
+bool AnalysisManager::is_cached(const std::string& name) const {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return results_.find(name) != results_.end();
+}
+
+void AnalysisManager::invalidate(const std::string& name) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    results_.erase(name);
+}
+
+void AnalysisManager::invalidate_all() {
+    std::lock_guard<std::mutex> guard(mutex_);
+    results_.clear();
+}
+
+void AnalysisManager::invalidate_all_except(const std::vector<std::string>& preserved) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    for (auto iter = results_.begin(); iter != results_.end();) {
+        if (std::find(preserved.begin(), preserved.end(), iter->first) == preserved.end())
+            iter = results_.erase(iter);
+        else
+            iter++;
+    }
+}
+
+PassManager::PassManager() {
+    analyses_.add_analysis(generator_order_analysis, [](Generator* top) {
+        return std::make_shared<GeneratorOrder>(generator_order(top));
+    });
+    analyses_.add_analysis(generator_levels_analysis, [](Generator* top) {
+        return std::make_shared<GeneratorLevels>(generator_levels(top));
+    });
+}
+
+void PassManager::add_pass(const std::string& name, std::function<void(Generator*)> fn) {
+    add_pass(name, std::move(fn), PassInfo());
+}
+
+void PassManager::add_pass(const std::string& name, void(fn)(Generator*)) {
+    add_pass(name, fn, PassInfo());
+}
+
+void PassManager::add_pass(const std::string& name, void(fn)(Generator*), const PassInfo& info) {
+    auto func = [=](Generator* generator) { (*fn)(generator); };
+    add_pass(name, std::function<void(Generator*)>(func), info);
+}
+
+void PassManager::add_pass(const std::string& name, std::function<void(Generator*)> fn,
+                           const PassInfo& info) {
+    if (has_pass(name))
+        throw ::runtime_error(::format("{0} already exists in the pass manager", name));
+    for (auto const& analysis : info.uses) {
+        if (!analyses_.has_analysis(analysis))
+            throw ::runtime_error(::format("{0} uses unknown analysis {1}", name, analysis));
+    }
+    passes_.emplace(name, std::move(fn));
+    passes_order_.emplace_back(name);
+    infos_.emplace(name, info);
+}
+
+std::vector<std::string> PassManager::pass_order() const {
+    // stable topological sort: among the passes whose dependencies have run, the one added
+    // first goes next
+    std::unordered_map<std::string, uint64_t> index;
+    for (uint64_t i = 0; i < passes_order_.size(); i++) index.emplace(passes_order_[i], i);
+    std::vector<std::vector<uint64_t>> dependents(passes_order_.size());
+    std::vector<uint64_t> num_dependencies(passes_order_.size(), 0);
+    for (uint64_t i = 0; i < passes_order_.size(); i++) {
+        for (auto const& dependency : infos_.at(passes_order_[i]).dependencies) {
+            if (index.find(dependency) == index.end()) continue;
+            dependents[index.at(dependency)].emplace_back(i);
+            num_dependencies[i]++;
+        }
+    }
+
+    std::priority_queue<uint64_t, std::vector<uint64_t>, std::greater<>> ready;
+    for (uint64_t i = 0; i < passes_order_.size(); i++) {
+        if (!num_dependencies[i]) ready.emplace(i);
+    }
+    std::vector<std::string> result;
+    result.reserve(passes_order_.size());
+    while (!ready.empty()) {
+        auto i = ready.top();
+        ready.pop();
+        result.emplace_back(passes_order_[i]);
+        for (auto const& dependent : dependents[i]) {
+            if (!--num_dependencies[dependent]) ready.emplace(dependent);
+        }
+    }
+    if (result.size() != passes_order_.size()) {
+        for (uint64_t i = 0; i < passes_order_.size(); i++) {
+            if (num_dependencies[i])
+                throw ::runtime_error(
+                    ::format("{0} has a cyclic dependency", passes_order_[i]));
+        }
+    }
+    return result;
+}
+
+class IRNodeCountVisitor : public ASTVisitor {
+public:
+    void visit(Generator* generator) override {
+        count.generators++;
+        count.vars += generator->vars().size();
+    }
+    void visit(Expr*) override { count.exprs++; }
+    void visit(AssignStmt*) override { count.stmts++; }
+    void visit(IfStmt*) override { count.stmts++; }
+    void visit(SwitchStmt*) override { count.stmts++; }
+    void visit(CombinationalStmtBlock*) override { count.stmts++; }
+    void visit(SequentialStmtBlock*) override { count.stmts++; }
+    void visit(ModuleInstantiationStmt*) override { count.stmts++; }
+
+    IRNodeCount count;
+};
+
+IRNodeCount count_ir_nodes(Generator* top) {
+    IRNodeCountVisitor visitor;
+    visitor.visit_root(top);
+    return visitor.count;
+}
+
+// passes walk the statements by position, which is slow past the empty slots left by
+// remove_stmt. they are compacted between passes, when nothing else reads the statements
+void compact_generator_stmts(Generator* top) {
+    std::vector<Generator*> generators = {top};
+    while (!generators.empty()) {
+        auto generator = generators.back();
+        generators.pop_back();
+        generator->compact_stmts();
+        for (auto const& child : generator->get_child_generators())
+            generators.emplace_back(child.get());
+    }
+}
+
+void PassManager::run_passes(Generator* generator) {
+    profile_.clear();
+    auto const order = pass_order();
+    for (uint64_t i = 0; i < order.size();) {
+        compact_generator_stmts(generator);
+        // group consecutive read-only passes that don't depend on each other. profiled passes
+        // always run one at a time
+        std::vector<std::string> group = {order[i++]};
+        if (!profiling_ && infos_.at(group[0]).read_only) {
+            while (i < order.size()) {
+                auto const& info = infos_.at(order[i]);
+                if (!info.read_only) break;
+                auto depends = std::any_of(
+                    info.dependencies.begin(), info.dependencies.end(), [&](const auto& name) {
+                        return std::find(group.begin(), group.end(), name) != group.end();
+                    });
+                if (depends) break;
+                group.emplace_back(order[i++]);
+            }
+        }
+
+        if (group.size() == 1)
+            run_pass(group[0], generator);
+        else
+            run_passes_concurrently(group, generator);
+    }
+    // code generation walks the statements as well
+    compact_generator_stmts(generator);
+}
+
+void PassManager::run_pass(const std::string& name, Generator* generator) {
+    auto const& info = infos_.at(name);
+    for (auto const& analysis : info.uses) analyses_.get(analysis, generator);
+    try {
+        if (profiling_)
+            run_pass_profiled(name, generator);
+        else
+            passes_.at(name)(generator);
+    } catch (...) {
+        // the IR may be half way through a change
+        if (!info.read_only) analyses_.invalidate_all();
+        throw;
+    }
+    if (!info.read_only) analyses_.invalidate_all_except(info.preserves);
+}
+
+void PassManager::run_passes_concurrently(const std::vector<std::string>& names,
+                                          Generator* generator) {
+    // compute the analyses up front so that the passes don't wait on each other
+    for (auto const& name : names) {
+        for (auto const& analysis : infos_.at(name).uses) analyses_.get(analysis, generator);
+    }
+
+    cxxpool::thread_pool pool{static_cast<uint32_t>(names.size())};
+    std::vector<std::future<void>> thread_tasks;
+    thread_tasks.reserve(names.size());
+    for (auto const& name : names) {
+        // the pass functions are never copied here, since they may hold python objects and
+        // the GIL is released while the passes run
+        auto const& fn = passes_.at(name);
+        thread_tasks.emplace_back(pool.push([&fn](Generator* top) { fn(top); }, generator));
+    }
+    // re-throw the error from the first pass in order
+    std::exception_ptr error;
+    for (auto& task : thread_tasks) {
+        try {
+            task.get();
+        } catch (...) {
+            if (!error) error = std::current_exception();
+        }
+    }
+    if (error) std::rethrow_exception(error);
+}
+
+void PassManager::run_pass_profiled(const std::string& name, Generator* generator) {
+    auto const& fn = passes_.at(name);
+    PassProfile entry;
+    entry.name = name;
+    entry.nodes_before = count_ir_nodes(generator);
+
+    auto wall_start = std::chrono::steady_clock::now();
+    auto cpu_start = std::clock();
+    start_allocation_tracking();
+    try {
+        fn(generator);
+    } catch (...) {
+        stop_allocation_tracking();
+        throw;
+    }
+    auto allocations = stop_allocation_tracking();
+    auto cpu_end = std::clock();
+    auto wall_end = std::chrono::steady_clock::now();
+
+    entry.wall_time = std::chrono::duration<double, std::milli>(wall_end - wall_start).count();
+    entry.cpu_time = 1000.0 * (cpu_end - cpu_start) / CLOCKS_PER_SEC;
+    entry.num_allocations = allocations.num_allocations;
+    entry.allocated_bytes = allocations.allocated_bytes;
+    entry.nodes_after = count_ir_nodes(generator);
+    profile_.emplace_back(entry);
+}
+
+std::string static json_string(const std::string& str) {
+    std::string result;
+    result.reserve(str.size() + 2);
+    result += '"';
+    for (auto const c : str) {
+        if (c == '"' || c == '\\') {
+            result += '\\';
+            result += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            result += ::format("\\u{0:04x}", static_cast<uint32_t>(c));
+        } else {
+            result += c;
+        }
+    }
+    result += '"';
+    return result;
+}
+
+std::string inline node_count_json(const IRNodeCount& count) {
+    return ::format(R"({{"generators": {0}, "vars": {1}, "stmts": {2}, "exprs": {3}}})",
+                    count.generators, count.vars, count.stmts, count.exprs);
+}
+
+std::string PassManager::profile_json() const {
+    std::vector<std::string> entries;
+    entries.reserve(profile_.size());
+    for (auto const& entry : profile_) {
+        entries.emplace_back(
+            ::format(R"(  {{"name": {0}, "wall_time": {1}, "cpu_time": {2}, )"
+                     R"("num_allocations": {3}, "allocated_bytes": {4}, )"
+                     R"("nodes_before": {5}, "nodes_after": {6}}})",
+                     json_string(entry.name), entry.wall_time, entry.cpu_time,
+                     entry.num_allocations, entry.allocated_bytes,
+                     node_count_json(entry.nodes_before), node_count_json(entry.nodes_after)));
+    }
+    return ::format("[\n{0}\n]\n", fmt::join(entries.begin(), entries.end(), ",\n"));
+}
+
+void PassManager::dump_profile(const std::string& filename) const {
+    std::ofstream stream(filename, std::ios::trunc);
+    if (!stream.is_open()) throw ::runtime_error(::format("unable to open {0}", filename));
+    stream << profile_json();
 }
\ No newline at end of file
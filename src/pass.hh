@@ -2,12 +2,16 @@
 #define KRATOS_PASS_HH
 
 #include <functional>
+#include <memory>
+#include <mutex>
 #include "ast.hh"
 #include "context.hh"
 #include "hash.hh"
 #include "stmt.hh"
 
-enum HashStrategy : int { SequentialHash, ParallelHash };
+// StructuralHash and ParallelStructuralHash combine per-node hashes directly instead of
+// hashing the string form of each statement
+enum HashStrategy : int { SequentialHash, ParallelHash, StructuralHash, ParallelStructuralHash };
 
 void fix_assignment_type(Generator* top);
 
@@ -21,6 +25,9 @@ void verify_generator_connectivity(Generator* top);
 
 void check_mixed_assignment(Generator* top);
 
+// verify_assignments, verify_generator_connectivity and check_mixed_assignment in one walk
+void verify_generators(Generator* top);
+
 void create_module_instantiation(Generator* top);
 
 void hash_generators(Generator* top, HashStrategy strategy);
@@ -28,10 +35,29 @@ void hash_generators(Generator* top, HashStrategy strategy);
 void decouple_generator_ports(Generator* top);
 
 void uniquify_generators(Generator* top);
+// if verify is set, generators with the same hash are also compared structurally, so that a
+// hash collision never merges two different modules
+void uniquify_generators(Generator* top, bool verify);
 
 void uniquify_module_instances(Generator* top);
 
 std::map<std::string, std::string> generate_verilog(Generator* top);
+// unique modules are generated on a thread pool if use_parallel is set
+std::map<std::string, std::string> generate_verilog(Generator* top, bool use_parallel);
+
+// where a module ended up when streamed to disk. line_offset is the number of lines
+// before the module in that file
+struct VerilogFileEntry {
+    std::string filename;
+    uint64_t line_offset = 0;
+    uint64_t num_lines = 0;
+};
+using VerilogManifest = std::map<std::string, VerilogFileEntry>;
+
+// streams the modules to disk as soon as they are generated. if split_files is set, each module
+// is written to path/module_name.sv, otherwise all modules are concatenated into path
+VerilogManifest generate_verilog(Generator* top, const std::string& path, bool split_files,
+                                 bool use_parallel);
 
 std::map<std::string, std::map<uint32_t, std::vector<std::pair<std::string, uint32_t>>>>
 extract_debug_info(Generator* top);
@@ -53,12 +79,155 @@ void remove_pass_through_modules(Generator* top);
 
 void merge_wire_assignments(Generator* top);
 
+// folds constant expressions, propagates vars that are driven by a constant and removes the
+// if/switch branches that can never be taken
+void fold_constants(Generator* top);
+
+// hoists expressions that are used more than once into wires. expressions with fewer than
+// min_size nodes, counting the leaves, are left alone
+constexpr uint32_t default_cse_min_size = 3;
+void eliminate_common_subexpressions(Generator* top);
+void eliminate_common_subexpressions(Generator* top, uint32_t min_size);
+
+// removes the logic that doesn't reach an output of the top generator: assignments, vars,
+// child ports and children that are left without any port
+void remove_dead_logic(Generator* top);
+
+// selects the children that inline_generators merges into their parent. a child is inlined if
+// any of the policies that are set selects it
+struct InlinePolicy {
+    // generators with at most max_size statements, counting the nested ones
+    uint32_t max_size = 0;
+    // generators that carry an attribute with this type_str
+    std::string attribute;
+    // generators whose name matches this regular expression
+    std::string name_pattern;
+};
+
+// merges the selected children into their parents. external, stub and cloned generators, and
+// generators with parameters, are never inlined
+void inline_generators(Generator* top, const InlinePolicy& policy);
+
+// calls fn on every generator in the hierarchy, level by level from the top. generators on the
+// same level are processed concurrently, so fn may only modify the generator it is given and
+// read its direct children. if any fn throws, the error from the first generator in
+// hierarchy order within that level is re-thrown after the level is finished
+void parallel_generator_pass(Generator* top, const std::function<void(Generator*)>& fn);
+
+// generators in hierarchy order, parents before children
+struct GeneratorOrder {
+    std::vector<Generator*> generators;
+};
+GeneratorOrder generator_order(Generator* top);
+
+// generators by their level in the hierarchy, each level sorted in hierarchy order
+struct GeneratorLevels {
+    std::vector<std::vector<Generator*>> levels;
+};
+GeneratorLevels generator_levels(Generator* top);
+// same as above with the levels already computed
+void parallel_generator_pass(const GeneratorLevels& levels,
+                             const std::function<void(Generator*)>& fn);
+
+// per-generator versions of the passes above, which can be used with parallel_generator_pass
+void fix_assignment_type_generator(Generator* generator);
+void verify_assignments_generator(Generator* generator);
+void zero_out_stub_generator(Generator* generator);
+void check_mixed_assignment_generator(Generator* generator);
+// the top level generator's inputs are not checked for drivers
+void verify_generator(Generator* generator, bool is_top_level);
+// also rewrites the connections to its children's ports, which is safe since the children are
+// processed on the next level
+void fold_constants_generator(Generator* generator);
+void eliminate_common_subexpressions_generator(Generator* generator);
+void eliminate_common_subexpressions_generator(Generator* generator, uint32_t min_size);
+
+// number of IR nodes reachable from a generator. used for profiling
+struct IRNodeCount {
+    uint64_t generators = 0;
+    uint64_t vars = 0;
+    uint64_t stmts = 0;
+    uint64_t exprs = 0;
+};
+
+IRNodeCount count_ir_nodes(Generator* top);
+
+// per-pass profiling result. times are in milliseconds
+struct PassProfile {
+    std::string name;
+    double wall_time = 0;
+    double cpu_time = 0;
+    // IR node allocations, plus the heap allocations of binaries that count them, see
+    // count_allocation
+    uint64_t num_allocations = 0;
+    uint64_t allocated_bytes = 0;
+    IRNodeCount nodes_before;
+    IRNodeCount nodes_after;
+};
+
+// names of the analyses every pass manager provides
+constexpr char generator_order_analysis[] = "generator_order";
+constexpr char generator_levels_analysis[] = "generator_levels";
+
+// results computed over the whole hierarchy and shared between passes. an analysis is computed
+// the first time it's asked for and cached until a pass that doesn't preserve it runs. it's safe
+// to get analyses from passes that run concurrently
+class AnalysisManager {
+public:
+    using AnalysisFn = std::function<std::shared_ptr<void>(Generator*)>;
+
+    void add_analysis(const std::string& name, AnalysisFn fn);
+    bool inline has_analysis(const std::string& name) const {
+        return analyses_.find(name) != analyses_.end();
+    }
+
+    std::shared_ptr<void> get(const std::string& name, Generator* top);
+    // T has to be the type the analysis computes
+    template <typename T>
+    std::shared_ptr<T> get(const std::string& name, Generator* top) {
+        return std::static_pointer_cast<T>(get(name, top));
+    }
+
+    bool is_cached(const std::string& name) const;
+    void invalidate(const std::string& name);
+    void invalidate_all();
+    void invalidate_all_except(const std::vector<std::string>& preserved);
+
+    // how many times an analysis has been computed. used for testing
+    uint64_t num_computations() const { return num_computations_; }
+
+private:
+    std::map<std::string, AnalysisFn> analyses_;
+    std::map<std::string, std::shared_ptr<void>> results_;
+    // the generator the cached results belong to
+    Generator* top_ = nullptr;
+    uint64_t num_computations_ = 0;
+    mutable std::mutex mutex_;
+};
+
+// what a pass declares to the pass manager. passes and analyses are referred to by name
+struct PassInfo {
+    // passes that have to run before this one. dependencies that are not added are ignored
+    std::vector<std::string> dependencies;
+    // analyses computed before the pass runs
+    std::vector<std::string> uses;
+    // analyses that are still valid after the pass. everything else is invalidated
+    std::vector<std::string> preserves;
+    // the pass doesn't change the IR, so nothing is invalidated. consecutive read-only passes
+    // that don't depend on each other run concurrently
+    bool read_only = false;
+};
+
 class PassManager {
 public:
-    PassManager() = default;
+    PassManager();
 
+    // passes added without a PassInfo are assumed to invalidate every analysis
     void add_pass(const std::string& name, std::function<void(Generator*)> fn);
     void add_pass(const std::string &name, void(fn)(Generator*));
+    void add_pass(const std::string& name, std::function<void(Generator*)> fn,
+                  const PassInfo& info);
+    void add_pass(const std::string& name, void(fn)(Generator*), const PassInfo& info);
 
     bool inline has_pass(const std::string& name) const {
         return passes_.find(name) != passes_.end();
@@ -67,10 +236,31 @@ public:
     void run_passes(Generator* generator);
 
     uint64_t num_passes()  const { return passes_order_.size(); }
+    // the order passes run in: the order they are added in, except that a pass is moved after
+    // its dependencies
+    std::vector<std::string> pass_order() const;
+
+    AnalysisManager& analyses() { return analyses_; }
+
+    // opt-in profiling. the profile is cleared every time run_passes is called
+    bool profiling() const { return profiling_; }
+    void set_profiling(bool value) { profiling_ = value; }
+    const std::vector<PassProfile>& profile() const { return profile_; }
+    std::string profile_json() const;
+    void dump_profile(const std::string& filename) const;
 
 private:
     std::map<std::string, std::function<void(Generator*)>> passes_;
     std::vector<std::string> passes_order_;
+    std::map<std::string, PassInfo> infos_;
+    AnalysisManager analyses_;
+
+    bool profiling_ = false;
+    std::vector<PassProfile> profile_;
+
+    void run_pass(const std::string& name, Generator* generator);
+    void run_pass_profiled(const std::string& name, Generator* generator);
+    void run_passes_concurrently(const std::vector<std::string>& names, Generator* generator);
 };
 
 #endif  // KRATOS_PASS_HH
@@ -2,6 +2,7 @@
 #include <stdexcept>
 #include <unordered_map>
 #include "fmt/format.h"
+#include "generator.hh"
 
 using fmt::format;
 using std::runtime_error;
@@ -41,7 +42,7 @@ PortPackedSlice& PortPacked::operator[](const std::string& member_name) {
     if (members_.find(member_name) != members_.end()) {
         return *members_.at(member_name);
     } else {
-        auto ptr = std::make_shared<PortPackedSlice>(this, member_name);
+        auto ptr = generator->make_node<PortPackedSlice>(this, member_name);
         members_.emplace(member_name, ptr);
         return *ptr;
     }
@@ -0,0 +1,562 @@
+#include "sim.hh"
+#include <algorithm>
+#include <deque>
+#include "except.hh"
+#include "fmt/format.h"
+#include "generator.hh"
+#include "port.hh"
+
+using fmt::format;
+using std::runtime_error;
+
+// upper bound on delta cycles before a combinational loop or a chain of derived clocks is
+// considered to oscillate
+constexpr uint32_t max_iterations = 1000;
+
+uint64_t inline mask(uint32_t width) { return width >= 64 ? ~0ull : (1ull << width) - 1; }
+
+int64_t inline sign_extend(uint64_t value, uint32_t width) {
+    if (width < 64 && ((value >> (width - 1)) & 1u)) value |= ~mask(width);
+    return static_cast<int64_t>(value);
+}
+
+uint64_t eval_unary(ExprOp op, uint64_t value, uint32_t width) {
+    switch (op) {
+        case ExprOp::UInvert:
+            return ~value & mask(width);
+        case ExprOp::UMinus:
+        case ExprOp::Minus:
+            return (~value + 1) & mask(width);
+        default:
+            return value;
+    }
+}
+
+uint64_t eval_binary(ExprOp op, uint64_t a, uint64_t b, uint32_t width, bool left_signed,
+                     bool right_signed, uint32_t result_width) {
+    auto const is_signed = left_signed && right_signed;
+    auto const sa = sign_extend(a, width);
+    auto const sb = sign_extend(b, width);
+    uint64_t result = 0;
+    switch (op) {
+        case ExprOp::Add:
+            result = a + b;
+            break;
+        case ExprOp::Minus:
+            result = a - b;
+            break;
+        case ExprOp::Multiply:
+            result = a * b;
+            break;
+        case ExprOp::Divide:
+        case ExprOp::Mod: {
+            if (!b) break;
+            bool const divide = op == ExprOp::Divide;
+            if (is_signed && sb == -1) {
+                // avoid the overflow of INT64_MIN / -1
+                result = divide ? ~a + 1 : 0;
+            } else if (is_signed) {
+                result = static_cast<uint64_t>(divide ? sa / sb : sa % sb);
+            } else {
+                result = divide ? a / b : a % b;
+            }
+            break;
+        }
+        case ExprOp::LogicalShiftRight:
+            result = b >= width ? 0 : a >> b;
+            break;
+        case ExprOp::SignedShiftRight:
+            // arithmetic only if the shifted operand is signed
+            if (left_signed)
+                result = static_cast<uint64_t>(sa >> std::min<uint64_t>(b, 63));
+            else
+                result = b >= width ? 0 : a >> b;
+            break;
+        case ExprOp::ShiftLeft:
+            result = b >= width ? 0 : a << b;
+            break;
+        case ExprOp::Or:
+            result = a | b;
+            break;
+        case ExprOp::And:
+            result = a & b;
+            break;
+        case ExprOp::Xor:
+            result = a ^ b;
+            break;
+        case ExprOp::LessThan:
+            result = is_signed ? sa < sb : a < b;
+            break;
+        case ExprOp::GreaterThan:
+            result = is_signed ? sa > sb : a > b;
+            break;
+        case ExprOp::LessEqThan:
+            result = is_signed ? sa <= sb : a <= b;
+            break;
+        case ExprOp::GreaterEqThan:
+            result = is_signed ? sa >= sb : a >= b;
+            break;
+        case ExprOp::Eq:
+            result = a == b;
+            break;
+        case ExprOp::Neq:
+            result = a != b;
+            break;
+        default:
+            throw runtime_error(::format("Unsupported binary op {0}", static_cast<uint64_t>(op)));
+    }
+    return result & mask(result_width);
+}
+
+Simulator::Simulator(Generator *top) : top_(top) {
+    add_generator(top);
+    levelize();
+    // the initial values are not edges
+    settle();
+    for (auto &trigger : triggers_) trigger.last_value = eval(trigger.node) & 1u;
+    dirty_ = false;
+}
+
+void Simulator::add_generator(Generator *generator) {
+    for (uint64_t i = 0; i < generator->stmts_count(); i++) {
+        auto stmt = generator->get_stmt(i);
+        if (stmt->type() == StatementType::ModuleInstantiation) continue;
+        if (stmt->type() == StatementType::Block &&
+            stmt->as<StmtBlock>()->block_type() == StatementBlockType::Sequential) {
+            auto block = stmt->as<SequentialStmtBlock>();
+            Process process;
+            process.stmts.emplace_back(compile(block.get(), true, process));
+            auto index = static_cast<uint32_t>(seq_processes_.size());
+            for (auto const &[edge, var] : block->get_conditions()) {
+                auto node = compile(var.get());
+                triggers_.emplace_back(Trigger{node, edge, index, false});
+                collect_nets(node, trigger_nets_);
+            }
+            seq_processes_.emplace_back(std::move(process));
+        } else if (stmt->type() == StatementType::Block ||
+                   stmt->type() == StatementType::Assign) {
+            Process process;
+            process.stmts.emplace_back(compile(stmt.get(), false, process));
+            comb_processes_.emplace_back(std::move(process));
+        } else {
+            throw StmtException("Top level statement is not supported by the simulator",
+                                {stmt.get()});
+        }
+    }
+    for (auto const &child : generator->get_child_generators()) add_generator(child.get());
+}
+
+uint32_t Simulator::net(Var *var) {
+    if (nets_.find(var) != nets_.end()) return nets_.at(var);
+    if (var->width > 64)
+        throw VarException(
+            ::format("{0} is {1} bits wide. The simulator only supports up to 64 bits",
+                     var->to_string(), var->width),
+            {var});
+    auto index = static_cast<uint32_t>(values_.size());
+    values_.emplace_back(0);
+    nets_.emplace(var, index);
+    return index;
+}
+
+uint32_t Simulator::compile(Var *var) {
+    if (node_ids_.find(var) != node_ids_.end()) return node_ids_.at(var);
+    if (var->width > 64)
+        throw VarException(
+            ::format("{0} is {1} bits wide. The simulator only supports up to 64 bits",
+                     var->to_string(), var->width),
+            {var});
+    Node node{};
+    node.width = var->width;
+    node.is_signed = var->is_signed;
+    // concat copies are not tagged with their own var type
+    if (auto concat = dynamic_cast<VarConcat *>(var)) {
+        node.kind = Node::Concat;
+        for (auto const &operand : concat->vars) node.operands.emplace_back(compile(operand.get()));
+    } else {
+        switch (var->type()) {
+            case VarType::Base:
+            case VarType::PortIO: {
+                node.kind = Node::Net;
+                node.value = net(var);
+                break;
+            }
+            case VarType::ConstValue:
+            case VarType::Parameter: {
+                node.kind = Node::Constant;
+                node.value = static_cast<Const *>(var)->bits().word(0);
+                break;
+            }
+            case VarType::Slice: {
+                auto slice = static_cast<VarSlice *>(var);
+                node.kind = Node::Slice;
+                node.left = compile(slice->parent_var);
+                node.low = slice->low;
+                break;
+            }
+            case VarType::BaseCasted: {
+                // same bits, only the signedness changes
+                node.kind = Node::Slice;
+                node.left = compile(static_cast<VarCasted *>(var)->parent_var());
+                node.low = 0;
+                break;
+            }
+            case VarType::Expression: {
+                auto expr = static_cast<Expr *>(var);
+                node.op = expr->op;
+                node.left = compile(expr->left.get());
+                if (expr->right) {
+                    node.kind = Node::Binary;
+                    node.right = compile(expr->right.get());
+                } else {
+                    node.kind = Node::Unary;
+                }
+                break;
+            }
+        }
+    }
+    auto index = static_cast<uint32_t>(nodes_.size());
+    nodes_.emplace_back(std::move(node));
+    node_ids_.emplace(var, index);
+    return index;
+}
+
+void Simulator::compile_target(Var *var, uint32_t offset, std::vector<Segment> &target) {
+    if (auto concat = dynamic_cast<VarConcat *>(var)) {
+        // the last var holds the least significant bits
+        for (auto iter = concat->vars.rbegin(); iter != concat->vars.rend(); iter++) {
+            compile_target(iter->get(), offset, target);
+            offset += (*iter)->width;
+        }
+        return;
+    }
+    uint32_t low = 0;
+    auto base = var;
+    while (base->type() == VarType::Slice) {
+        auto slice = static_cast<VarSlice *>(base);
+        low += slice->low;
+        base = slice->parent_var;
+    }
+    if (base->type() != VarType::Base && base->type() != VarType::PortIO)
+        throw VarException(::format("{0} cannot be assigned in simulation", var->to_string()),
+                           {var});
+    target.emplace_back(Segment{net(base), low, var->width, offset});
+}
+
+uint32_t Simulator::compile(Stmt *stmt, bool sequential, Process &process) {
+    Statement result{};
+    switch (stmt->type()) {
+        case StatementType::Assign: {
+            auto assign = static_cast<AssignStmt *>(stmt);
+            result.kind = Statement::Assign;
+            // non-blocking assignments are only deferred in sequential blocks
+            result.non_blocking =
+                sequential && assign->assign_type() != AssignmentType::Blocking;
+            result.expr = compile(assign->right().get());
+            collect_nets(result.expr, process.reads);
+            compile_target(assign->left().get(), 0, result.target);
+            for (auto const &segment : result.target) process.writes.emplace(segment.net);
+            break;
+        }
+        case StatementType::If: {
+            auto if_ = static_cast<IfStmt *>(stmt);
+            result.kind = Statement::If;
+            result.expr = compile(if_->predicate().get());
+            collect_nets(result.expr, process.reads);
+            for (auto const &s : if_->then_body())
+                result.body.emplace_back(compile(s.get(), sequential, process));
+            for (auto const &s : if_->else_body())
+                result.else_body.emplace_back(compile(s.get(), sequential, process));
+            break;
+        }
+        case StatementType::Switch: {
+            auto switch_ = static_cast<SwitchStmt *>(stmt);
+            result.kind = Statement::Switch;
+            result.expr = compile(switch_->target().get());
+            collect_nets(result.expr, process.reads);
+            auto const target_mask = mask(nodes_[result.expr].width);
+            for (auto const &[condition, stmts] : switch_->body()) {
+                std::vector<uint32_t> body;
+                for (auto const &s : stmts)
+                    body.emplace_back(compile(s.get(), sequential, process));
+                if (condition) {
+                    result.cases.emplace_back(condition->bits().word(0) & target_mask,
+                                              std::move(body));
+                } else {
+                    result.has_default = true;
+                    result.else_body = std::move(body);
+                }
+            }
+            break;
+        }
+        case StatementType::Block: {
+            auto block = static_cast<StmtBlock *>(stmt);
+            result.kind = Statement::Block;
+            for (uint64_t i = 0; i < block->child_count(); i++) {
+                auto child = static_cast<Stmt *>(block->get_child(i));
+                result.body.emplace_back(compile(child, sequential, process));
+            }
+            break;
+        }
+        default:
+            throw StmtException("Statement is not supported by the simulator", {stmt});
+    }
+    auto index = static_cast<uint32_t>(stmts_.size());
+    stmts_.emplace_back(std::move(result));
+    return index;
+}
+
+void Simulator::collect_nets(uint32_t node, std::unordered_set<uint32_t> &nets) const {
+    auto const &n = nodes_[node];
+    switch (n.kind) {
+        case Node::Net:
+            nets.emplace(static_cast<uint32_t>(n.value));
+            break;
+        case Node::Constant:
+            break;
+        case Node::Binary:
+            collect_nets(n.right, nets);
+            collect_nets(n.left, nets);
+            break;
+        case Node::Unary:
+        case Node::Slice:
+            collect_nets(n.left, nets);
+            break;
+        case Node::Concat:
+            for (auto operand : n.operands) collect_nets(operand, nets);
+            break;
+    }
+}
+
+void Simulator::levelize() {
+    // processes that write each net
+    std::unordered_map<uint32_t, std::vector<uint32_t>> drivers;
+    for (uint32_t i = 0; i < comb_processes_.size(); i++) {
+        for (auto net : comb_processes_[i].writes) drivers[net].emplace_back(i);
+    }
+    std::vector<std::vector<uint32_t>> fan_out(comb_processes_.size());
+    std::vector<uint32_t> in_degree(comb_processes_.size(), 0);
+    for (uint32_t i = 0; i < comb_processes_.size(); i++) {
+        std::unordered_set<uint32_t> sources;
+        for (auto net : comb_processes_[i].reads) {
+            if (drivers.find(net) == drivers.end()) continue;
+            for (auto driver : drivers.at(net)) {
+                // reading back what the process itself writes is not a dependency
+                if (driver != i && sources.emplace(driver).second) {
+                    fan_out[driver].emplace_back(i);
+                    in_degree[i]++;
+                }
+            }
+        }
+    }
+
+    std::deque<uint32_t> queue;
+    for (uint32_t i = 0; i < comb_processes_.size(); i++) {
+        if (!in_degree[i]) queue.emplace_back(i);
+    }
+    comb_order_.reserve(comb_processes_.size());
+    while (!queue.empty()) {
+        auto process = queue.front();
+        queue.pop_front();
+        comb_order_.emplace_back(process);
+        for (auto next : fan_out[process]) {
+            if (!(--in_degree[next])) queue.emplace_back(next);
+        }
+    }
+    // whatever is left is part of a loop, possibly a false one through different bits of
+    // the same net. evaluate it last and iterate
+    if (comb_order_.size() != comb_processes_.size()) {
+        has_loop_ = true;
+        for (uint32_t i = 0; i < comb_processes_.size(); i++) {
+            if (in_degree[i]) comb_order_.emplace_back(i);
+        }
+    }
+
+    // a trigger also depends on the nets it is computed from, e.g. the clock port of a child
+    std::vector<uint32_t> worklist(trigger_nets_.begin(), trigger_nets_.end());
+    while (!worklist.empty()) {
+        auto net = worklist.back();
+        worklist.pop_back();
+        auto iter = drivers.find(net);
+        if (iter == drivers.end()) continue;
+        for (auto driver : iter->second) {
+            for (auto read : comb_processes_[driver].reads) {
+                if (trigger_nets_.emplace(read).second) worklist.emplace_back(read);
+            }
+        }
+    }
+}
+
+uint64_t Simulator::eval(uint32_t node) const {
+    auto const &n = nodes_[node];
+    switch (n.kind) {
+        case Node::Net:
+            return values_[n.value];
+        case Node::Constant:
+            return n.value & mask(n.width);
+        case Node::Slice:
+            return (eval(n.left) >> n.low) & mask(n.width);
+        case Node::Concat: {
+            uint64_t result = 0;
+            for (auto operand : n.operands) {
+                // only a single operand could be 64 bits wide
+                auto const width = nodes_[operand].width;
+                result = width >= 64 ? eval(operand) : (result << width) | eval(operand);
+            }
+            return result;
+        }
+        case Node::Unary:
+            return eval_unary(n.op, eval(n.left), n.width);
+        case Node::Binary: {
+            auto const &left = nodes_[n.left];
+            auto const &right = nodes_[n.right];
+            return eval_binary(n.op, eval(n.left), eval(n.right), left.width, left.is_signed,
+                               right.is_signed, n.width);
+        }
+    }
+    return 0;
+}
+
+void Simulator::write(const std::vector<Segment> &target, uint64_t value) {
+    for (auto const &segment : target) {
+        auto const segment_mask = mask(segment.width);
+        auto const bits = segment.offset >= 64 ? 0 : (value >> segment.offset) & segment_mask;
+        auto &net = values_[segment.net];
+        auto const updated = (net & ~(segment_mask << segment.low)) | (bits << segment.low);
+        if (updated != net) {
+            net = updated;
+            changed_ = true;
+        }
+    }
+}
+
+void Simulator::execute(uint32_t stmt) {
+    auto const &s = stmts_[stmt];
+    switch (s.kind) {
+        case Statement::Assign: {
+            auto value = eval(s.expr);
+            if (s.non_blocking)
+                pending_.emplace_back(&s.target, value);
+            else
+                write(s.target, value);
+            break;
+        }
+        case Statement::If: {
+            execute(eval(s.expr) ? s.body : s.else_body);
+            break;
+        }
+        case Statement::Switch: {
+            auto const value = eval(s.expr);
+            auto iter = std::find_if(s.cases.begin(), s.cases.end(),
+                                     [value](const auto &c) { return c.first == value; });
+            if (iter != s.cases.end())
+                execute(iter->second);
+            else if (s.has_default)
+                execute(s.else_body);
+            break;
+        }
+        case Statement::Block: {
+            execute(s.body);
+            break;
+        }
+    }
+}
+
+void Simulator::execute(const std::vector<uint32_t> &stmts) {
+    for (auto stmt : stmts) execute(stmt);
+}
+
+void Simulator::settle() {
+    uint32_t iteration = 0;
+    do {
+        changed_ = false;
+        for (auto process : comb_order_) execute(comb_processes_[process].stmts);
+        if (++iteration > max_iterations)
+            throw runtime_error(::format("Combinational logic in {0} does not settle", top_->name));
+    } while (has_loop_ && changed_);
+}
+
+void Simulator::update() {
+    for (uint32_t iteration = 0;; iteration++) {
+        settle();
+        std::vector<uint32_t> processes;
+        for (auto &trigger : triggers_) {
+            bool const value = eval(trigger.node) & 1u;
+            bool const fired = trigger.edge == BlockEdgeType::Posedge
+                                   ? (!trigger.last_value && value)
+                                   : (trigger.last_value && !value);
+            trigger.last_value = value;
+            if (fired && std::find(processes.begin(), processes.end(), trigger.process) ==
+                             processes.end())
+                processes.emplace_back(trigger.process);
+        }
+        if (processes.empty()) break;
+        if (iteration > max_iterations)
+            throw runtime_error(::format("Sequential logic in {0} does not settle", top_->name));
+        // non-blocking assignments see the values from before the edge
+        for (auto process : processes) execute(seq_processes_[process].stmts);
+        for (auto const &[target, value] : pending_) write(*target, value);
+        pending_.clear();
+    }
+    dirty_ = false;
+}
+
+void Simulator::poke(Var *var, uint64_t value) {
+    if (var->type() != VarType::Base && var->type() != VarType::PortIO)
+        throw VarException(::format("Cannot poke {0}", var->to_string()), {var});
+    auto index = net(var);
+    bool const is_trigger = trigger_nets_.find(index) != trigger_nets_.end();
+    // logic sensitive to this net has to see the values from before the edge
+    if (is_trigger && dirty_) update();
+    values_[index] = value & mask(var->width);
+    dirty_ = true;
+    if (is_trigger) update();
+}
+
+void Simulator::poke(const std::string &name, uint64_t value) { poke(get_var(name), value); }
+
+uint64_t Simulator::peek(Var *var) {
+    if (dirty_) update();
+    return eval(compile(var));
+}
+
+uint64_t Simulator::peek(const std::string &name) { return peek(get_var(name)); }
+
+void Simulator::step(Var *clock) {
+    poke(clock, 1);
+    poke(clock, 0);
+}
+
+void Simulator::step(const std::string &clock_name) { step(get_var(clock_name)); }
+
+void Simulator::step() {
+    std::vector<Var *> clocks;
+    for (auto const &port_name : top_->get_port_names()) {
+        auto port = top_->get_port(port_name);
+        if (port->port_type() == PortType::Clock) clocks.emplace_back(port.get());
+    }
+    if (clocks.size() != 1)
+        throw runtime_error(::format("{0} has {1} clock ports. Please specify the clock to step",
+                                     top_->name, clocks.size()));
+    step(clocks[0]);
+}
+
+Var *Simulator::get_var(const std::string &name) const {
+    auto generator = top_;
+    uint64_t start = 0;
+    for (auto pos = name.find('.'); pos != std::string::npos; pos = name.find('.', start)) {
+        auto const instance_name = name.substr(start, pos - start);
+        auto const &children = generator->get_child_generators();
+        auto iter = std::find_if(children.begin(), children.end(), [&](const auto &child) {
+            return child->instance_name == instance_name;
+        });
+        if (iter == children.end())
+            throw runtime_error(
+                ::format("{0} does not have child {1}", generator->name, instance_name));
+        generator = iter->get();
+        start = pos + 1;
+    }
+    auto var = generator->get_var(name.substr(start));
+    if (!var) throw runtime_error(::format("Unable to find {0} in {1}", name, top_->name));
+    return var.get();
+}
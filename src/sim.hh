@@ -0,0 +1,131 @@
+#ifndef KRATOS_SIM_HH
+#define KRATOS_SIM_HH
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "expr.hh"
+#include "stmt.hh"
+
+// 64-bit expression semantics shared by the simulator and constant folding. operands are
+// width bits wide and the result is truncated to result_width
+uint64_t eval_unary(ExprOp op, uint64_t value, uint32_t width);
+uint64_t eval_binary(ExprOp op, uint64_t a, uint64_t b, uint32_t width, bool left_signed,
+                     bool right_signed, uint32_t result_width);
+
+// cycle-based evaluator that runs directly on the generator IR. the hierarchy is flattened:
+// every var and port is a net whose value lives in a flat array. top level assignments and
+// combinational blocks are levelized once and re-evaluated in that order whenever an input
+// changes; sequential blocks run on the edges of their sensitivity list with non-blocking
+// assignments applied after all triggered blocks have run.
+// nets and expressions are limited to 64 bits and there is no X/Z, i.e. division by zero is 0
+class Simulator {
+public:
+    explicit Simulator(Generator *top);
+
+    void poke(Var *var, uint64_t value);
+    // names are relative to the top generator, e.g. "child.in" for a child port
+    void poke(const std::string &name, uint64_t value);
+    uint64_t peek(Var *var);
+    uint64_t peek(const std::string &name);
+
+    // one clock period: the clock goes high and then low again
+    void step(Var *clock);
+    void step(const std::string &clock_name);
+    // uses the only clock port of the top generator
+    void step();
+
+    Var *get_var(const std::string &name) const;
+    uint64_t num_nets() const { return values_.size(); }
+
+private:
+    friend class SimulationCodeGen;
+
+    struct Node {
+        enum Kind : uint8_t { Net, Constant, Unary, Binary, Slice, Concat };
+        Kind kind;
+        ExprOp op;
+        bool is_signed;
+        uint32_t width;
+        // net index or constant value
+        uint64_t value;
+        uint32_t low;
+        uint32_t left;
+        uint32_t right;
+        // concat operands, most significant first
+        std::vector<uint32_t> operands;
+    };
+
+    // part of a net written by an assignment. offset is the position in the assigned value
+    struct Segment {
+        uint32_t net;
+        uint32_t low;
+        uint32_t width;
+        uint32_t offset;
+    };
+
+    struct Statement {
+        enum Kind : uint8_t { Assign, If, Switch, Block };
+        Kind kind;
+        bool non_blocking;
+        // assigned segments, predicate or switch target
+        std::vector<Segment> target;
+        uint32_t expr;
+        std::vector<uint32_t> body;
+        std::vector<uint32_t> else_body;
+        std::vector<std::pair<uint64_t, std::vector<uint32_t>>> cases;
+        bool has_default;
+    };
+
+    struct Process {
+        std::vector<uint32_t> stmts;
+        std::unordered_set<uint32_t> reads;
+        std::unordered_set<uint32_t> writes;
+    };
+
+    struct Trigger {
+        uint32_t node;
+        BlockEdgeType edge;
+        uint32_t process;
+        bool last_value;
+    };
+
+    Generator *top_;
+
+    std::vector<uint64_t> values_;
+    std::unordered_map<const Var *, uint32_t> nets_;
+    std::vector<Node> nodes_;
+    std::unordered_map<const Var *, uint32_t> node_ids_;
+    std::vector<Statement> stmts_;
+
+    std::vector<Process> comb_processes_;
+    // levelized evaluation order of comb_processes_
+    std::vector<uint32_t> comb_order_;
+    // combinational loops are iterated until the values settle
+    bool has_loop_ = false;
+    std::vector<Process> seq_processes_;
+    std::vector<Trigger> triggers_;
+    std::unordered_set<uint32_t> trigger_nets_;
+
+    std::vector<std::pair<const std::vector<Segment> *, uint64_t>> pending_;
+    bool changed_ = false;
+    bool dirty_ = true;
+
+    void add_generator(Generator *generator);
+    uint32_t net(Var *var);
+    uint32_t compile(Var *var);
+    void compile_target(Var *var, uint32_t offset, std::vector<Segment> &target);
+    uint32_t compile(Stmt *stmt, bool sequential, Process &process);
+    void collect_nets(uint32_t node, std::unordered_set<uint32_t> &nets) const;
+    void levelize();
+
+    uint64_t eval(uint32_t node) const;
+    void write(const std::vector<Segment> &target, uint64_t value);
+    void execute(uint32_t stmt);
+    void execute(const std::vector<uint32_t> &stmts);
+    void settle();
+    void update();
+};
+
+#endif  // KRATOS_SIM_HH
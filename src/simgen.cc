@@ -0,0 +1,481 @@
+#include "simgen.hh"
+#include <fmt/format.h>
+#include <cctype>
+#include "generator.hh"
+
+using fmt::format;
+using std::runtime_error;
+
+std::string inline mask_str(uint32_t width) {
+    return ::format("0x{0:X}ull", width >= 64 ? ~0ull : (1ull << width) - 1);
+}
+
+// truncates an expression to width
+std::string inline masked(const std::string &expr, uint32_t width) {
+    return width >= 64 ? expr : ::format("(({0}) & {1})", expr, mask_str(width));
+}
+
+// helpers shared by all generated models. they mirror Simulator::eval
+constexpr char sim_helpers[] = R"(    static int64_t sext(uint64_t value, uint32_t width) {
+        if (width < 64 && ((value >> (width - 1)) & 1u)) value |= ~0ull << width;
+        return static_cast<int64_t>(value);
+    }
+    static uint64_t shl(uint64_t a, uint64_t b, uint32_t width) { return b >= width ? 0 : a << b; }
+    static uint64_t shr(uint64_t a, uint64_t b, uint32_t width) { return b >= width ? 0 : a >> b; }
+    static uint64_t ashr(uint64_t a, uint64_t b, uint32_t width) {
+        return static_cast<uint64_t>(sext(a, width) >> (b > 63 ? 63 : b));
+    }
+    static uint64_t div(uint64_t a, uint64_t b, uint32_t width, bool is_signed, bool is_mod) {
+        if (!b) return 0;
+        if (!is_signed) return is_mod ? a % b : a / b;
+        auto const sa = sext(a, width);
+        auto const sb = sext(b, width);
+        if (sb == -1) return is_mod ? 0 : ~a + 1;
+        return static_cast<uint64_t>(is_mod ? sa % sb : sa / sb);
+    }
+)";
+
+SimulationCodeGen::SimulationCodeGen(Generator *top, uint32_t lanes)
+    : sim_(top), top_(top), lanes_(lanes), stream_(top, nullptr) {
+    if (!lanes) throw runtime_error("lanes cannot be 0");
+    class_name_ = top->name + "_sim";
+    for (auto &c : class_name_) {
+        if (!std::isalnum(static_cast<unsigned char>(c))) c = '_';
+    }
+    for (auto const &process : sim_.seq_processes_) {
+        for (auto stmt : process.stmts) collect_non_blocking(stmt);
+    }
+    // committed in program order
+    std::sort(non_blocking_.begin(), non_blocking_.end());
+    net_widths_.resize(sim_.values_.size());
+    for (auto const &[var, net] : sim_.nets_) net_widths_[net] = var->width;
+
+    stream_ << "// simulation model of " << top->name << " generated by kratos" << stream_.endl()
+            << "#include <cstdint>" << stream_.endl() << "#include <cstring>" << stream_.endl()
+            << "#include <stdexcept>" << stream_.endl() << stream_.endl();
+    stream_ << "class " << class_name_ << " {" << stream_.endl() << "public:" << stream_.endl();
+    indent_++;
+    generate_interface();
+    indent_--;
+    stream_ << stream_.endl() << "private:" << stream_.endl();
+    indent_++;
+    generate_state();
+    stream_ << sim_helpers << stream_.endl();
+    generate_comb();
+    stream_ << stream_.endl();
+    generate_seq();
+    indent_--;
+    stream_ << "};" << stream_.endl();
+}
+
+const std::string &SimulationCodeGen::indent() {
+    while (indents_.size() <= indent_) indents_.emplace_back(indents_.size() * indent_size, ' ');
+    return indents_[indent_];
+}
+
+void SimulationCodeGen::generate_interface() {
+    auto const num_nets = sim_.values_.size();
+    auto const net_size = std::max<uint64_t>(num_nets, 1);
+    std::vector<std::string> names(num_nets);
+    for (auto const &[var, net] : sim_.nets_) names[net] = net_name(var);
+
+    stream_ << indent() << "static constexpr uint32_t lanes = " << std::to_string(lanes_) << ';'
+            << stream_.endl();
+    stream_ << indent() << "static constexpr uint32_t num_nets = " << std::to_string(num_nets)
+            << ';' << stream_.endl();
+    stream_ << indent() << "static constexpr uint32_t max_iterations = 1000;" << stream_.endl()
+            << stream_.endl();
+    stream_ << indent() << "// one value per lane for every net" << stream_.endl();
+    stream_ << indent() << "alignas(64) uint64_t values[" << std::to_string(net_size)
+            << "][lanes] = {};" << stream_.endl() << stream_.endl();
+
+    // the initial values are not edges
+    stream_ << indent() << class_name_ << "() {" << stream_.endl();
+    indent_++;
+    stream_ << indent() << "comb();" << stream_.endl();
+    if (!sim_.triggers_.empty()) {
+        stream_ << indent() << "for (uint32_t l = 0; l < lanes; l++) {" << stream_.endl();
+        indent_++;
+        for (uint64_t i = 0; i < sim_.triggers_.size(); i++) {
+            stream_ << indent() << "last_[" << std::to_string(i) << "][l] = "
+                    << expr_code(sim_.triggers_[i].node) << " & 1u;" << stream_.endl();
+        }
+        indent_--;
+        stream_ << indent() << '}' << stream_.endl();
+    }
+    indent_--;
+    stream_ << indent() << '}' << stream_.endl() << stream_.endl();
+
+    stream_ << indent() << "static const char *net_name(uint32_t net) {" << stream_.endl();
+    indent_++;
+    stream_ << indent() << "static const char *names[] = {";
+    for (uint64_t i = 0; i < names.size(); i++) {
+        if (i) stream_ << ", ";
+        stream_ << '"' << names[i] << '"';
+    }
+    if (names.empty()) stream_ << "nullptr";
+    stream_ << "};" << stream_.endl() << indent() << "return names[net];" << stream_.endl();
+    indent_--;
+    stream_ << indent() << '}' << stream_.endl() << stream_.endl();
+
+    stream_ << indent() << "// -1 if there is no such net" << stream_.endl();
+    stream_ << indent() << "static int32_t net_index(const char *name) {" << stream_.endl();
+    indent_++;
+    stream_ << indent() << "for (uint32_t i = 0; i < num_nets; i++) {" << stream_.endl();
+    stream_ << indent() << "    if (std::strcmp(net_name(i), name) == 0) "
+            << "return static_cast<int32_t>(i);" << stream_.endl();
+    stream_ << indent() << '}' << stream_.endl() << indent() << "return -1;" << stream_.endl();
+    indent_--;
+    stream_ << indent() << '}' << stream_.endl() << stream_.endl();
+
+    stream_ << indent() << "// settles the combinational logic and runs the sequential logic on "
+            << "the edges" << stream_.endl();
+    stream_ << indent() << "void eval() {" << stream_.endl();
+    indent_++;
+    stream_ << indent() << "for (uint32_t i = 0; i < max_iterations; i++) {" << stream_.endl();
+    stream_ << indent() << "    comb();" << stream_.endl();
+    stream_ << indent() << "    if (!seq()) return;" << stream_.endl();
+    stream_ << indent() << '}' << stream_.endl();
+    stream_ << indent() << "throw std::runtime_error(\"" << top_->name
+            << " does not settle\");" << stream_.endl();
+    indent_--;
+    stream_ << indent() << '}' << stream_.endl() << stream_.endl();
+
+    stream_ << indent() << "// one clock period on every lane" << stream_.endl();
+    stream_ << indent() << "void step(uint32_t clock) {" << stream_.endl();
+    indent_++;
+    stream_ << indent() << "eval();" << stream_.endl();
+    stream_ << indent() << "for (auto &value : values[clock]) value = 1;" << stream_.endl();
+    stream_ << indent() << "eval();" << stream_.endl();
+    stream_ << indent() << "for (auto &value : values[clock]) value = 0;" << stream_.endl();
+    stream_ << indent() << "eval();" << stream_.endl();
+    indent_--;
+    stream_ << indent() << '}' << stream_.endl();
+}
+
+void SimulationCodeGen::generate_state() {
+    // zero-sized arrays are not allowed
+    auto const net_size = std::max<uint64_t>(sim_.values_.size(), 1);
+    auto const trigger_size = std::max<uint64_t>(sim_.triggers_.size(), 1);
+    stream_ << indent() << "// trigger values from the last evaluation, used to detect edges"
+            << stream_.endl();
+    stream_ << indent() << "uint64_t last_[" << std::to_string(trigger_size) << "][lanes] = {};"
+            << stream_.endl();
+    if (sim_.has_loop_) {
+        stream_ << indent() << "uint64_t previous_[" << std::to_string(net_size) << "][lanes];"
+                << stream_.endl();
+    }
+    stream_ << stream_.endl();
+}
+
+void SimulationCodeGen::generate_comb() {
+    // processes in a loop are iterated until the values settle
+    auto const name = sim_.has_loop_ ? "comb_once" : "comb";
+    stream_ << indent() << "void " << name << "() {" << stream_.endl();
+    indent_++;
+    for (auto process : sim_.comb_order_) {
+        // one loop per process, which keeps the loop bodies small enough to be vectorized
+        stream_ << indent() << "for (uint32_t l = 0; l < lanes; l++) {" << stream_.endl();
+        indent_++;
+        for (auto stmt : sim_.comb_processes_[process].stmts) dispatch_node(stmt);
+        indent_--;
+        stream_ << indent() << '}' << stream_.endl();
+    }
+    indent_--;
+    stream_ << indent() << '}' << stream_.endl();
+
+    if (sim_.has_loop_) {
+        stream_ << stream_.endl() << indent() << "void comb() {" << stream_.endl();
+        indent_++;
+        stream_ << indent() << "for (uint32_t i = 0; i < max_iterations; i++) {" << stream_.endl();
+        stream_ << indent() << "    std::memcpy(previous_, values, sizeof(values));"
+                << stream_.endl();
+        stream_ << indent() << "    comb_once();" << stream_.endl();
+        stream_ << indent() << "    if (std::memcmp(previous_, values, sizeof(values)) == 0) "
+                << "return;" << stream_.endl();
+        stream_ << indent() << '}' << stream_.endl();
+        stream_ << indent() << "throw std::runtime_error(\"Combinational logic in " << top_->name
+                << " does not settle\");" << stream_.endl();
+        indent_--;
+        stream_ << indent() << '}' << stream_.endl();
+    }
+}
+
+void SimulationCodeGen::generate_seq() {
+    stream_ << indent() << "bool seq() {" << stream_.endl();
+    indent_++;
+    auto const &processes = sim_.seq_processes_;
+    if (processes.empty()) {
+        stream_ << indent() << "return false;" << stream_.endl();
+        indent_--;
+        stream_ << indent() << '}' << stream_.endl();
+        return;
+    }
+    stream_ << indent() << "bool fired = false;" << stream_.endl();
+    stream_ << indent() << "for (uint32_t l = 0; l < lanes; l++) {" << stream_.endl();
+    indent_++;
+    stream_ << indent() << "bool fire[" << std::to_string(processes.size()) << "] = {};"
+            << stream_.endl();
+    for (uint64_t i = 0; i < sim_.triggers_.size(); i++) {
+        auto const &trigger = sim_.triggers_[i];
+        auto const last = ::format("last_[{0}][l]", i);
+        stream_ << indent() << "{" << stream_.endl();
+        indent_++;
+        stream_ << indent() << "uint64_t value = " << expr_code(trigger.node) << " & 1u;"
+                << stream_.endl();
+        if (trigger.edge == BlockEdgeType::Posedge)
+            stream_ << indent() << "if (!" << last << " && value) ";
+        else
+            stream_ << indent() << "if (" << last << " && !value) ";
+        stream_ << "fire[" << std::to_string(trigger.process) << "] = true;" << stream_.endl();
+        stream_ << indent() << last << " = value;" << stream_.endl();
+        indent_--;
+        stream_ << indent() << '}' << stream_.endl();
+    }
+    stream_ << indent() << "bool any = false;" << stream_.endl();
+    stream_ << indent() << "for (auto f : fire) any |= f;" << stream_.endl();
+    stream_ << indent() << "if (!any) continue;" << stream_.endl();
+    stream_ << indent() << "fired = true;" << stream_.endl();
+
+    // non-blocking assignments see the values from before the edge
+    for (auto stmt : non_blocking_) {
+        stream_ << indent() << "uint64_t nb" << std::to_string(stmt) << " = 0;" << stream_.endl();
+        stream_ << indent() << "bool nb" << std::to_string(stmt) << "_set = false;"
+                << stream_.endl();
+    }
+    for (uint64_t i = 0; i < processes.size(); i++) {
+        stream_ << indent() << "if (fire[" << std::to_string(i) << "]) {" << stream_.endl();
+        indent_++;
+        for (auto stmt : processes[i].stmts) dispatch_node(stmt);
+        indent_--;
+        stream_ << indent() << '}' << stream_.endl();
+    }
+    for (auto stmt : non_blocking_) {
+        auto const nb = ::format("nb{0}", stmt);
+        stream_ << indent() << "if (" << nb << "_set) {" << stream_.endl();
+        indent_++;
+        auto const &s = sim_.stmts_[stmt];
+        write_code(s.target, nb, sim_.nodes_[s.expr].width);
+        indent_--;
+        stream_ << indent() << '}' << stream_.endl();
+    }
+    indent_--;
+    stream_ << indent() << '}' << stream_.endl();
+    stream_ << indent() << "return fired;" << stream_.endl();
+    indent_--;
+    stream_ << indent() << '}' << stream_.endl();
+}
+
+void SimulationCodeGen::collect_non_blocking(uint32_t stmt) {
+    auto const &s = sim_.stmts_[stmt];
+    if (s.kind == Simulator::Statement::Assign) {
+        if (s.non_blocking) non_blocking_.emplace_back(stmt);
+        return;
+    }
+    for (auto child : s.body) collect_non_blocking(child);
+    for (auto const &c : s.cases) {
+        for (auto child : c.second) collect_non_blocking(child);
+    }
+    for (auto child : s.else_body) collect_non_blocking(child);
+}
+
+void SimulationCodeGen::dispatch_node(uint32_t stmt) { stmt_code(sim_.stmts_[stmt], stmt); }
+
+void SimulationCodeGen::stmt_code(const Simulator::Statement &stmt, uint32_t index) {
+    switch (stmt.kind) {
+        case Simulator::Statement::Assign: {
+            if (stmt.non_blocking) {
+                stream_ << indent() << "nb" << std::to_string(index) << " = "
+                        << expr_code(stmt.expr) << ';' << stream_.endl();
+                stream_ << indent() << "nb" << std::to_string(index) << "_set = true;"
+                        << stream_.endl();
+            } else {
+                write_code(stmt.target, expr_code(stmt.expr), sim_.nodes_[stmt.expr].width);
+            }
+            break;
+        }
+        case Simulator::Statement::If: {
+            stream_ << indent() << "if (" << expr_code(stmt.expr) << ") {" << stream_.endl();
+            indent_++;
+            for (auto child : stmt.body) dispatch_node(child);
+            indent_--;
+            if (!stmt.else_body.empty()) {
+                stream_ << indent() << "} else {" << stream_.endl();
+                indent_++;
+                for (auto child : stmt.else_body) dispatch_node(child);
+                indent_--;
+            }
+            stream_ << indent() << '}' << stream_.endl();
+            break;
+        }
+        case Simulator::Statement::Switch: {
+            auto const target = ::format("s{0}", index);
+            stream_ << indent() << "{" << stream_.endl();
+            indent_++;
+            stream_ << indent() << "uint64_t " << target << " = " << expr_code(stmt.expr) << ';'
+                    << stream_.endl();
+            stream_ << indent();
+            for (auto const &[value, body] : stmt.cases) {
+                stream_ << "if (" << target << " == " << ::format("0x{0:X}ull", value) << ") {"
+                        << stream_.endl();
+                indent_++;
+                for (auto child : body) dispatch_node(child);
+                indent_--;
+                stream_ << indent() << "} else ";
+            }
+            stream_ << "{" << stream_.endl();
+            indent_++;
+            if (stmt.has_default) {
+                for (auto child : stmt.else_body) dispatch_node(child);
+            }
+            indent_--;
+            stream_ << indent() << '}' << stream_.endl();
+            indent_--;
+            stream_ << indent() << '}' << stream_.endl();
+            break;
+        }
+        case Simulator::Statement::Block: {
+            for (auto child : stmt.body) dispatch_node(child);
+            break;
+        }
+    }
+}
+
+void SimulationCodeGen::write_code(const std::vector<Simulator::Segment> &target,
+                                   const std::string &value, uint32_t width) {
+    // whole net
+    if (target.size() == 1 && target[0].low == 0 && target[0].offset == 0 &&
+        target[0].width == net_widths_[target[0].net]) {
+        auto const &segment = target[0];
+        stream_ << indent() << net_code(segment.net) << " = "
+                << (width > segment.width ? masked(value, segment.width) : value) << ';'
+                << stream_.endl();
+        return;
+    }
+    stream_ << indent() << "{" << stream_.endl();
+    indent_++;
+    stream_ << indent() << "uint64_t value = " << value << ';' << stream_.endl();
+    for (auto const &segment : target) {
+        auto const net = net_code(segment.net);
+        auto const mask = mask_str(segment.width);
+        stream_ << indent() << net << " = (" << net << " & ~(" << mask << " << "
+                << std::to_string(segment.low) << ")) | (((value >> "
+                << std::to_string(segment.offset) << ") & " << mask << ") << "
+                << std::to_string(segment.low) << ");" << stream_.endl();
+    }
+    indent_--;
+    stream_ << indent() << '}' << stream_.endl();
+}
+
+std::string SimulationCodeGen::net_code(uint64_t net) const {
+    return ::format("values[{0}][l]", net);
+}
+
+std::string SimulationCodeGen::net_name(const Var *var) const {
+    auto name = var->name;
+    for (auto generator = var->generator; generator && generator != top_;
+         generator = static_cast<Generator *>(generator->parent())) {
+        name = generator->instance_name + "." + name;
+    }
+    return name;
+}
+
+std::string SimulationCodeGen::expr_code(uint32_t node) const {
+    auto const &n = sim_.nodes_[node];
+    switch (n.kind) {
+        case Simulator::Node::Net:
+            return net_code(n.value);
+        case Simulator::Node::Constant:
+            return ::format("0x{0:X}ull", n.value & (n.width >= 64 ? ~0ull : (1ull << n.width) - 1));
+        case Simulator::Node::Slice: {
+            auto const &parent = sim_.nodes_[n.left];
+            if (!n.low && n.width == parent.width) return expr_code(n.left);
+            return masked(::format("{0} >> {1}", expr_code(n.left), n.low), n.width);
+        }
+        case Simulator::Node::Concat: {
+            std::string result = "(";
+            uint32_t shift = n.width;
+            for (uint64_t i = 0; i < n.operands.size(); i++) {
+                auto const operand = n.operands[i];
+                shift -= sim_.nodes_[operand].width;
+                if (i) result.append(" | ");
+                if (shift)
+                    result.append(::format("({0} << {1})", expr_code(operand), shift));
+                else
+                    result.append(expr_code(operand));
+            }
+            result.append(")");
+            return result;
+        }
+        case Simulator::Node::Unary: {
+            auto const value = expr_code(n.left);
+            switch (n.op) {
+                case ExprOp::UInvert:
+                    return masked("~" + value, n.width);
+                case ExprOp::UMinus:
+                case ExprOp::Minus:
+                    return masked("0ull - " + value, n.width);
+                default:
+                    return value;
+            }
+        }
+        case Simulator::Node::Binary: {
+            auto const &left = sim_.nodes_[n.left];
+            auto const &right = sim_.nodes_[n.right];
+            auto const a = expr_code(n.left);
+            auto const b = expr_code(n.right);
+            auto const width = left.width;
+            auto const is_signed = left.is_signed && right.is_signed;
+            auto const compare = [&](const char *op) {
+                if (is_signed)
+                    return ::format("static_cast<uint64_t>(sext({0}, {2}) {1} sext({3}, {2}))", a,
+                                    op, width, b);
+                return ::format("static_cast<uint64_t>({0} {1} {2})", a, op, b);
+            };
+            switch (n.op) {
+                case ExprOp::Add:
+                    return masked(::format("{0} + {1}", a, b), n.width);
+                case ExprOp::Minus:
+                    return masked(::format("{0} - {1}", a, b), n.width);
+                case ExprOp::Multiply:
+                    return masked(::format("{0} * {1}", a, b), n.width);
+                case ExprOp::Divide:
+                case ExprOp::Mod:
+                    return masked(::format("div({0}, {1}, {2}, {3}, {4})", a, b, width,
+                                           is_signed ? "true" : "false",
+                                           n.op == ExprOp::Mod ? "true" : "false"),
+                                  n.width);
+                case ExprOp::LogicalShiftRight:
+                    return ::format("shr({0}, {1}, {2})", a, b, width);
+                case ExprOp::SignedShiftRight:
+                    if (left.is_signed)
+                        return masked(::format("ashr({0}, {1}, {2})", a, b, width), n.width);
+                    return ::format("shr({0}, {1}, {2})", a, b, width);
+                case ExprOp::ShiftLeft:
+                    return masked(::format("shl({0}, {1}, {2})", a, b, width), n.width);
+                case ExprOp::Or:
+                    return ::format("({0} | {1})", a, b);
+                case ExprOp::And:
+                    return ::format("({0} & {1})", a, b);
+                case ExprOp::Xor:
+                    return ::format("({0} ^ {1})", a, b);
+                case ExprOp::LessThan:
+                    return compare("<");
+                case ExprOp::GreaterThan:
+                    return compare(">");
+                case ExprOp::LessEqThan:
+                    return compare("<=");
+                case ExprOp::GreaterEqThan:
+                    return compare(">=");
+                case ExprOp::Eq:
+                    return ::format("static_cast<uint64_t>({0} == {1})", a, b);
+                case ExprOp::Neq:
+                    return ::format("static_cast<uint64_t>({0} != {1})", a, b);
+                default:
+                    throw runtime_error(
+                        ::format("Unsupported binary op {0}", static_cast<uint64_t>(n.op)));
+            }
+        }
+    }
+    return "";
+}
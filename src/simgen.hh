@@ -0,0 +1,51 @@
+#ifndef KRATOS_SIMGEN_HH
+#define KRATOS_SIMGEN_HH
+
+#include "codegen.hh"
+#include "sim.hh"
+
+// lowers the design to a standalone C++ class that evaluates many independent stimulus
+// vectors per call. every net is stored as an array with one value per lane, and each
+// combinational process becomes a loop over the lanes so the compiler can vectorize it.
+// the semantics, including the 64-bit limit, are the same as Simulator, whose levelized
+// program is what gets emitted
+class SimulationCodeGen {
+public:
+    SimulationCodeGen(Generator *top, uint32_t lanes);
+    explicit SimulationCodeGen(Generator *top) : SimulationCodeGen(top, 64) {}
+    std::string str() const { return stream_.str(); }
+    const std::string &class_name() const { return class_name_; }
+
+    uint32_t indent_size = 4;
+
+    const std::string &indent();
+
+private:
+    Simulator sim_;
+    Generator *top_;
+    uint32_t lanes_;
+    std::string class_name_;
+    uint32_t indent_ = 0;
+    std::vector<std::string> indents_;
+    Stream stream_;
+    // statements with non-blocking assignments, which get a local in the sequential update
+    std::vector<uint32_t> non_blocking_;
+    std::vector<uint32_t> net_widths_;
+
+    void generate_interface();
+    void generate_state();
+    void generate_comb();
+    void generate_seq();
+
+    void dispatch_node(uint32_t stmt);
+    void stmt_code(const Simulator::Statement &stmt, uint32_t index);
+    void write_code(const std::vector<Simulator::Segment> &target, const std::string &value,
+                    uint32_t width);
+    void collect_non_blocking(uint32_t stmt);
+
+    std::string expr_code(uint32_t node) const;
+    std::string net_code(uint64_t net) const;
+    std::string net_name(const Var *var) const;
+};
+
+#endif  // KRATOS_SIMGEN_HH
@@ -12,6 +12,14 @@ using std::runtime_error;
 
 ASTNode *Stmt::parent() { return parent_; }
 
+// nested statements are only reachable through their block, so the owning generator has to be
+// marked explicitly. statements that are not attached yet are marked once they get added
+void inline mark_generator_dirty(ASTNode *node) {
+    while (node != nullptr && node->ast_node_kind() != ASTNodeKind::GeneratorKind)
+        node = node->parent();
+    if (node) static_cast<Generator *>(node)->mark_dirty();
+}
+
 AssignStmt::AssignStmt(const std::shared_ptr<Var> &left, const std::shared_ptr<Var> &right)
     : AssignStmt(left, right, AssignmentType::Undefined) {}
 
@@ -34,6 +42,21 @@ AssignStmt::AssignStmt(const std::shared_ptr<Var> &left, const std::shared_ptr<V
     }
 }
 
+void AssignStmt::set_assign_type(AssignmentType assign_type) {
+    assign_type_ = assign_type;
+    mark_generator_dirty(this);
+}
+
+void AssignStmt::set_left(const std::shared_ptr<Var> &left) {
+    left_ = left;
+    mark_generator_dirty(this);
+}
+
+void AssignStmt::set_right(const std::shared_ptr<Var> &right) {
+    right_ = right;
+    mark_generator_dirty(this);
+}
+
 bool AssignStmt::equal(const std::shared_ptr<AssignStmt> &stmt) const {
     return left_ == stmt->left_ && right_ == stmt->right_;
 }
@@ -59,6 +82,7 @@ void IfStmt::add_then_stmt(const std::shared_ptr<Stmt> &stmt) {
         throw ::runtime_error("cannot add statement block to the if statement body");
     stmt->set_parent(this);
     then_body_.emplace_back(stmt);
+    mark_generator_dirty(this);
 }
 
 void IfStmt::add_else_stmt(const std::shared_ptr<Stmt> &stmt) {
@@ -66,6 +90,24 @@ void IfStmt::add_else_stmt(const std::shared_ptr<Stmt> &stmt) {
         throw ::runtime_error("cannot add statement block to the if statement body");
     stmt->set_parent(this);
     else_body_.emplace_back(stmt);
+    mark_generator_dirty(this);
+}
+
+void IfStmt::set_predicate(const std::shared_ptr<Var> &predicate) {
+    predicate_ = predicate;
+    mark_generator_dirty(this);
+}
+
+void IfStmt::set_then_body(const std::vector<std::shared_ptr<Stmt>> &stmts) {
+    then_body_.clear();
+    for (auto const &stmt : stmts) add_then_stmt(stmt);
+    mark_generator_dirty(this);
+}
+
+void IfStmt::set_else_body(const std::vector<std::shared_ptr<Stmt>> &stmts) {
+    else_body_.clear();
+    for (auto const &stmt : stmts) add_else_stmt(stmt);
+    mark_generator_dirty(this);
 }
 
 ASTNode *IfStmt::get_child(uint64_t index) {
@@ -106,10 +148,20 @@ void StmtBlock::add_statement(const std::shared_ptr<Stmt> &stmt) {
     }
     stmt->set_parent(this);
     stmts_.emplace_back(stmt);
+    mark_generator_dirty(this);
 }
 
 void StmtBlock::set_child(uint64_t index, const std::shared_ptr<Stmt> &stmt) {
-    if (index < stmts_.size()) stmts_[index] = stmt;
+    if (index < stmts_.size()) {
+        stmts_[index] = stmt;
+        mark_generator_dirty(this);
+    }
+}
+
+void StmtBlock::set_statements(const std::vector<std::shared_ptr<Stmt>> &stmts) {
+    for (auto const &stmt : stmts) stmt->set_parent(this);
+    stmts_ = stmts;
+    mark_generator_dirty(this);
 }
 
 void SequentialStmtBlock::add_condition(
@@ -124,6 +176,7 @@ void SequentialStmtBlock::add_condition(
             "only clock and async reset allowed to use as sequential block condition");
     }
     conditions_.emplace(condition);
+    mark_generator_dirty(this);
 }
 
 SwitchStmt::SwitchStmt(const std::shared_ptr<Var> &target)
@@ -141,6 +194,7 @@ void SwitchStmt::add_switch_case(const std::shared_ptr<Const> &switch_case,
         throw ::runtime_error(::format("statement already exists in switch body with case {0}",
                                        switch_case->to_string()));
     body_[switch_case].emplace_back(stmt);
+    mark_generator_dirty(this);
 }
 
 void SwitchStmt::add_switch_case(const std::shared_ptr<Const> &switch_case,
@@ -148,6 +202,20 @@ void SwitchStmt::add_switch_case(const std::shared_ptr<Const> &switch_case,
     for (auto &stmt : stmts) add_switch_case(switch_case, stmt);
 }
 
+void SwitchStmt::set_target(const std::shared_ptr<Var> &target) {
+    if (target->type() == VarType::ConstValue)
+        throw ::runtime_error(::format("switch target cannot be const value {0}", target->name));
+    target_ = target;
+    mark_generator_dirty(this);
+}
+
+void SwitchStmt::set_switch_case(const std::shared_ptr<Const> &switch_case,
+                                 const std::vector<std::shared_ptr<Stmt>> &stmts) {
+    body_[switch_case].clear();
+    add_switch_case(switch_case, stmts);
+    mark_generator_dirty(this);
+}
+
 uint64_t SwitchStmt::child_count() {
     uint64_t i = 1;  // 1 for target
     for (auto const &iter : body_) {
@@ -170,10 +238,9 @@ ASTNode *SwitchStmt::get_child(uint64_t index) {
     }
 }
 
-std::unordered_set<std::shared_ptr<AssignStmt>> filter_assignments_with_target(
-    const std::unordered_set<std::shared_ptr<AssignStmt>> &stmts, const Generator *target,
-    bool lhs) {
-    std::unordered_set<std::shared_ptr<AssignStmt>> result;
+AssignStmtSet filter_assignments_with_target(const AssignStmtSet &stmts, const Generator *target,
+                                             bool lhs) {
+    AssignStmtSet result;
     for (const auto &stmt : stmts) {
         if (lhs) {
             if (stmt->left()->generator == target) result.emplace(stmt);
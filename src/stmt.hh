@@ -39,13 +39,14 @@ public:
                AssignmentType type);
 
     AssignmentType assign_type() const { return assign_type_; }
-    void set_assign_type(AssignmentType assign_type) { assign_type_ = assign_type; }
+    // the setters mark the owning generator dirty
+    void set_assign_type(AssignmentType assign_type);
 
     const std::shared_ptr<Var> left() const { return left_; }
     const std::shared_ptr<Var> right() const { return right_; }
 
-    void set_left(const std::shared_ptr<Var> &left) { left_ = left; }
-    void set_right(const std::shared_ptr<Var> &right) { right_ = right; }
+    void set_left(const std::shared_ptr<Var> &left);
+    void set_right(const std::shared_ptr<Var> &right);
 
     bool equal(const std::shared_ptr<AssignStmt> &stmt) const;
     bool operator==(const AssignStmt &stmt) const;
@@ -74,6 +75,10 @@ public:
     void add_then_stmt(Stmt &stmt) { add_then_stmt(stmt.shared_from_this()); }
     void add_else_stmt(const std::shared_ptr<Stmt> &stmt);
     void add_else_stmt(Stmt &stmt) { add_else_stmt(stmt.shared_from_this()); }
+    // used by passes that rewrite the body in place
+    void set_predicate(const std::shared_ptr<Var> &predicate);
+    void set_then_body(const std::vector<std::shared_ptr<Stmt>> &stmts);
+    void set_else_body(const std::vector<std::shared_ptr<Stmt>> &stmts);
 
     // AST stuff
     void accept(ASTVisitor *visitor) override { visitor->visit(this); }
@@ -95,8 +100,12 @@ public:
 
     void add_switch_case(const std::shared_ptr<Const> &switch_case,
                          const std::vector<std::shared_ptr<Stmt>> &stmts);
+    // replaces the body of an existing case. an empty body keeps the case
+    void set_switch_case(const std::shared_ptr<Const> &switch_case,
+                         const std::vector<std::shared_ptr<Stmt>> &stmts);
 
     const std::shared_ptr<Var> target() const { return target_; }
+    void set_target(const std::shared_ptr<Var> &target);
 
     const std::map<std::shared_ptr<Const>, std::vector<std::shared_ptr<Stmt>>> &body() const {
         return body_;
@@ -126,6 +135,8 @@ public:
     }
 
     void set_child(uint64_t index, const std::shared_ptr<Stmt> &stmt);
+    // replaces all the statements. the statements are not checked again
+    void set_statements(const std::vector<std::shared_ptr<Stmt>> &stmts);
 
 protected:
     explicit StmtBlock(StatementBlockType type);
@@ -0,0 +1,292 @@
+#include <sys/resource.h>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include "../src/codegen.hh"
+#include "../src/expr.hh"
+#include "../src/generator.hh"
+#include "../src/pass.hh"
+#include "../src/port.hh"
+#include "../src/stmt.hh"
+#include "fmt/format.h"
+
+// synthetic large-design benchmark
+// usage: kratos_bench [scale] [design_name]
+// each design is built through the C++ API and then pushed through the same pass
+// sequence as VerilogModule::run_passes, followed by generate_verilog
+
+using fmt::format;
+
+constexpr uint32_t DATA_WIDTH = 16;
+
+// count the heap allocations of profiled passes. the library only counts IR nodes served from
+// its arenas and leaves the global allocator alone
+void* operator new(std::size_t size) {
+    if (allocation_tracking()) count_allocation(size);
+    if (size == 0) size = 1;
+    while (true) {
+        auto ptr = std::malloc(size);
+        if (ptr) return ptr;
+        auto handler = std::get_new_handler();
+        if (!handler) throw std::bad_alloc();
+        handler();
+    }
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+
+// peak resident set size in MB
+double peak_rss() {
+    struct rusage usage {};
+    getrusage(RUSAGE_SELF, &usage);
+    // linux reports ru_maxrss in KB
+    return static_cast<double>(usage.ru_maxrss) / 1024;
+}
+
+void report_header() {
+    std::cout << format(
+                     "{0:<16} {1:<32} {2:>10} {3:>10} {4:>10} {5:>10} {6:>8} {7:>8} {8:>8} {9:>8}",
+                     "design", "stage", "wall (ms)", "cpu (ms)", "allocs", "peak (MB)", "gens",
+                     "vars", "stmts", "exprs")
+              << std::endl;
+}
+
+void report(const std::string& design, const PassProfile& entry, double rss) {
+    auto const& count = entry.nodes_after;
+    std::cout << format("{0:<16} {1:<32} {2:>10.2f} {3:>10.2f} {4:>10} {5:>10.2f} {6:>8} {7:>8} "
+                        "{8:>8} {9:>8}",
+                        design, entry.name, entry.wall_time, entry.cpu_time, entry.num_allocations,
+                        rss, count.generators, count.vars, count.stmts, count.exprs)
+              << std::endl;
+}
+
+void report(const std::string& design, const std::string& stage, double ms, Generator* top) {
+    PassProfile entry;
+    entry.name = stage;
+    entry.wall_time = ms;
+    entry.nodes_after = count_ir_nodes(top);
+    report(design, entry, peak_rss());
+}
+
+template <typename Fn>
+double time_ms(Fn fn) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+// processing element with a register, an if-else chain and an optional constant offset.
+// generators built with the same offset are identical; different offsets produce
+// near-identical generators that share a name and have to be uniquified
+Generator& make_pe(Context& c, int64_t offset) {
+    auto& pe = c.generator("pe");
+    auto& clk = pe.port(PortDirection::In, "clk", 1, PortType::Clock, false);
+    auto& cfg = pe.port(PortDirection::In, "cfg", 2);
+    auto& in_w = pe.port(PortDirection::In, "in_w", DATA_WIDTH);
+    auto& in_n = pe.port(PortDirection::In, "in_n", DATA_WIDTH);
+    auto& out = pe.port(PortDirection::Out, "out", DATA_WIDTH);
+
+    auto& sum = pe.var("sum", DATA_WIDTH);
+    auto& value = pe.var("value", DATA_WIDTH);
+    auto& reg = pe.var("reg", DATA_WIDTH);
+
+    pe.add_stmt(sum.assign(in_w + in_n).shared_from_this());
+
+    auto comb = pe.combinational();
+    auto if_0 = std::make_shared<IfStmt>(cfg.eq(pe.constant(0, 2)));
+    auto if_1 = std::make_shared<IfStmt>(cfg.eq(pe.constant(1, 2)));
+    auto if_2 = std::make_shared<IfStmt>(cfg.eq(pe.constant(2, 2)));
+    if_0->add_then_stmt(value.assign(in_w));
+    if_1->add_then_stmt(value.assign(in_n));
+    if_2->add_then_stmt(value.assign(sum));
+    if_2->add_else_stmt(value.assign(sum + pe.constant(offset, DATA_WIDTH)));
+    if_1->add_else_stmt(if_2);
+    if_0->add_else_stmt(if_1);
+    comb->add_statement(if_0);
+
+    auto seq = pe.sequential();
+    seq->add_condition({BlockEdgeType::Posedge, clk.shared_from_this()});
+    seq->add_statement(reg.assign(value));
+
+    pe.add_stmt(out.assign(reg).shared_from_this());
+    return pe;
+}
+
+// rows x cols mesh of PEs. clk and cfg fan out to every PE, data flows east and south
+Generator& make_mesh(Context& c, uint32_t rows, uint32_t cols, uint32_t num_variants) {
+    auto& top = c.generator("mesh");
+    auto& clk = top.port(PortDirection::In, "clk", 1, PortType::Clock, false);
+    auto& cfg = top.port(PortDirection::In, "cfg", 2);
+    std::vector<std::vector<Generator*>> pes(rows, std::vector<Generator*>(cols, nullptr));
+    for (uint32_t r = 0; r < rows; r++) {
+        for (uint32_t c_ = 0; c_ < cols; c_++) {
+            auto offset = num_variants ? (r * cols + c_) % num_variants : 0;
+            auto& pe = make_pe(c, offset);
+            pe.instance_name = format("pe_{0}_{1}", r, c_);
+            top.add_child_generator(pe.shared_from_this());
+            pes[r][c_] = &pe;
+            top.add_stmt(pe.get_port("clk")->assign(clk).shared_from_this());
+            top.add_stmt(pe.get_port("cfg")->assign(cfg).shared_from_this());
+        }
+    }
+    for (uint32_t r = 0; r < rows; r++) {
+        auto& in = top.port(PortDirection::In, format("in_row_{0}", r), DATA_WIDTH);
+        auto& out = top.port(PortDirection::Out, format("out_row_{0}", r), DATA_WIDTH);
+        for (uint32_t c_ = 0; c_ < cols; c_++) {
+            auto pe = pes[r][c_];
+            auto in_w = pe->get_port("in_w");
+            auto in_n = pe->get_port("in_n");
+            if (c_ == 0)
+                top.add_stmt(in_w->assign(in).shared_from_this());
+            else
+                top.add_stmt(in_w->assign(pes[r][c_ - 1]->get_port("out")).shared_from_this());
+            if (r == 0)
+                top.add_stmt(in_n->assign(in).shared_from_this());
+            else
+                top.add_stmt(in_n->assign(pes[r - 1][c_]->get_port("out")).shared_from_this());
+        }
+        top.add_stmt(out.assign(pes[r][cols - 1]->get_port("out")).shared_from_this());
+    }
+    return top;
+}
+
+// a chain of depth unique generators, each wrapping the next one
+Generator& make_deep(Context& c, uint32_t depth) {
+    std::vector<Generator*> levels;
+    levels.reserve(depth);
+    for (uint32_t i = 0; i < depth; i++) {
+        auto& gen = c.generator(format("deep_{0}", i));
+        gen.port(PortDirection::In, "in", DATA_WIDTH);
+        gen.port(PortDirection::Out, "out", DATA_WIDTH);
+        levels.emplace_back(&gen);
+    }
+    for (uint32_t i = 0; i < depth; i++) {
+        auto gen = levels[i];
+        auto in = gen->get_port("in");
+        auto out = gen->get_port("out");
+        auto& tmp = gen->var("tmp", DATA_WIDTH);
+        gen->add_stmt(tmp.assign(*in + gen->constant(i % 256, DATA_WIDTH)).shared_from_this());
+        if (i == depth - 1) {
+            gen->add_stmt(out->assign(tmp).shared_from_this());
+        } else {
+            auto child = levels[i + 1];
+            gen->add_child_generator(child->shared_from_this());
+            gen->add_stmt(child->get_port("in")->assign(tmp).shared_from_this());
+            gen->add_stmt(out->assign(child->get_port("out")).shared_from_this());
+        }
+    }
+    return *levels[0];
+}
+
+// one generator with a long left-leaning expression chain over a handful of inputs
+Generator& make_expr_chain(Context& c, uint32_t length) {
+    constexpr uint32_t num_inputs = 8;
+    auto& gen = c.generator("expr_chain");
+    std::vector<Port*> inputs;
+    for (uint32_t i = 0; i < num_inputs; i++) {
+        inputs.emplace_back(&gen.port(PortDirection::In, format("in_{0}", i), DATA_WIDTH));
+    }
+    auto& out = gen.port(PortDirection::Out, "out", DATA_WIDTH);
+    Var* acc = inputs[0];
+    for (uint32_t i = 1; i < length; i++) {
+        auto& right = *inputs[i % num_inputs];
+        acc = (i % 3 == 0) ? &(*acc ^ right) : &(*acc + right);
+    }
+    gen.add_stmt(out.assign(*acc).shared_from_this());
+    return gen;
+}
+
+void run_design(const std::string& design, Generator& top) {
+    // same order as VerilogModule::run_passes with every optional pass and parallelism turned on
+    std::vector<std::pair<std::string, std::function<void(Generator*)>>> passes = {
+        {"remove_pass_through_modules", &remove_pass_through_modules},
+        {"transform_if_to_case", &transform_if_to_case},
+        {"fix_assignment_type",
+         [](Generator* generator) {
+             parallel_generator_pass(generator, &fix_assignment_type_generator);
+         }},
+        {"zero_out_stubs",
+         [](Generator* generator) {
+             parallel_generator_pass(generator, &zero_out_stub_generator);
+         }},
+        {"remove_fanout_one_wires", &remove_fanout_one_wires},
+        {"decouple_generator_ports", &decouple_generator_ports},
+        {"remove_unused_vars", &remove_unused_vars},
+        {"verify_generators",
+         [](Generator* top) {
+             parallel_generator_pass(top, [=](Generator* generator) {
+                 verify_generator(generator, generator == top);
+             });
+         }},
+        {"merge_wire_assignments", &merge_wire_assignments},
+        {"hash_generators",
+         [](Generator* generator) { hash_generators(generator, HashStrategy::ParallelHash); }},
+        {"uniquify_generators", [](Generator* generator) { uniquify_generators(generator); }},
+        {"uniquify_module_instances", &uniquify_module_instances},
+        {"create_module_instantiation", &create_module_instantiation}};
+
+    PassManager manager;
+    manager.set_profiling(true);
+    // peak memory is sampled right after each pass
+    std::vector<double> rss;
+    for (auto const& [name, fn] : passes) {
+        manager.add_pass(name, [&rss, fn = fn](Generator* generator) {
+            fn(generator);
+            rss.emplace_back(peak_rss());
+        });
+    }
+    manager.run_passes(&top);
+
+    double total = 0;
+    auto const& profile = manager.profile();
+    for (uint32_t i = 0; i < profile.size(); i++) {
+        total += profile[i].wall_time;
+        report(design, profile[i], rss[i]);
+    }
+
+    uint64_t src_size = 0;
+    auto ms = time_ms([&]() {
+        auto src = generate_verilog(&top);
+        for (auto const& iter : src) src_size += iter.second.size();
+    });
+    total += ms;
+    report(design, "generate_verilog", ms, &top);
+    // not included in the total since it produces the same output
+    ms = time_ms([&]() { generate_verilog(&top, true); });
+    report(design, "generate_verilog (parallel)", ms, &top);
+    report(design, "total", total, &top);
+    std::cout << format("{0:<16} {1:<32} {2:>10}", design, "verilog size (bytes)", src_size)
+              << std::endl
+              << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    uint32_t scale = 1;
+    std::string filter;
+    if (argc > 1) scale = std::max(1, std::stoi(argv[1]));
+    if (argc > 2) filter = argv[2];
+
+    std::vector<std::pair<std::string, std::function<Generator&(Context&)>>> designs = {
+        {"mesh", [=](Context& c) -> Generator& { return make_mesh(c, 16 * scale, 16, 0); }},
+        {"mesh_variants",
+         [=](Context& c) -> Generator& { return make_mesh(c, 16 * scale, 16, 64); }},
+        {"deep", [=](Context& c) -> Generator& { return make_deep(c, 256 * scale); }},
+        {"expr_chain",
+         [=](Context& c) -> Generator& { return make_expr_chain(c, 256 * scale); }}};
+
+    report_header();
+    for (auto const& [name, fn] : designs) {
+        if (!filter.empty() && filter != name) continue;
+        Context context;
+        Generator* top = nullptr;
+        auto ms = time_ms([&]() { top = &fn(context); });
+        report(name, "build", ms, top);
+        run_design(name, *top);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -1,3 +1,4 @@
+#include <thread>
 #include "../src/context.hh"
 #include "../src/generator.hh"
 #include "../src/expr.hh"
@@ -48,4 +49,59 @@ TEST(ast, visit_if) {  // NOLINT
     EXPECT_EQ(visitor.vars.size(), 2);
     EXPECT_EQ(visitor.max_level, 2);
     EXPECT_EQ(visitor.current_level(), 0);
-}
\ No newline at end of file
+}
+
+TEST(ast, composite_visitor) {  // NOLINT
+    Context c;
+    auto &mod = c.generator("test");
+    auto &var1 = mod.var("a", 2);
+    auto &var2 = mod.var("b", 2);
+
+    auto &expr = var1.assign(var2);
+
+    VarVisitor visitor1;
+    VarVisitor visitor2;
+    CompositeVisitor visitor;
+    visitor.add_visitor(&visitor1);
+    visitor.add_visitor(&visitor2);
+    visitor.visit_root(expr.ast_node());
+    EXPECT_EQ(visitor1.vars, visitor2.vars);
+    EXPECT_EQ(visitor1.vars.size(), 2);
+    EXPECT_EQ(visitor1.vars[0], &var1);
+}
+
+TEST(ast, visit_marks) {  // NOLINT
+    Context c;
+    auto &mod = c.generator("test");
+    auto &var1 = mod.var("a", 2);
+    auto &var2 = mod.var("b", 2);
+    auto &expr = var1.assign(var2 + var2);
+
+    // more visitors alive at the same time than there are visit slots
+    std::vector<std::unique_ptr<VarVisitor>> visitors;
+    for (uint32_t i = 0; i < ASTNode::num_visit_slots + 2; i++) {
+        visitors.emplace_back(std::make_unique<VarVisitor>());
+        visitors.back()->visit_root(expr.ast_node());
+    }
+    for (auto const &visitor : visitors) {
+        EXPECT_EQ(visitor->vars.size(), 2);
+        // nodes are only visited once per visitor
+        visitor->visit_root(expr.ast_node());
+        EXPECT_EQ(visitor->vars.size(), 2);
+    }
+
+    // concurrent traversals
+    std::vector<std::thread> threads;
+    std::vector<uint64_t> counts(8);
+    for (uint32_t i = 0; i < counts.size(); i++) {
+        threads.emplace_back([&, i]() {
+            for (uint32_t j = 0; j < 100; j++) {
+                VarVisitor visitor;
+                visitor.visit_root(expr.ast_node());
+                counts[i] += visitor.vars.size();
+            }
+        });
+    }
+    for (auto &thread : threads) thread.join();
+    for (auto const &count : counts) EXPECT_EQ(count, 200);
+}
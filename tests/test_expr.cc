@@ -83,6 +83,36 @@ TEST(expr, assign) {  // NOLINT
     EXPECT_EQ(raw_stmt.left(), assign_stmt.left());
 }
 
+TEST(expr, sink_order) {  // NOLINT
+    Context c;
+    auto &mod = c.generator("module");
+    auto &a = mod.var("a", 1);
+    std::vector<std::shared_ptr<AssignStmt>> stmts;
+    // large enough to switch the sink set to the indexed mode
+    for (uint32_t i = 0; i < 40; i++) {
+        auto &var = mod.var("b" + std::to_string(i), 1);
+        auto &stmt = var.assign(a);
+        mod.add_stmt(stmt.shared_from_this());
+        stmts.emplace_back(stmt.shared_from_this()->as<AssignStmt>());
+    }
+    EXPECT_EQ(a.sinks().size(), stmts.size());
+    EXPECT_TRUE(std::equal(a.sinks().begin(), a.sinks().end(), stmts.begin()));
+
+    // removal keeps the connection order
+    std::vector<std::shared_ptr<AssignStmt>> remaining;
+    for (uint32_t i = 0; i < stmts.size(); i++) {
+        if (i % 3) {
+            stmts[i]->left()->unassign(stmts[i]);
+        } else {
+            remaining.emplace_back(stmts[i]);
+        }
+    }
+    EXPECT_EQ(a.sinks().size(), remaining.size());
+    EXPECT_TRUE(std::equal(a.sinks().begin(), a.sinks().end(), remaining.begin()));
+    EXPECT_TRUE(a.sinks().find(stmts[1]) == a.sinks().end());
+    EXPECT_TRUE(a.sinks().find(stmts[3]) != a.sinks().end());
+}
+
 TEST(expr, const_val) {  // NOLINT
     Context c;
     auto mod = c.generator("module");
@@ -93,6 +123,28 @@ TEST(expr, const_val) {  // NOLINT
     EXPECT_EQ(c1.to_string(), "-4'h4");
 }
 
+TEST(expr, const_wide) {  // NOLINT
+    Context c;
+    auto &mod = c.generator("module");
+    auto &c0 = mod.constant(BitVector::from_hex("DEAD_BEEF_0000_0000_0000_0001", 128), false);
+    EXPECT_EQ(c0.to_string(), "128'hDEADBEEF0000000000000001");
+    EXPECT_ANY_THROW(c0.value());
+    EXPECT_ANY_THROW(BitVector::from_hex("1" + std::string(32, '0'), 128));
+    auto &c1 = mod.constant(BitVector(-1, 100), true);
+    EXPECT_EQ(c1.to_string(), "-100'h1");
+    EXPECT_EQ(c1.value(), -1);
+    auto &c2 = mod.constant(0xFFFFFFFFFFFFFFFF, 64);
+    EXPECT_EQ(c2.to_string(), "64'hFFFFFFFFFFFFFFFF");
+
+    // resizing keeps the sign
+    auto bits = BitVector(-8, 4);
+    EXPECT_TRUE(bits.fits(72, true));
+    EXPECT_EQ(bits.resized(72, true).to_string(true), "-72'h8");
+    EXPECT_EQ(bits.resized(72, false).to_string(false), "72'h8");
+    EXPECT_FALSE(BitVector(8, 5).fits(4, true));
+    EXPECT_TRUE(BitVector(8, 5).fits(4, false));
+}
+
 TEST(expr, concat) {  // NOLINT
     Context c;
     auto mod = c.generator("module");
@@ -136,4 +188,29 @@ TEST(expr, port_packed) {   // NOLINT
     EXPECT_EQ(slice1.to_string(), slice2.to_string());
     EXPECT_EQ(slice2.low, 1);
     EXPECT_EQ(slice2.high, 2);
-}
\ No newline at end of file
+}
+TEST(expr, hash_consing) {  // NOLINT
+    Context c;
+    auto mod = c.generator("module");
+    auto &var1 = mod.var("a", 2);
+    auto &var2 = mod.var("b", 2);
+    auto &var3 = mod.var("c", 2);
+    auto &var4 = mod.var("d", 2);
+
+    auto &expr1 = var1 + var2;
+    EXPECT_EQ(&expr1, &(var1 + var2));
+    EXPECT_NE(&expr1, &(var2 + var1));
+    EXPECT_NE(&expr1, &(var1 - var2));
+    EXPECT_EQ(&(-var1), &(-var1));
+    EXPECT_EQ(&((var1 + var2) + var3), &(expr1 + var3));
+    EXPECT_EQ(mod.exprs_count(), 5);
+
+    // rewire the operand in place. the stale entry should not be reused
+    var3.assign(expr1);
+    Var::move_sink_to(&var1, &var4, &mod, false);
+    EXPECT_EQ(expr1.to_string(), "d + b");
+    auto &expr2 = var1 + var2;
+    EXPECT_NE(&expr1, &expr2);
+    EXPECT_EQ(expr2.to_string(), "a + b");
+    EXPECT_EQ(&expr2, &(var1 + var2));
+}
@@ -1,10 +1,16 @@
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <random>
 #include "../src/codegen.hh"
+#include "../src/except.hh"
 #include "../src/expr.hh"
 #include "../src/generator.hh"
 #include "../src/pass.hh"
 #include "../src/port.hh"
 #include "../src/stmt.hh"
 #include "../src/util.hh"
+#include "fmt/format.h"
 #include "gtest/gtest.h"
 
 TEST(generator, load) {  // NOLINT
@@ -41,6 +47,26 @@ TEST(generator, rename_var) {  // NOLINT
     EXPECT_EQ(a.name, "c");
     EXPECT_EQ(stmt1.left()->to_string(), "c");
     EXPECT_EQ(stmt2.right()->to_string(), "c[0:0]");
+    EXPECT_EQ(mod.get_var("c"), a.shared_from_this());
+    EXPECT_EQ(mod.get_var("a"), nullptr);
+    EXPECT_ANY_THROW(mod.rename_var("c", "b"));
+}
+
+TEST(generator, unique_variable_name) {  // NOLINT
+    Context c;
+    auto &mod = c.generator("module");
+    mod.var("a_0", 1);
+    auto name1 = mod.get_unique_variable_name("", "a");
+    EXPECT_EQ(name1, "a_1");
+    mod.var(name1, 1);
+    EXPECT_EQ(mod.get_unique_variable_name("", "a"), "a_2");
+    EXPECT_EQ(mod.get_unique_variable_name("inst", "a"), "inst$a_0");
+
+    // freed names are handed out again
+    mod.remove_var("a_0");
+    EXPECT_EQ(mod.get_unique_variable_name("", "a"), "a_0");
+    EXPECT_EQ(c.num_generators_by_name("module"), 1u);
+    EXPECT_EQ(c.num_generators_by_name("not_a_name"), 0u);
 }
 
 TEST(generator, remove_stmt) {  // NOLINT
@@ -55,6 +81,87 @@ TEST(generator, remove_stmt) {  // NOLINT
     EXPECT_EQ(mod.get_stmt(0), nullptr);
 }
 
+TEST(generator, remove_stmts) {  // NOLINT
+    Context c;
+    auto &mod = c.generator("module");
+    auto &a = mod.var("a", 1);
+    std::vector<std::shared_ptr<Stmt>> stmts;
+    for (uint32_t i = 0; i < 100; i++) {
+        auto &var = mod.var("b" + std::to_string(i), 1);
+        auto stmt = var.assign(a).shared_from_this();
+        mod.add_stmt(stmt);
+        stmts.emplace_back(stmt);
+    }
+    std::vector<std::shared_ptr<Stmt>> to_remove;
+    std::vector<std::shared_ptr<Stmt>> remaining;
+    for (uint32_t i = 0; i < stmts.size(); i++) {
+        if (i % 4)
+            to_remove.emplace_back(stmts[i]);
+        else
+            remaining.emplace_back(stmts[i]);
+    }
+    // single removal and bulk removal keep the statement order
+    mod.remove_stmt(to_remove.back());
+    mod.remove_stmts(to_remove);
+    EXPECT_EQ(mod.stmts_count(), remaining.size());
+    for (uint32_t i = 0; i < remaining.size(); i++) EXPECT_EQ(mod.get_stmt(i), remaining[i]);
+    EXPECT_EQ(mod.get_stmt(remaining.size()), nullptr);
+
+    // a statement is only added once
+    mod.add_stmt(remaining[0]);
+    EXPECT_EQ(mod.stmts_count(), remaining.size());
+    EXPECT_EQ(mod.get_stmt(0), remaining[0]);
+}
+
+TEST(generator, remove_stmt_positions) {  // NOLINT
+    Context c;
+    auto &mod = c.generator("module");
+    auto &a = mod.var("a", 1);
+    std::vector<std::shared_ptr<Stmt>> stmts;
+    for (uint32_t i = 0; i < 40; i++) {
+        auto &var = mod.var("b" + std::to_string(i), 1);
+        auto stmt = var.assign(a).shared_from_this();
+        mod.add_stmt(stmt);
+        stmts.emplace_back(stmt);
+    }
+    // a few single removals leave empty slots behind, which positional access skips
+    for (auto const i : {30u, 5u, 17u, 6u}) mod.remove_stmt(stmts[i]);
+    std::vector<std::shared_ptr<Stmt>> remaining;
+    for (uint32_t i = 0; i < stmts.size(); i++) {
+        if (i != 30 && i != 5 && i != 17 && i != 6) remaining.emplace_back(stmts[i]);
+    }
+    auto check = [&]() {
+        EXPECT_EQ(mod.stmts_count(), remaining.size());
+        for (uint32_t i = 0; i < remaining.size(); i++)
+            EXPECT_EQ(mod.get_stmt(i), remaining[i]);
+        EXPECT_EQ(mod.get_stmt(remaining.size()), nullptr);
+    };
+    check();
+    mod.compact_stmts();
+    check();
+}
+
+
+TEST(generator, arena) {  // NOLINT
+    Context c;
+    auto &mod = c.generator("module");
+    auto &a = mod.var("a", 2);
+    auto &b = mod.var("b", 2);
+    mod.add_stmt(a.assign(b + b).shared_from_this());
+    EXPECT_GT(mod.arena()->bytes_in_use(), 0);
+    EXPECT_GT(c.arena_memory_size(), 0);
+
+    // freed memory is reused within the same size class
+    auto arena = c.create_arena();
+    auto ptr = arena->allocate(48, 8);
+    arena->deallocate(ptr, 48, 8);
+    EXPECT_EQ(arena->allocate(40, 8), ptr);
+    EXPECT_EQ(arena->bytes_reserved(), ArenaChunkPool::chunk_size);
+    // chunks go back to the context once the arena is gone
+    EXPECT_EQ(c.arena_free_memory_size(), 0);
+    arena = nullptr;
+    EXPECT_EQ(c.arena_free_memory_size(), ArenaChunkPool::chunk_size);
+}
 
 TEST(generator, param) {    // NOLINT
     Context c;
@@ -87,6 +194,57 @@ TEST(pass, assignment_fix) {  // NOLINT
     EXPECT_EQ(expr.assign_type(), AssignmentType::Blocking);
 }
 
+TEST(pass, parallel_generator_pass) {  // NOLINT
+    Context c;
+    auto &top = c.generator("top");
+    std::vector<Generator *> children;
+    for (uint32_t i = 0; i < 4; i++) {
+        auto &child = c.generator("child" + std::to_string(i));
+        auto &in = child.port(PortDirection::In, "in", 2);
+        auto &out = child.port(PortDirection::Out, "out", 2);
+        auto &child_var = child.var("var" + std::to_string(i), 1);
+        child.add_stmt(out.assign(in).shared_from_this());
+        child.add_stmt(child_var.assign(in[0]).shared_from_this());
+        auto &grandchild = c.generator("grandchild" + std::to_string(i));
+        child.add_child_generator(grandchild.shared_from_this());
+        top.add_child_generator(child.shared_from_this());
+        children.emplace_back(&child);
+    }
+
+    // parents are always processed before their children
+    std::mutex mutex;
+    std::vector<Generator *> visited;
+    parallel_generator_pass(&top, [&](Generator *generator) {
+        std::lock_guard<std::mutex> guard(mutex);
+        if (generator->parent()) {
+            EXPECT_NE(std::find(visited.begin(), visited.end(), generator->parent()),
+                      visited.end());
+        }
+        visited.emplace_back(generator);
+    });
+    EXPECT_EQ(visited.size(), 9);
+
+    parallel_generator_pass(&top, &fix_assignment_type_generator);
+    auto stmt = std::static_pointer_cast<AssignStmt>(children[0]->get_stmt(0));
+    EXPECT_EQ(stmt->assign_type(), AssignmentType::Blocking);
+    EXPECT_NO_THROW(parallel_generator_pass(&top, &verify_assignments_generator));
+
+    // the first error in hierarchy order is reported
+    for (auto i : {1, 3}) {
+        auto &bad_var = children[i]->var("bad" + std::to_string(i), 2);
+        children[i]->add_stmt(bad_var.assign(*children[i]->get_port("in")).shared_from_this());
+        bad_var.width = 1;
+    }
+    for (uint32_t i = 0; i < 4; i++) {
+        try {
+            parallel_generator_pass(&top, &verify_assignments_generator);
+            FAIL();
+        } catch (StmtException &ex) {
+            EXPECT_NE(std::string(ex.what()).find("bad1"), std::string::npos);
+        }
+    }
+}
+
 TEST(pass, unused_var) {  // NOLINT
     Context c;
     auto mod = c.generator("module");
@@ -134,6 +292,61 @@ TEST(pass, connectivity) {  // NOLINT
     EXPECT_NO_THROW(verify_generator_connectivity(&mod1));
 }
 
+TEST(pass, verify_generators) {  // NOLINT
+    Context c;
+    auto &mod1 = c.generator("module1");
+    auto &port1 = mod1.port(PortDirection::In, "in", 2);
+    auto &port2 = mod1.port(PortDirection::Out, "out", 2);
+    auto &mod2 = c.generator("module2");
+    mod1.add_child_generator(mod2.shared_from_this());
+    auto &port3 = mod2.port(PortDirection::In, "in", 2);
+    auto &port4 = mod2.port(PortDirection::Out, "out", 2);
+    mod1.add_stmt(port3.assign(port1).shared_from_this());
+    mod1.add_stmt(port2.assign(port4).shared_from_this());
+    fix_assignment_type(&mod1);
+
+    // module2.out is floating
+    EXPECT_THROW(verify_generators(&mod1), StmtException);
+    mod2.add_stmt(port4.assign(port3).shared_from_this());
+    fix_assignment_type(&mod1);
+    EXPECT_NO_THROW(verify_generators(&mod1));
+
+    // wire assignment that is also used in an always block
+    auto &var = mod2.var("a", 2);
+    mod2.add_stmt(var.assign(port3).shared_from_this());
+    fix_assignment_type(&mod1);
+    EXPECT_NO_THROW(verify_generators(&mod1));
+    auto comb = mod2.combinational();
+    comb->add_statement(var.assign(port3).shared_from_this());
+    fix_assignment_type(&mod1);
+    EXPECT_THROW(verify_generators(&mod1), StmtException);
+}
+
+TEST(pass, verify_generators_mixed_assignment) {  // NOLINT
+    Context c;
+    auto &mod = c.generator("module");
+    auto &in = mod.port(PortDirection::In, "in", 2);
+    auto &out = mod.port(PortDirection::Out, "out", 2);
+    mod.add_stmt(out.assign(in, AssignmentType::Blocking).shared_from_this());
+    EXPECT_NO_THROW(verify_generators(&mod));
+    // the port is reached through the statements
+    auto &stmt = out.assign(in);
+    mod.add_stmt(stmt.shared_from_this());
+    stmt.set_assign_type(AssignmentType::NonBlocking);
+    EXPECT_THROW(verify_generators(&mod), StmtException);
+
+    // same for a var
+    auto &mod2 = c.generator("module2");
+    auto &in2 = mod2.port(PortDirection::In, "in", 2);
+    auto &var = mod2.var("a", 2);
+    mod2.add_stmt(var.assign(in2, AssignmentType::Blocking).shared_from_this());
+    EXPECT_NO_THROW(verify_generators(&mod2));
+    auto &var_stmt = var.assign(in2);
+    mod2.add_stmt(var_stmt.shared_from_this());
+    var_stmt.set_assign_type(AssignmentType::NonBlocking);
+    EXPECT_THROW(verify_generators(&mod2), StmtException);
+}
+
 TEST(pass, verilog_code_gen) {  // NOLINT
     Context c;
     auto &mod1 = c.generator("module1");
@@ -147,6 +360,89 @@ TEST(pass, verilog_code_gen) {  // NOLINT
     EXPECT_FALSE(module_str.empty());
 }
 
+TEST(pass, verilog_code_gen_parallel) {  // NOLINT
+    Context c;
+    auto &mod1 = c.generator("module1");
+    auto &port1 = mod1.port(PortDirection::In, "in", 4);
+    for (uint32_t i = 0; i < 8; i++) {
+        auto &child = c.generator("child" + std::to_string(i));
+        auto &child_in = child.port(PortDirection::In, "in", 4);
+        auto &child_out = child.port(PortDirection::Out, "out", 4);
+        child.add_stmt(child_out.assign(child_in + child.constant(i, 4)).shared_from_this());
+        mod1.add_child_generator(child.shared_from_this());
+        auto &out = mod1.port(PortDirection::Out, "out" + std::to_string(i), 4);
+        mod1.add_stmt(child_in.assign(port1).shared_from_this());
+        mod1.add_stmt(out.assign(child_out).shared_from_this());
+    }
+    fix_assignment_type(&mod1);
+    create_module_instantiation(&mod1);
+
+    auto const &result = generate_verilog(&mod1, true);
+    EXPECT_EQ(result.size(), 9);
+    EXPECT_EQ(result, generate_verilog(&mod1, false));
+}
+
+TEST(pass, verilog_code_gen_stream) {  // NOLINT
+    Context c;
+    auto &mod1 = c.generator("module1");
+    auto &port1 = mod1.port(PortDirection::In, "in", 1);
+    auto &port2 = mod1.port(PortDirection::Out, "out", 1);
+    auto &mod2 = c.generator("module2");
+    auto &port3 = mod2.port(PortDirection::In, "in", 1);
+    auto &port4 = mod2.port(PortDirection::Out, "out", 1);
+    mod2.add_stmt(port4.assign(port3).shared_from_this());
+    mod1.add_child_generator(mod2.shared_from_this());
+    mod1.add_stmt(port3.assign(port1).shared_from_this());
+    mod1.add_stmt(port2.assign(port4).shared_from_this());
+    fix_assignment_type(&mod1);
+    create_module_instantiation(&mod1);
+
+    auto const &result = generate_verilog(&mod1);
+    const std::string filename = "verilog_code_gen_stream.sv";
+    auto const &manifest = generate_verilog(&mod1, filename, false, true);
+    EXPECT_EQ(manifest.size(), 2);
+    EXPECT_EQ(manifest.at("module1").line_offset, 0);
+    EXPECT_EQ(manifest.at("module2").line_offset, manifest.at("module1").num_lines);
+    EXPECT_EQ(manifest.at("module2").filename, filename);
+
+    std::ifstream stream(filename);
+    std::string content((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+    EXPECT_EQ(content, result.at("module1") + result.at("module2"));
+    std::remove(filename.c_str());
+
+    EXPECT_ANY_THROW(generate_verilog(&mod1, "non_exist_dir/", true, false));
+}
+
+TEST(pass, verilog_code_gen_cache) {  // NOLINT
+    Context c;
+    auto &mod1 = c.generator("module1");
+    auto &port1 = mod1.port(PortDirection::In, "in", 1);
+    auto &port2 = mod1.port(PortDirection::Out, "out", 1);
+    mod1.add_stmt(port2.assign(port1, AssignmentType::Blocking).shared_from_this());
+    auto const src = generate_verilog(&mod1).at("module1");
+
+    // keep the cache out of the source tree
+    auto const dir = std::filesystem::temp_directory_path() /
+                     fmt::format("kratos_cache_{0:x}", std::random_device()());
+    std::filesystem::create_directories(dir);
+    c.set_codegen_cache_dir(dir.string());
+    auto const hash = hash_generator_codegen(&mod1);
+    auto const filename = dir / fmt::format("{0:016x}.sv", hash);
+    EXPECT_EQ(generate_verilog(&mod1).at("module1"), src);
+    std::ifstream cached(filename);
+    EXPECT_TRUE(cached.good());
+    cached.close();
+    // hits should come from the cache
+    std::ofstream(filename) << "cached";
+    EXPECT_EQ(generate_verilog(&mod1).at("module1"), "cached");
+
+    // any change to the module changes the key
+    mod1.port(PortDirection::Out, "out2", 1);
+    EXPECT_NE(hash_generator_codegen(&mod1), hash);
+    EXPECT_NE(generate_verilog(&mod1).at("module1"), "cached");
+    std::filesystem::remove_all(dir);
+}
+
 TEST(pass, generator_hash) {  // NOLINT
     Context c;
     auto &mod1 = c.generator("module1");
@@ -179,6 +475,222 @@ TEST(pass, generator_hash) {  // NOLINT
     EXPECT_EQ(mod3.name, "module1_unq0");
 }
 
+TEST(pass, uniquify_generators_verify) {  // NOLINT
+    auto build = [](Context &c, uint32_t i) {
+        auto &mod = c.generator("module1");
+        auto &in = mod.port(PortDirection::In, "in", 1);
+        auto &out = mod.port(PortDirection::Out, "out", 1);
+        if (i % 2)
+            mod.add_stmt(out.assign(in + mod.constant(1, 1), AssignmentType::Blocking)
+                             .shared_from_this());
+        else
+            mod.add_stmt(out.assign(in, AssignmentType::Blocking).shared_from_this());
+        return &mod;
+    };
+    Context c;
+    std::vector<Generator *> mods;
+    for (uint32_t i = 0; i < 4; i++) mods.emplace_back(build(c, i));
+    for (auto const &mod : mods) hash_generators(mod, HashStrategy::StructuralHash);
+    // identical generators end up with the same name
+    uniquify_generators(mods[0]);
+    EXPECT_EQ(mods[0]->name, mods[2]->name);
+    EXPECT_EQ(mods[1]->name, mods[3]->name);
+    EXPECT_NE(mods[0]->name, mods[1]->name);
+
+    // fake a hash collision
+    Context c2;
+    auto mod1 = build(c2, 0);
+    auto mod2 = build(c2, 1);
+    c2.add_hash(mod1, 42);
+    c2.add_hash(mod2, 42);
+    uniquify_generators(mod1);
+    EXPECT_EQ(mod1->name, mod2->name);
+    uniquify_generators(mod1, true);
+    EXPECT_NE(mod1->name, mod2->name);
+}
+
+TEST(pass, generator_hash_structural) {  // NOLINT
+    // a parent with two same-named children that only differ in a width and a constant
+    auto build = [](Context &c) {
+        auto &top = c.generator("top");
+        for (uint32_t i = 0; i < 4; i++) {
+            auto width = i == 3 ? 4 : 2;
+            auto &child = c.generator("child");
+            auto &in = child.port(PortDirection::In, "in", width);
+            auto &out = child.port(PortDirection::Out, "out", width);
+            auto &value = (in + child.constant(i % 2, width)) * in;
+            child.add_stmt(out.assign(value, AssignmentType::Blocking).shared_from_this());
+            child.instance_name = "child" + std::to_string(i);
+            top.add_child_generator(child.shared_from_this());
+        }
+        return &top;
+    };
+    Context c1, c2;
+    auto top1 = build(c1);
+    auto top2 = build(c2);
+    hash_generators(top1, HashStrategy::StructuralHash);
+    hash_generators(top2, HashStrategy::ParallelStructuralHash);
+
+    auto const &children1 = top1->get_child_generators();
+    auto const &children2 = top2->get_child_generators();
+    for (uint32_t i = 0; i < 4; i++) {
+        EXPECT_EQ(c1.get_hash(children1[i].get()), c2.get_hash(children2[i].get()));
+    }
+    EXPECT_EQ(c1.get_hash(children1[0].get()), c1.get_hash(children1[2].get()));
+    EXPECT_NE(c1.get_hash(children1[0].get()), c1.get_hash(children1[1].get()));
+    EXPECT_NE(c1.get_hash(children1[1].get()), c1.get_hash(children1[3].get()));
+    EXPECT_EQ(c1.get_hash(top1), c2.get_hash(top2));
+
+    uniquify_generators(top1);
+    EXPECT_EQ(children1[0]->name, children1[2]->name);
+    EXPECT_NE(children1[0]->name, children1[1]->name);
+    EXPECT_NE(children1[1]->name, children1[3]->name);
+}
+
+TEST(pass, generator_hash_concat_order) {  // NOLINT
+    // concatenations of three vars are only distinguished by their operands
+    Context c;
+    std::vector<Generator *> mods;
+    for (uint32_t i = 0; i < 2; i++) {
+        auto &mod = c.generator("mod");
+        auto &a = mod.var("a", 1);
+        auto &b = mod.var("b", 1);
+        auto &d = mod.var("d", 1);
+        auto &out = mod.var("out", 3);
+        auto &value = i == 0 ? a.concat(b).concat(d) : d.concat(b).concat(a);
+        mod.add_stmt(out.assign(value, AssignmentType::Blocking).shared_from_this());
+        mods.emplace_back(&mod);
+    }
+    EXPECT_FALSE(generator_structural_equal(mods[0], mods[1]));
+    for (auto const &mod : mods) hash_generators(mod, HashStrategy::StructuralHash);
+    EXPECT_NE(c.get_hash(mods[0]), c.get_hash(mods[1]));
+}
+
+TEST(pass, generator_hash_incremental) {  // NOLINT
+    Context c;
+    auto &top = c.generator("top");
+    std::vector<Generator *> children;
+    std::vector<std::shared_ptr<CombinationalStmtBlock>> blocks;
+    for (uint32_t i = 0; i < 3; i++) {
+        auto &child = c.generator("child");
+        auto &in = child.port(PortDirection::In, "in", 2);
+        auto &out = child.port(PortDirection::Out, "out", 2);
+        auto comb = child.combinational();
+        comb->add_statement(out.assign(in).shared_from_this());
+        child.instance_name = "child" + std::to_string(i);
+        top.add_child_generator(child.shared_from_this());
+        children.emplace_back(&child);
+        blocks.emplace_back(comb);
+    }
+    EXPECT_TRUE(top.is_dirty());
+    hash_generators(&top, HashStrategy::StructuralHash);
+    EXPECT_FALSE(top.is_dirty());
+    for (auto const &child : children) EXPECT_FALSE(child->is_dirty());
+    auto top_hash = c.get_hash(&top);
+    auto child_hash = c.get_hash(children[0]);
+    EXPECT_EQ(child_hash, c.get_hash(children[1]));
+
+    // nothing changed
+    hash_generators(&top, HashStrategy::StructuralHash);
+    EXPECT_EQ(top_hash, c.get_hash(&top));
+
+    // a nested statement marks the child and its parent, but not the siblings
+    auto &extra = children[1]->var("extra", 2);
+    blocks[1]->add_statement(extra.assign(*children[1]->get_port("in")).shared_from_this());
+    EXPECT_TRUE(children[1]->is_dirty());
+    EXPECT_TRUE(top.is_dirty());
+    EXPECT_FALSE(children[0]->is_dirty());
+    EXPECT_FALSE(children[2]->is_dirty());
+
+    hash_generators(&top, HashStrategy::ParallelStructuralHash);
+    EXPECT_FALSE(top.is_dirty());
+    EXPECT_EQ(child_hash, c.get_hash(children[0]));
+    EXPECT_EQ(child_hash, c.get_hash(children[2]));
+    EXPECT_NE(child_hash, c.get_hash(children[1]));
+}
+
+TEST(pass, generator_hash_in_place_edit) {  // NOLINT
+    Context c;
+    auto &top = c.generator("top");
+    // only generators that share a name are hashed structurally
+    std::vector<Generator *> leaves;
+    std::vector<Generator *> mids;
+    for (uint32_t i = 0; i < 2; i++) {
+        auto &mid = c.generator("mid");
+        auto &leaf = c.generator("leaf");
+        auto &in = leaf.port(PortDirection::In, "in", 2);
+        auto &out = leaf.port(PortDirection::Out, "out", 2);
+        leaf.parameter("p", 2);
+        leaf.add_stmt(out.assign(in + leaf.constant(1, 2)).shared_from_this());
+        mid.add_child_generator(leaf.shared_from_this());
+        mid.instance_name = "mid" + std::to_string(i);
+        top.add_child_generator(mid.shared_from_this());
+        leaves.emplace_back(&leaf);
+        mids.emplace_back(&mid);
+    }
+    auto &leaf = *leaves[1];
+    auto &mid = *mids[1];
+    auto stmt = leaf.get_stmt(0)->as<AssignStmt>();
+    auto &constant = *stmt->right()->as<Expr>()->right->as<Const>();
+    auto &param = *leaf.get_param("p");
+
+    // every edit has to change the hash of the parent once it's re-hashed
+    hash_generators(&top, HashStrategy::StructuralHash);
+    auto hash = c.get_hash(&mid);
+    EXPECT_EQ(hash, c.get_hash(mids[0]));
+    auto rehash = [&]() {
+        EXPECT_TRUE(mid.is_dirty());
+        EXPECT_FALSE(mids[0]->is_dirty());
+        hash_generators(&top, HashStrategy::StructuralHash);
+        EXPECT_NE(hash, c.get_hash(&mid));
+        hash = c.get_hash(&mid);
+    };
+
+    stmt->set_assign_type(AssignmentType::NonBlocking);
+    rehash();
+    constant.set_value(2);
+    rehash();
+    param.set_value(3);
+    rehash();
+    stmt->set_right(leaf.get_port("in"));
+    rehash();
+    stmt->set_left(leaf.var("a", 2).shared_from_this());
+    rehash();
+    leaf.set_instance_name("new_leaf");
+    rehash();
+    c.change_generator_name(&leaf, "new_leaf");
+    rehash();
+}
+
+TEST(pass, generator_hash_move_sink) {  // NOLINT
+    // moving sinks without keeping the connection rewrites expressions and slices in place
+    Context c;
+    std::vector<Generator *> mods;
+    for (uint32_t i = 0; i < 2; i++) {
+        auto &mod = c.generator("mod");
+        auto &a = mod.var("a", 2);
+        auto &b = mod.var("b", 2);
+        mod.var("n", 2);
+        auto &o = mod.var("o", 2);
+        auto &p = mod.var("p", 1);
+        mod.add_stmt(o.assign(a + b, AssignmentType::Blocking).shared_from_this());
+        mod.add_stmt(p.assign(a[0], AssignmentType::Blocking).shared_from_this());
+        mods.emplace_back(&mod);
+    }
+    for (auto const &mod : mods) hash_generators(mod, HashStrategy::StructuralHash);
+    auto hash = c.get_hash(mods[1]);
+    EXPECT_EQ(hash, c.get_hash(mods[0]));
+    EXPECT_FALSE(mods[1]->is_dirty());
+
+    auto &mod = *mods[1];
+    Var::move_sink_to(mod.get_var("a").get(), mod.get_var("n").get(), &mod, false);
+    EXPECT_TRUE(mod.is_dirty());
+    EXPECT_FALSE(mods[0]->is_dirty());
+    hash_generators(&mod, HashStrategy::StructuralHash);
+    EXPECT_NE(hash, c.get_hash(&mod));
+    EXPECT_FALSE(generator_structural_equal(mods[0], mods[1]));
+}
+
 TEST(pass, generator_instance) {  // NOLINT
     Context c;
     auto &mod1 = c.generator("module1");
@@ -325,6 +837,232 @@ TEST(pass, fanout) {  // NOLINT
     EXPECT_TRUE(src.find('b') == std::string::npos);
 }
 
+TEST(pass, fold_constants) {  // NOLINT
+    Context c;
+    auto &mod = c.generator("module1");
+    auto &in = mod.port(PortDirection::In, "in", 4);
+    auto &out1 = mod.port(PortDirection::Out, "out1", 4);
+    auto &out2 = mod.port(PortDirection::Out, "out2", 4);
+    auto &out3 = mod.port(PortDirection::Out, "out3", 4);
+    auto &a = mod.var("a", 4);
+    auto &b = mod.var("b", 4);
+    auto &mode = mod.var("mode", 2);
+
+    mod.add_stmt(a.assign(mod.constant(3, 4) + mod.constant(2, 4)).shared_from_this());
+    mod.add_stmt(mode.assign(mod.constant(1, 2)).shared_from_this());
+    auto &sum = (in & mod.constant(15, 4)) + (a << mod.constant(1, 4));
+    mod.add_stmt(out1.assign(sum).shared_from_this());
+    mod.add_stmt(b.assign(in | mod.constant(15, 4)).shared_from_this());
+    mod.add_stmt(out2.assign(b).shared_from_this());
+
+    auto comb = mod.combinational();
+    auto if_ = std::make_shared<IfStmt>(mode.eq(mod.constant(1, 2)));
+    if_->add_then_stmt(out3.assign(in));
+    if_->add_else_stmt(out3.assign(a));
+    comb->add_statement(if_);
+
+    fold_constants(&mod);
+
+    // in + 10
+    auto const &stmt1 = *out1.sources().begin();
+    EXPECT_EQ(stmt1->right()->to_string(), "in + 4'hA");
+    EXPECT_TRUE(sum.sinks().empty());
+    EXPECT_EQ(in.sinks().size(), 2);
+    EXPECT_TRUE(a.sinks().empty());
+    // x | all ones
+    EXPECT_EQ((*b.sources().begin())->right()->to_string(), "4'hF");
+    EXPECT_EQ((*out2.sources().begin())->right()->to_string(), "4'hF");
+    // the if statement is replaced by its then branch
+    EXPECT_EQ(comb->child_count(), 1);
+    auto stmt = reinterpret_cast<Stmt *>(comb->get_child(0));
+    EXPECT_EQ(stmt->type(), StatementType::Assign);
+    EXPECT_EQ(stmt->parent(), comb.get());
+    EXPECT_EQ(out3.sources().size(), 1);
+
+    fix_assignment_type(&mod);
+    auto src = generate_verilog(&mod)["module1"];
+    EXPECT_TRUE(is_valid_verilog(src));
+    EXPECT_EQ(src.find("if"), std::string::npos);
+}
+
+TEST(pass, eliminate_common_subexpressions) {  // NOLINT
+    Context c;
+    auto &mod = c.generator("module1");
+    auto &a = mod.port(PortDirection::In, "a", 4);
+    auto &b = mod.port(PortDirection::In, "b", 4);
+    auto &sel = mod.port(PortDirection::In, "sel", 2);
+    auto &out1 = mod.port(PortDirection::Out, "out1", 4);
+    auto &out2 = mod.port(PortDirection::Out, "out2", 4);
+    auto &out3 = mod.port(PortDirection::Out, "out3", 4);
+    auto &out4 = mod.port(PortDirection::Out, "out4", 4);
+    auto &tmp = mod.var("tmp", 4);
+
+    auto &sum = a + b;
+    mod.add_stmt(out1.assign(sum + a).shared_from_this());
+    mod.add_stmt(out2.assign(sum + b).shared_from_this());
+    auto &cond = sel.eq(mod.constant(1, 2));
+    auto comb = mod.combinational();
+    auto if1 = std::make_shared<IfStmt>(cond);
+    if1->add_then_stmt(out3.assign(a));
+    if1->add_else_stmt(out3.assign(b));
+    comb->add_statement(if1);
+    // tmp + b changes between the two uses
+    comb->add_statement(tmp.assign(a));
+    comb->add_statement(out4.assign(tmp + b));
+    comb->add_statement(tmp.assign(b));
+    auto if2 = std::make_shared<IfStmt>(cond);
+    if2->add_then_stmt(out4.assign(tmp + b));
+    comb->add_statement(if2);
+
+    eliminate_common_subexpressions(&mod);
+
+    auto cse_0 = mod.get_var("cse_0");
+    auto cse_1 = mod.get_var("cse_1");
+    ASSERT_NE(cse_0, nullptr);
+    ASSERT_NE(cse_1, nullptr);
+    EXPECT_EQ(mod.get_var("cse_2"), nullptr);
+    EXPECT_EQ((*out1.sources().begin())->right()->to_string(), "cse_0 + a");
+    EXPECT_EQ((*cse_0->sources().begin())->right(), sum.shared_from_this());
+    EXPECT_EQ((*cse_1->sources().begin())->right(), cond.shared_from_this());
+    EXPECT_EQ(if1->predicate(), cse_1);
+    EXPECT_EQ(if2->predicate(), cse_1);
+    EXPECT_EQ(cse_0->sinks().size(), 2);
+    EXPECT_EQ(sel.sinks().size(), 1);
+
+    fix_assignment_type(&mod);
+    auto src = generate_verilog(&mod)["module1"];
+    EXPECT_TRUE(is_valid_verilog(src));
+}
+
+TEST(pass, remove_dead_logic) {  // NOLINT
+    Context c;
+    auto &top = c.generator("top");
+    auto &in = top.port(PortDirection::In, "in", 4);
+    auto &out = top.port(PortDirection::Out, "out", 4);
+    auto &dead = top.var("dead", 4);
+
+    auto &child1 = c.generator("child1");
+    auto &child1_in = child1.port(PortDirection::In, "in", 4);
+    auto &child1_out = child1.port(PortDirection::Out, "out", 4);
+    auto &child1_unused = child1.port(PortDirection::Out, "unused", 4);
+    auto &tmp = child1.var("tmp", 4);
+    child1.add_stmt(child1_out.assign(child1_in).shared_from_this());
+    child1.add_stmt(tmp.assign(child1_in + child1.constant(1, 4)).shared_from_this());
+    child1.add_stmt(child1_unused.assign(tmp).shared_from_this());
+
+    auto &child2 = c.generator("child2");
+    auto &child2_in = child2.port(PortDirection::In, "in", 4);
+    auto &child2_out = child2.port(PortDirection::Out, "out", 4);
+    child2.add_stmt(child2_out.assign(~child2_in).shared_from_this());
+
+    top.add_child_generator(child1.shared_from_this());
+    top.add_child_generator(child2.shared_from_this());
+    top.add_stmt(child1_in.assign(in).shared_from_this());
+    top.add_stmt(out.assign(child1_out).shared_from_this());
+    top.add_stmt(child2_in.assign(in).shared_from_this());
+    top.add_stmt(dead.assign(child2_out).shared_from_this());
+    auto comb = top.combinational();
+    auto if_ = std::make_shared<IfStmt>(in.eq(top.constant(0, 4)));
+    if_->add_then_stmt(dead.assign(in));
+    comb->add_statement(if_);
+
+    // the pass drops the last owner of child2
+    auto child2_ptr = child2.shared_from_this();
+    remove_dead_logic(&top);
+
+    EXPECT_EQ(top.get_var("dead"), nullptr);
+    EXPECT_EQ(top.stmts_count(), 2);
+    EXPECT_EQ(in.sinks().size(), 1);
+    EXPECT_FALSE(top.has_child_generator(child2_ptr));
+    EXPECT_EQ(c.num_generators_by_name("child2"), 0);
+    EXPECT_EQ(child1.get_port_names(), std::set<std::string>({"in", "out"}));
+    EXPECT_EQ(child1.get_var("tmp"), nullptr);
+    EXPECT_EQ(child1.stmts_count(), 1);
+    EXPECT_TRUE(child1_in.sinks().size() == 1);
+
+    fix_assignment_type(&top);
+    create_module_instantiation(&top);
+    auto mod_src = generate_verilog(&top);
+    EXPECT_TRUE(is_valid_verilog(mod_src["top"]));
+    EXPECT_TRUE(is_valid_verilog(mod_src["child1"]));
+    EXPECT_EQ(mod_src.find("child2"), mod_src.end());
+}
+
+TEST(pass, inline_generators) {  // NOLINT
+    Context c;
+    auto &top = c.generator("top");
+    top.debug = true;
+    auto &clk = top.port(PortDirection::In, "clk", 1, PortType::Clock, false);
+    auto &in = top.port(PortDirection::In, "in", 4);
+    auto &out = top.port(PortDirection::Out, "out", 4);
+    auto &reg_out = top.var("reg_out", 4);
+
+    auto &reg = c.generator("reg");
+    auto &reg_clk = reg.port(PortDirection::In, "clk", 1, PortType::Clock, false);
+    auto &reg_in = reg.port(PortDirection::In, "in", 4);
+    auto &reg_q = reg.port(PortDirection::Out, "q", 4);
+    auto seq = reg.sequential();
+    seq->add_condition({BlockEdgeType::Posedge, reg_clk.shared_from_this()});
+    auto &stmt = reg_q.assign(reg_in + reg.constant(1, 4));
+    stmt.fn_name_ln.emplace_back("reg.py", 42);
+    seq->add_statement(stmt);
+
+    auto &inv = c.generator("inv");
+    auto &inv_in = inv.port(PortDirection::In, "in", 4);
+    auto &inv_out = inv.port(PortDirection::Out, "out", 4);
+    inv.add_stmt(inv_out.assign(~inv_in).shared_from_this());
+    reg.add_child_generator(inv.shared_from_this());
+    reg.add_stmt(inv_in.assign(reg_q).shared_from_this());
+
+    top.add_child_generator(reg.shared_from_this());
+    top.add_stmt(reg_clk.assign(clk).shared_from_this());
+    top.add_stmt(reg_in.assign(in).shared_from_this());
+    top.add_stmt(reg_out.assign(reg_q).shared_from_this());
+    top.add_stmt(out.assign(reg_out + inv_out).shared_from_this());
+
+    auto attribute = std::make_shared<Attribute>();
+    attribute->type_str = "inline";
+    reg.add_attribute(attribute);
+    // the pass drops the last owner of reg
+    auto reg_ptr = reg.shared_from_this();
+    // inv doesn't match
+    inline_generators(&top, {0, "inline", "mux.*"});
+
+    EXPECT_FALSE(top.has_child_generator(reg_ptr));
+    EXPECT_TRUE(top.has_child_generator(inv.shared_from_this()));
+    EXPECT_EQ(inv.instance_name, "reg_inv");
+    // the clock and the input are wired directly, the output gets a new name
+    EXPECT_EQ(top.get_var("reg_clk"), nullptr);
+    EXPECT_EQ(top.get_var("reg_in"), nullptr);
+    auto q = top.get_var("reg_q");
+    EXPECT_NE(q, nullptr);
+    EXPECT_EQ(inv_in.sources().size(), 1);
+    EXPECT_EQ((*inv_in.sources().begin())->right(), q);
+
+    std::shared_ptr<SequentialStmtBlock> block;
+    for (uint64_t i = 0; i < top.stmts_count(); i++) {
+        if (top.get_stmt(i)->type() == StatementType::Block)
+            block = top.get_stmt(i)->as<SequentialStmtBlock>();
+    }
+    EXPECT_NE(block, nullptr);
+    EXPECT_EQ(block->get_conditions().begin()->second.get(), &clk);
+    auto inlined = reinterpret_cast<AssignStmt *>(block->get_child(0));
+    EXPECT_EQ(inlined->left(), q);
+    EXPECT_EQ(inlined->fn_name_ln.size(), 2);
+    EXPECT_EQ(inlined->fn_name_ln[0].first, "reg.py");
+
+    // small generators are selected by size
+    inline_generators(&top, {1, "", ""});
+    EXPECT_EQ(top.get_child_generator_size(), 0);
+    EXPECT_NE(top.get_var("reg_inv_out"), nullptr);
+
+    fix_assignment_type(&top);
+    create_module_instantiation(&top);
+    auto mod_src = generate_verilog(&top);
+    EXPECT_EQ(mod_src.size(), 1);
+    EXPECT_TRUE(is_valid_verilog(mod_src["top"]));
+}
+
 TEST(pass, pass_through_module) {  // NOLINT
     Context c;
     auto &mod1 = c.generator("module1");
@@ -414,4 +1152,146 @@ TEST(pass, decouple_generator_ports) {  // NOLINT
     auto src = verilog.verilog_src();
     EXPECT_EQ(src.size(), 3);
     EXPECT_TRUE(is_valid_verilog(src.at("module1")));
-}
\ No newline at end of file
+}
+TEST(pass, pass_manager_profile) {  // NOLINT
+    Context c;
+    auto &mod = c.generator("module");
+    auto &in = mod.port(PortDirection::In, "in", 1);
+    auto &out = mod.port(PortDirection::Out, "out", 1);
+
+    PassManager manager;
+    manager.add_pass("add_assignment", [&](Generator *generator) {
+        generator->add_stmt(out.assign(in).shared_from_this());
+    });
+    manager.add_pass("fix_assignment_type", &fix_assignment_type);
+
+    // profiling is off by default
+    manager.run_passes(&mod);
+    EXPECT_TRUE(manager.profile().empty());
+
+    mod.remove_stmt(mod.get_stmt(0));
+    manager.set_profiling(true);
+    manager.run_passes(&mod);
+    auto const &profile = manager.profile();
+    EXPECT_EQ(profile.size(), 2);
+    EXPECT_EQ(profile[0].name, "add_assignment");
+    EXPECT_EQ(profile[0].nodes_before.stmts, 0);
+    EXPECT_EQ(profile[0].nodes_after.stmts, 1);
+    // the new statement is allocated from the generator arena
+    EXPECT_GT(profile[0].num_allocations, 0);
+    EXPECT_GT(profile[0].allocated_bytes, 0);
+    EXPECT_GE(profile[0].wall_time, 0);
+    EXPECT_EQ(profile[1].name, "fix_assignment_type");
+    EXPECT_EQ(profile[1].nodes_after.vars, 2);
+
+    auto json = manager.profile_json();
+    EXPECT_NE(json.find("\"add_assignment\""), std::string::npos);
+    EXPECT_NE(json.find("\"fix_assignment_type\""), std::string::npos);
+
+    // pass names are escaped
+    PassManager quoted;
+    quoted.set_profiling(true);
+    quoted.add_pass("a \"quoted\"\\name", [&](Generator *) {});
+    quoted.run_passes(&mod);
+    EXPECT_NE(quoted.profile_json().find(R"("a \"quoted\"\\name")"), std::string::npos);
+}
+
+TEST(pass, pass_manager_analysis) {  // NOLINT
+    Context c;
+    auto &mod = c.generator("module");
+    auto &child = c.generator("child");
+    mod.add_child_generator(child.shared_from_this());
+
+    PassManager manager;
+    std::vector<std::string> order;
+    std::mutex order_mutex;
+    auto record = [&](const std::string &name) {
+        std::lock_guard<std::mutex> guard(order_mutex);
+        order.emplace_back(name);
+    };
+
+    PassInfo use_levels;
+    use_levels.uses = {generator_levels_analysis};
+    use_levels.preserves = {generator_levels_analysis};
+    manager.add_pass("first", [&](Generator *top) {
+        EXPECT_TRUE(manager.analyses().is_cached(generator_levels_analysis));
+        auto levels = manager.analyses().get<GeneratorLevels>(generator_levels_analysis, top);
+        EXPECT_EQ(levels->levels.size(), 2);
+        record("first");
+    }, use_levels);
+    // reuses the cached levels
+    manager.add_pass("second", [&](Generator *) { record("second"); }, use_levels);
+    // invalidates everything
+    manager.add_pass("mutate", [&](Generator *) { record("mutate"); });
+    PassInfo after_check;
+    after_check.dependencies = {"check"};
+    after_check.uses = {generator_levels_analysis};
+    manager.add_pass("after_check", [&](Generator *) { record("after_check"); }, after_check);
+    PassInfo read_only;
+    read_only.read_only = true;
+    manager.add_pass("check", [&](Generator *) { record("check"); }, read_only);
+    manager.add_pass("another_check", [&](Generator *) { record("another_check"); }, read_only);
+
+    EXPECT_EQ(manager.pass_order(), std::vector<std::string>({"first", "second", "mutate",
+                                                              "check", "after_check",
+                                                              "another_check"}));
+    manager.run_passes(&mod);
+    EXPECT_EQ(order.size(), 6);
+    EXPECT_EQ(manager.analyses().num_computations(), 2);
+    // after_check doesn't preserve anything
+    EXPECT_FALSE(manager.analyses().is_cached(generator_levels_analysis));
+
+    PassManager cyclic;
+    PassInfo depends_on_b;
+    depends_on_b.dependencies = {"b"};
+    PassInfo depends_on_a;
+    depends_on_a.dependencies = {"a"};
+    cyclic.add_pass("a", [&](Generator *) {}, depends_on_b);
+    cyclic.add_pass("b", [&](Generator *) {}, depends_on_a);
+    EXPECT_THROW(cyclic.run_passes(&mod), std::runtime_error);
+}
+
+TEST(pass, pass_manager_read_only) {  // NOLINT
+    Context c;
+    auto &mod = c.generator("module");
+
+    // independent read-only passes run concurrently and the error from the first one in
+    // pass order is re-thrown
+    PassManager manager;
+    PassInfo read_only;
+    read_only.read_only = true;
+    manager.add_pass("first", [&](Generator *) { throw std::runtime_error("first"); },
+                     read_only);
+    manager.add_pass("second", [&](Generator *) { throw std::runtime_error("second"); },
+                     read_only);
+    try {
+        manager.run_passes(&mod);
+        FAIL();
+    } catch (const std::runtime_error &error) {
+        EXPECT_EQ(std::string(error.what()), "first");
+    }
+
+    // the checking passes walk the same generator at the same time. statements were removed
+    // beforehand, which must not leave anything for the walks to fix up
+    auto &top = c.generator("top");
+    auto &in = top.port(PortDirection::In, "in", 1);
+    std::vector<std::shared_ptr<Stmt>> removed;
+    for (uint32_t i = 0; i < 64; i++) {
+        auto &var = top.var("v" + std::to_string(i), 1);
+        auto stmt = var.assign(in).shared_from_this();
+        top.add_stmt(stmt);
+        if (i % 2) removed.emplace_back(stmt);
+    }
+    for (auto const &stmt : removed) top.remove_stmt(stmt);
+    fix_assignment_type(&top);
+
+    PassManager checks;
+    for (uint32_t i = 0; i < 4; i++) {
+        checks.add_pass("verify_generator_connectivity" + std::to_string(i),
+                        &verify_generator_connectivity, read_only);
+        checks.add_pass("check_mixed_assignment" + std::to_string(i), &check_mixed_assignment,
+                        read_only);
+    }
+    EXPECT_NO_THROW(checks.run_passes(&top));
+    EXPECT_EQ(top.stmts_count(), 32);
+}
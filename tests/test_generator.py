@@ -1,7 +1,9 @@
 from kratos import Generator, PortDirection, PortType, BlockEdgeType, always, \
     verilog, is_valid_verilog, VarException, StmtException, ASTVisitor, \
     PackedStruct, Port, Attribute
-from kratos.passes import uniquify_generators, hash_generators
+from kratos.passes import uniquify_generators, hash_generators, HashStrategy
+from kratos.sim import Simulator, simulation_cpp
+import _kratos
 import os
 import tempfile
 
@@ -99,6 +101,66 @@ def test_module_unique():
     assert reg1.name != reg2.name
 
 
+def test_module_unique_structural():
+    reg1 = AsyncReg(16)
+    reg2 = AsyncReg(1)
+    reg2.instance_name = "test"
+    parent = Generator("top")
+    parent.add_child_generator("reg1", reg1)
+    parent.add_child_generator("reg2", reg2)
+
+    hash_generators(parent, HashStrategy.StructuralHash)
+    c = Generator.get_context()
+    reg1_hash = c.get_hash(reg1.internal_generator)
+    reg2_hash = c.get_hash(reg2.internal_generator)
+    assert reg1_hash != reg2_hash
+
+
+def test_rehash_dirty():
+    reg1 = AsyncReg(16)
+    reg2 = AsyncReg(16)
+    reg2.instance_name = "test"
+    parent = Generator("top")
+    parent.add_child_generator("reg1", reg1)
+    parent.add_child_generator("reg2", reg2)
+
+    hash_generators(parent, HashStrategy.StructuralHash)
+    assert not parent.internal_generator.is_dirty()
+    c = Generator.get_context()
+    reg_hash = c.get_hash(reg1.internal_generator)
+    assert reg_hash == c.get_hash(reg2.internal_generator)
+
+    reg2.var("extra", 1)
+    assert parent.internal_generator.is_dirty()
+    assert not reg1.internal_generator.is_dirty()
+    hash_generators(parent, HashStrategy.StructuralHash)
+    assert reg_hash == c.get_hash(reg1.internal_generator)
+    assert reg_hash != c.get_hash(reg2.internal_generator)
+
+
+def test_rehash_var_edit():
+    reg1 = AsyncReg(16)
+    reg2 = AsyncReg(16)
+    reg2.instance_name = "test"
+    parent = Generator("top")
+    parent.add_child_generator("reg1", reg1)
+    parent.add_child_generator("reg2", reg2)
+
+    hash_generators(parent, HashStrategy.StructuralHash)
+    c = Generator.get_context()
+    reg_hash = c.get_hash(reg1.internal_generator)
+    assert reg_hash == c.get_hash(reg2.internal_generator)
+
+    # writing a var field directly has to mark the generator dirty
+    var = reg2.internal_generator.get_var("val")
+    var.width = 8
+    assert reg2.internal_generator.is_dirty()
+    assert not reg1.internal_generator.is_dirty()
+    hash_generators(parent, HashStrategy.StructuralHash)
+    assert reg_hash == c.get_hash(reg1.internal_generator)
+    assert reg_hash != c.get_hash(reg2.internal_generator)
+
+
 def test_else_if():
     class ElseIf(Generator):
         def __init__(self):
@@ -578,6 +640,29 @@ def test_verilog_file():
             assert is_valid_verilog(src)
 
 
+def test_verilog_output_dir():
+    mod = PassThroughTop()
+    with tempfile.TemporaryDirectory() as tempdir:
+        manifest = verilog(mod, optimize_passthrough=False, output_dir=tempdir)
+        assert len(manifest) == 2
+        for mod_name, filename in manifest.items():
+            assert filename == os.path.join(tempdir, mod_name + ".sv")
+            with open(filename) as f:
+                assert is_valid_verilog(f.read())
+
+
+def test_verilog_cache_dir():
+    with tempfile.TemporaryDirectory() as tempdir:
+        mod_src = verilog(PassThroughTop(), optimize_passthrough=False,
+                          cache_dir=tempdir)
+        assert len(os.listdir(tempdir)) == 2
+        Generator.clear_context()
+        cached_src = verilog(PassThroughTop(), optimize_passthrough=False,
+                             cache_dir=tempdir)
+        assert len(os.listdir(tempdir)) == 2
+        assert mod_src == cached_src
+
+
 def test_attribute():
     mod = PassThroughTop()
     stmt = mod.get_stmt_by_index(0)
@@ -614,5 +699,161 @@ def test_wire_merge():
     assert is_valid_verilog(src)
 
 
+def test_pass_profile():
+    mod = PassThroughTop()
+    code_gen = _kratos.VerilogModule(mod.internal_generator)
+    pass_manager = code_gen.pass_manager()
+    pass_manager.set_profiling(True)
+    code_gen.run_passes(True, True, True, True)
+    profile = pass_manager.profile()
+    assert "hash_generators" in profile
+    entry = profile["hash_generators"]
+    assert entry["wall_time"] >= 0
+    assert entry["nodes_after"]["generators"] == 2
+    assert "hash_generators" in pass_manager.profile_json()
+
+
+def test_pass_dependency():
+    mod = PassThroughTop()
+    pass_manager = _kratos.passes.PassManager()
+    order = []
+    info = _kratos.passes.PassInfo()
+    info.dependencies = ["check"]
+    info.uses = ["generator_levels"]
+    pass_manager.add_pass("count", lambda _: order.append("count"), info)
+    info = _kratos.passes.PassInfo()
+    info.read_only = True
+    pass_manager.add_pass("check", lambda _: order.append("check"), info)
+    assert pass_manager.pass_order() == ["check", "count"]
+    pass_manager.run_passes(mod.internal_generator)
+    assert order == ["check", "count"]
+    assert not pass_manager.is_analysis_cached("generator_levels")
+
+
+def test_const_wide():
+    class Mod(Generator):
+        def __init__(self):
+            super().__init__("mod")
+            self.out_ = self.port("out", 128, PortDirection.Out)
+            self.wire(self.out_, self.const(1 << 100, 128))
+
+    mod = Mod()
+    src = verilog(mod)["mod"]
+    assert "128'h10000000000000000000000000" in src
+    assert is_valid_verilog(src)
+
+
+def test_simulator():
+    reg = AsyncReg(16)
+    sim = Simulator(reg)
+    sim.poke("rst", 1)
+    sim.poke("in", 42)
+    assert sim.peek("out") == 0
+    sim.step()
+    assert sim.peek("out") == 42
+    # reset is active low in the register
+    sim.poke("rst", 0)
+    sim.step()
+    assert sim.peek("out") == 0
+
+
+def test_simulation_cpp():
+    reg = AsyncReg(16)
+    src = simulation_cpp(reg, 8)
+    assert "class register_sim {" in src
+    assert "lanes = 8;" in src
+
+
+def test_fold_constants():
+    mod = Generator("mod")
+    in_ = mod.port("in", 4, PortDirection.In)
+    out = mod.port("out", 4, PortDirection.Out)
+    a = mod.var("a", 4)
+    mod.wire(a, mod.const(2, 4) + mod.const(3, 4))
+    mod.wire(out, (in_ & mod.const(15, 4)) + a)
+    src = verilog(mod, fold_constants=True)["mod"]
+    assert is_valid_verilog(src)
+    assert "in + 4'h5" in src
+
+
+def test_eliminate_common_subexpressions():
+    mod = Generator("mod")
+    a = mod.port("a", 4, PortDirection.In)
+    b = mod.port("b", 4, PortDirection.In)
+    out1 = mod.port("out1", 4, PortDirection.Out)
+    out2 = mod.port("out2", 4, PortDirection.Out)
+    mod.wire(out1, (a + b) ^ a)
+    mod.wire(out2, (a + b) ^ b)
+    src = verilog(mod, cse_min_size=3)["mod"]
+    assert is_valid_verilog(src)
+    assert "assign cse_0 = a + b;" in src
+    assert "assign out1 = cse_0 ^ a;" in src
+
+
+def test_remove_dead_logic():
+    class Child(Generator):
+        def __init__(self):
+            super().__init__("child")
+            in_ = self.port("in", 4, PortDirection.In)
+            self.wire(self.port("out", 4, PortDirection.Out), in_)
+            self.wire(self.port("unused", 4, PortDirection.Out), ~in_)
+
+    mod = Generator("mod")
+    in_ = mod.port("in", 4, PortDirection.In)
+    out = mod.port("out", 4, PortDirection.Out)
+    child = Child()
+    mod.add_child_generator("child", child)
+    mod.wire(child.ports["in"], in_)
+    mod.wire(out, child.ports.out)
+    mod.wire(mod.var("dead", 4), child.ports.unused)
+    src = verilog(mod, remove_dead_logic=True)
+    assert "dead" not in src["mod"]
+    assert "unused" not in src["child"]
+    assert is_valid_verilog(src["child"])
+
+
+def test_var_sinks_order():
+    mod = Generator("mod")
+    in_ = mod.port("in", 4, PortDirection.In)
+    names = ["d", "b", "e", "a", "c"]
+    for name in names:
+        mod.wire(mod.var(name, 4), in_)
+    # connection order, not hash order
+    sinks = in_.sinks()
+    assert isinstance(sinks, list)
+    assert [stmt.left.name for stmt in sinks] == names
+    assert [stmt.right.name for stmt in mod.var("c", 4).sources()] == ["in"]
+
+
+
+def test_inline_generators():
+    class Register(Generator):
+        def __init__(self):
+            super().__init__("register")
+            self.clk = self.port("clk", 1, PortDirection.In, PortType.Clock)
+            self.in_ = self.port("in", 4, PortDirection.In)
+            self.out_ = self.port("out", 4, PortDirection.Out)
+            self.add_code(self.code)
+
+        @always([(BlockEdgeType.Posedge, "clk")])
+        def code(self):
+            self.out_ = self.in_
+
+    mod = Generator("mod")
+    clk = mod.port("clk", 1, PortDirection.In, PortType.Clock)
+    in_ = mod.port("in", 4, PortDirection.In)
+    out = mod.port("out", 4, PortDirection.Out)
+    for i in range(2):
+        reg = Register()
+        mod.add_child_generator("reg{0}".format(i), reg)
+        mod.wire(reg.ports.clk, clk)
+        mod.wire(reg.ports["in"], in_ if i == 0 else mod["reg0"].ports.out)
+    mod.wire(out, mod["reg1"].ports.out)
+    src = verilog(mod, inline_pattern="reg.*")
+    assert "register" not in src
+    assert "reg0_out <= in;" in src["mod"]
+    assert "reg1_out <= reg0_out;" in src["mod"]
+    assert is_valid_verilog(src["mod"])
+
 if __name__ == "__main__":
     test_attribute()
@@ -0,0 +1,271 @@
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include "../src/generator.hh"
+#include "../src/simgen.hh"
+#include "../src/stmt.hh"
+#include "fmt/format.h"
+#include "gtest/gtest.h"
+
+namespace fs = std::filesystem;
+
+TEST(sim, comb) {  // NOLINT
+    Context c;
+    auto &mod = c.generator("mod");
+    auto &a = mod.port(PortDirection::In, "a", 8);
+    auto &b = mod.port(PortDirection::In, "b", 8);
+    auto &sel = mod.port(PortDirection::In, "sel", 2);
+    auto &out = mod.port(PortDirection::Out, "out", 8);
+    auto &sum = mod.var("sum", 8);
+    auto &flags = mod.var("flags", 2);
+    // declared in reverse order to exercise the levelization
+    auto comb = mod.combinational();
+    auto switch_ = std::make_shared<SwitchStmt>(sel.shared_from_this());
+    switch_->add_switch_case(mod.constant(0, 2).as<Const>(), out.assign(sum).shared_from_this());
+    switch_->add_switch_case(mod.constant(1, 2).as<Const>(),
+                             out.assign(a - b).shared_from_this());
+    switch_->add_switch_case(nullptr, out.assign(flags.concat(sum[{5, 0}])).shared_from_this());
+    comb->add_statement(switch_);
+    mod.add_stmt(sum.assign(a + b).shared_from_this());
+    mod.add_stmt(flags[0].assign(a < b).shared_from_this());
+    mod.add_stmt(flags[1].assign(a.eq(b)).shared_from_this());
+
+    Simulator sim(&mod);
+    sim.poke("a", 200);
+    sim.poke("b", 100);
+    EXPECT_EQ(sim.peek("sum"), 44);
+    EXPECT_EQ(sim.peek("out"), 44);
+    sim.poke("sel", 1);
+    EXPECT_EQ(sim.peek("out"), 100);
+    sim.poke("sel", 3);
+    sim.poke(&b, 201);
+    EXPECT_EQ(sim.peek("flags"), 1);
+    EXPECT_EQ(sim.peek(&out), 0b01010001);
+    EXPECT_EQ(sim.peek(&(a + b)), 145);
+    EXPECT_ANY_THROW(sim.peek("c"));
+}
+
+TEST(sim, seq) {  // NOLINT
+    Context c;
+    auto &mod = c.generator("mod");
+    auto &clk = mod.port(PortDirection::In, "clk", 1, PortType::Clock, false);
+    auto &rst = mod.port(PortDirection::In, "rst", 1, PortType::AsyncReset, false);
+    auto &en = mod.port(PortDirection::In, "en", 1);
+    auto &out = mod.port(PortDirection::Out, "out", 4);
+    auto &count = mod.var("count", 4);
+    auto &a = mod.var("a", 4);
+    auto &b = mod.var("b", 4);
+
+    auto seq = mod.sequential();
+    seq->add_condition({BlockEdgeType::Posedge, clk.shared_from_this()});
+    seq->add_condition({BlockEdgeType::Posedge, rst.shared_from_this()});
+    auto if_rst = std::make_shared<IfStmt>(rst);
+    if_rst->add_then_stmt(count.assign(mod.constant(0, 4)));
+    if_rst->add_then_stmt(a.assign(mod.constant(1, 4)));
+    if_rst->add_then_stmt(b.assign(mod.constant(2, 4)));
+    auto if_en = std::make_shared<IfStmt>(en);
+    if_en->add_then_stmt(count.assign(count + mod.constant(1, 4)));
+    // non-blocking swap
+    if_en->add_then_stmt(a.assign(b));
+    if_en->add_then_stmt(b.assign(a));
+    if_rst->add_else_stmt(if_en);
+    seq->add_statement(if_rst);
+    mod.add_stmt(out.assign(count).shared_from_this());
+
+    Simulator sim(&mod);
+    sim.poke("count", 5);
+    // asynchronous reset
+    sim.poke("rst", 1);
+    EXPECT_EQ(sim.peek("out"), 0);
+    sim.poke("rst", 0);
+    sim.step();
+    EXPECT_EQ(sim.peek("out"), 0);
+    sim.poke("en", 1);
+    for (uint32_t i = 0; i < 17; i++) sim.step();
+    EXPECT_EQ(sim.peek("out"), 1);
+    EXPECT_EQ(sim.peek("a"), 2);
+    EXPECT_EQ(sim.peek("b"), 1);
+    // no edge
+    sim.poke("clk", 0);
+    EXPECT_EQ(sim.peek("out"), 1);
+}
+
+TEST(sim, hierarchy) {  // NOLINT
+    Context c;
+    auto &top = c.generator("top");
+    auto &child = c.generator("child");
+    auto &in = top.port(PortDirection::In, "in", 8, PortType::Data, true);
+    auto &out = top.port(PortDirection::Out, "out", 8, PortType::Data, true);
+    auto &child_in = child.port(PortDirection::In, "in", 8, PortType::Data, true);
+    auto &child_out = child.port(PortDirection::Out, "out", 8, PortType::Data, true);
+    child.add_stmt(child_out.assign(child_in.ashr(child.constant(2, 8, true))).shared_from_this());
+    top.add_child_generator(child.shared_from_this());
+    top.add_stmt(child_in.assign(in).shared_from_this());
+    top.add_stmt(out.assign(child_out).shared_from_this());
+
+    Simulator sim(&top);
+    sim.poke("in", static_cast<uint64_t>(-16));
+    EXPECT_EQ(sim.peek("child.in"), 0xF0);
+    EXPECT_EQ(sim.peek("out"), 0xFC);
+    EXPECT_ANY_THROW(sim.step());
+}
+
+TEST(sim, child_clock) {  // NOLINT
+    Context c;
+    auto &top = c.generator("top");
+    auto &child = c.generator("child");
+    auto &clk = top.port(PortDirection::In, "clk", 1, PortType::Clock, false);
+    auto &out = top.port(PortDirection::Out, "out", 4);
+    auto &child_clk = child.port(PortDirection::In, "clk", 1, PortType::Clock, false);
+    auto &child_out = child.port(PortDirection::Out, "out", 4);
+    auto &count = child.var("count", 4);
+    auto seq = child.sequential();
+    seq->add_condition({BlockEdgeType::Posedge, child_clk.shared_from_this()});
+    seq->add_statement(count.assign(count + child.constant(1, 4)));
+    child.add_stmt(child_out.assign(count).shared_from_this());
+    top.add_child_generator(child.shared_from_this());
+    top.add_stmt(child_clk.assign(clk).shared_from_this());
+    top.add_stmt(out.assign(child_out).shared_from_this());
+
+    Simulator sim(&top);
+    for (uint32_t i = 0; i < 3; i++) sim.step();
+    EXPECT_EQ(sim.peek("out"), 3);
+}
+
+TEST(sim, codegen) {  // NOLINT
+    Context c;
+    auto &mod = c.generator("mod");
+    auto &clk = mod.port(PortDirection::In, "clk", 1, PortType::Clock, false);
+    auto &in = mod.port(PortDirection::In, "in", 8);
+    auto &out = mod.port(PortDirection::Out, "out", 8);
+    auto &val = mod.var("val", 8);
+    auto seq = mod.sequential();
+    seq->add_condition({BlockEdgeType::Posedge, clk.shared_from_this()});
+    seq->add_statement(val.assign(val + in));
+    mod.add_stmt(out[{3, 0}].assign(val[{7, 4}]).shared_from_this());
+    mod.add_stmt(out[{7, 4}].assign(val[{3, 0}]).shared_from_this());
+
+    SimulationCodeGen codegen(&mod, 16);
+    auto const src = codegen.str();
+    EXPECT_EQ(codegen.class_name(), "mod_sim");
+    EXPECT_NE(src.find("class mod_sim {"), std::string::npos);
+    EXPECT_NE(src.find("static constexpr uint32_t lanes = 16;"), std::string::npos);
+    EXPECT_NE(src.find("\"val\""), std::string::npos);
+    // the register update is deferred
+    EXPECT_NE(src.find("_set = true;"), std::string::npos);
+    EXPECT_ANY_THROW(SimulationCodeGen(&mod, 0));
+}
+
+#ifdef KRATOS_CXX_COMPILER
+TEST(sim, codegen_compiled) {  // NOLINT
+    // builds the generated model with the configured compiler and runs it against Simulator
+    Context c;
+    auto &top = c.generator("top");
+    auto &child = c.generator("child");
+    auto &clk = top.port(PortDirection::In, "clk", 1, PortType::Clock, false);
+    auto &rst = top.port(PortDirection::In, "rst", 1, PortType::AsyncReset, false);
+    auto &a = top.port(PortDirection::In, "a", 8, PortType::Data, true);
+    auto &b = top.port(PortDirection::In, "b", 8, PortType::Data, true);
+    auto &sel = top.port(PortDirection::In, "sel", 2);
+    auto &out = top.port(PortDirection::Out, "out", 8, PortType::Data, true);
+    auto &acc = top.port(PortDirection::Out, "acc", 8, PortType::Data, true);
+    auto &mix = top.var("mix", 8, true);
+    auto &child_in = child.port(PortDirection::In, "in", 8, PortType::Data, true);
+    auto &child_out = child.port(PortDirection::Out, "out", 8, PortType::Data, true);
+    child.add_stmt(child_out.assign(child_in.ashr(child.constant(1, 8, true))).shared_from_this());
+    top.add_child_generator(child.shared_from_this());
+    top.add_stmt(child_in.assign(a - b).shared_from_this());
+    top.add_stmt(mix[{7, 4}].assign(a[{3, 0}]).shared_from_this());
+    top.add_stmt(mix[{3, 0}].assign(b[{7, 4}]).shared_from_this());
+
+    auto comb = top.combinational();
+    auto switch_ = std::make_shared<SwitchStmt>(sel.shared_from_this());
+    switch_->add_switch_case(top.constant(0, 2).as<Const>(),
+                             out.assign(child_out).shared_from_this());
+    switch_->add_switch_case(top.constant(1, 2).as<Const>(), out.assign(a + b).shared_from_this());
+    switch_->add_switch_case(nullptr, out.assign(mix).shared_from_this());
+    comb->add_statement(switch_);
+
+    auto seq = top.sequential();
+    seq->add_condition({BlockEdgeType::Posedge, clk.shared_from_this()});
+    seq->add_condition({BlockEdgeType::Posedge, rst.shared_from_this()});
+    auto if_rst = std::make_shared<IfStmt>(rst);
+    if_rst->add_then_stmt(acc.assign(top.constant(0, 8, true)));
+    if_rst->add_else_stmt(acc.assign(acc + out.ashr(top.constant(2, 8, true))));
+    seq->add_statement(if_rst);
+
+    constexpr uint32_t lanes = 16;
+    constexpr uint32_t cycles = 200;
+    std::vector<std::string> const inputs = {"rst", "a", "b", "sel"};
+    std::vector<std::string> const outputs = {"out", "acc", "mix", "child.out"};
+
+    std::mt19937_64 rand(42);  // NOLINT
+    // stimulus[cycle][input][lane]
+    std::vector<std::vector<std::vector<uint64_t>>> stimulus(cycles);
+    for (auto &inputs_value : stimulus) {
+        inputs_value.resize(inputs.size(), std::vector<uint64_t>(lanes));
+        for (uint32_t l = 0; l < lanes; l++) {
+            inputs_value[0][l] = rand() % 16 == 0;
+            inputs_value[1][l] = rand() & 0xFFu;
+            inputs_value[2][l] = rand() & 0xFFu;
+            inputs_value[3][l] = rand() & 0x3u;
+        }
+    }
+
+    SimulationCodeGen codegen(&top, lanes);
+    auto const dir = fs::temp_directory_path() / ::fmt::format("kratos_sim_{0:x}", rand());
+    fs::create_directories(dir);
+    {
+        std::ofstream stream(dir / "model.cc");
+        stream << codegen.str() << "#include <cstdio>" << std::endl
+               << "#include <fstream>" << std::endl
+               << "int main(int, char *argv[]) {" << std::endl
+               << "    static " << codegen.class_name() << " model;" << std::endl
+               << "    std::ifstream in(argv[1]);" << std::endl
+               << "    for (uint32_t i = 0; i < " << cycles << "; i++) {" << std::endl;
+        for (auto const &name : inputs) {
+            stream << "        for (auto &v : model.values[model.net_index(\"" << name
+                   << "\")]) in >> v;" << std::endl;
+        }
+        stream << "        model.step(model.net_index(\"clk\"));" << std::endl;
+        for (auto const &name : outputs) {
+            stream << "        for (auto v : model.values[model.net_index(\"" << name
+                   << "\")]) std::printf(\"%llu\\n\", static_cast<unsigned long long>(v));"
+                   << std::endl;
+        }
+        stream << "    }" << std::endl << "}" << std::endl;
+        std::ofstream stimulus_stream(dir / "stimulus.txt");
+        for (auto const &inputs_value : stimulus) {
+            for (auto const &lane_values : inputs_value) {
+                for (auto v : lane_values) stimulus_stream << v << std::endl;
+            }
+        }
+    }
+    auto const exe = (dir / "model").string();
+    auto const compile = ::fmt::format("\"{0}\" -std=c++17 -O1 -o \"{1}\" \"{2}\"",
+                                       KRATOS_CXX_COMPILER, exe, (dir / "model.cc").string());
+    ASSERT_EQ(std::system(compile.c_str()), 0);
+    auto const run = ::fmt::format("\"{0}\" \"{1}\" > \"{2}\"", exe,
+                                   (dir / "stimulus.txt").string(), (dir / "result.txt").string());
+    ASSERT_EQ(std::system(run.c_str()), 0);
+
+    std::vector<std::unique_ptr<Simulator>> sims;
+    for (uint32_t l = 0; l < lanes; l++) sims.emplace_back(std::make_unique<Simulator>(&top));
+    std::ifstream result(dir / "result.txt");
+    for (uint32_t i = 0; i < cycles; i++) {
+        for (uint32_t l = 0; l < lanes; l++) {
+            for (uint64_t j = 0; j < inputs.size(); j++) sims[l]->poke(inputs[j], stimulus[i][j][l]);
+            sims[l]->step();
+        }
+        for (auto const &name : outputs) {
+            for (uint32_t l = 0; l < lanes; l++) {
+                uint64_t value = 0;
+                ASSERT_TRUE(result >> value);
+                EXPECT_EQ(value, sims[l]->peek(name)) << name << " lane " << l << " cycle " << i;
+            }
+        }
+    }
+    fs::remove_all(dir);
+}
+#endif